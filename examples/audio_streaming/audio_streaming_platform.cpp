@@ -17,25 +17,42 @@
  */
 
 #include "anbox-platform-sdk/plugin.h"
+#include "anbox-platform-sdk/audio_pcm.h"
+#include "anbox-platform-sdk/audio_resampler.h"
+#include "anbox-platform-sdk/audio_shared_ring.h"
+#include "anbox-platform-sdk/blocking_queue.h"
+#include "anbox-platform-sdk/trace.h"
 
+#include <algorithm>
 #include <chrono>
-#include <future>
+#include <condition_variable>
 #include <mutex>
-#include <queue>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 }
 
-namespace chrono = std::chrono;
+// Encoders can output into buffers of our own since libavcodec 58.134
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 134, 100)
+#define HAVE_ENCODE_BUFFER 1
+#endif
 
 #ifndef SYSTEM_LIBDIR
 #define SYSTEM_LIBDIR
@@ -50,15 +67,125 @@ constexpr const char* opengl_es2_driver_path = SYSTEM_LIBDIR  "/anbox/angle/libG
 constexpr const char* egl_driver_path = SYSTEM_LIBDIR  "/anbox/angle/libEGL.so";
 
 constexpr const char* output_url = "rtp://127.0.0.1:37777";
-constexpr int max_audio_buffer_size = 50 * 1024;
-constexpr int frame_duration = 100;
+constexpr size_t audio_buffer_size = 64 * 1024;
+// Upper bound for write_data to wait for the encoder to free up space
+constexpr std::chrono::milliseconds max_write_blocking_time{100};
+// Number of timestamps of written audio data the encoder can lag behind
+constexpr size_t max_pending_timestamps = 64;
+constexpr uint64_t nsecs_per_sec = 1000000000ULL;
+// Encoded packets in flight between the encoder and the muxer
+constexpr size_t packet_pool_size = 32;
+// Size of the pooled packet payloads, which fits any Opus or MP3 frame.
+// Larger packets get a buffer of their own.
+constexpr int packet_payload_size = 4096;
+
+// Platform specific configuration items to switch the audio codec at runtime
+constexpr int audio_codec_config_id = PLATFORM_CONFIGURATION_ID_START;
+constexpr int audio_frame_duration_config_id = PLATFORM_CONFIGURATION_ID_START + 1;
+constexpr int audio_bit_rate_config_id = PLATFORM_CONFIGURATION_ID_START + 2;
+constexpr int audio_complexity_config_id = PLATFORM_CONFIGURATION_ID_START + 3;
+constexpr const char* audio_codec_mp3 = "mp3";
+constexpr const char* audio_codec_opus = "opus";
+constexpr uint32_t min_bit_rate = 6000;
+constexpr uint32_t max_bit_rate = 510000;
+constexpr uint32_t max_complexity = 10;
+// Opus only runs at these rates, anything else is resampled to the first one
+constexpr uint32_t opus_sample_rates[] = {48000, 24000, 16000, 12000, 8000};
+constexpr uint32_t opus_frame_durations_us[] = {2500, 5000, 10000, 20000};
+
+// Recorded audio is received as RTP stream of 16 bit PCM (L16, RFC 3551),
+// e.g. `ffmpeg -re -i input.wav -ac 1 -ar 44100 -f rtp rtp://127.0.0.1:37778`
+constexpr const char* input_address = "127.0.0.1";
+constexpr uint16_t input_port = 37778;
+constexpr size_t capture_buffer_size = 64 * 1024;
+constexpr size_t max_datagram_size = 2048;
+constexpr size_t rtp_header_size = 12;
+constexpr uint8_t rtp_version = 2;
+constexpr uint8_t rtp_payload_type_l16_stereo = 10;
+constexpr uint8_t rtp_payload_type_l16_mono = 11;
+constexpr uint8_t rtp_first_dynamic_payload_type = 96;
+// Audio the jitter buffer collects before handing it out, both initially and
+// after an underrun, and the maximum it keeps before dropping old audio.
+constexpr std::chrono::milliseconds jitter_buffer_target{40};
+constexpr std::chrono::milliseconds jitter_buffer_max{200};
+
+uint64_t monotonic_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * nsecs_per_sec + ts.tv_nsec;
+}
+
+// Computes value * num / den without overflowing for streams running for
+// days, as long as num * den fits into 64 bit.
+uint64_t mul_div(uint64_t value, uint64_t num, uint64_t den) {
+  return value / den * num + value % den * num / den;
+}
 } // namespace
 
 namespace anbox {
-struct AudioBuffer {
-  uint8_t data[max_audio_buffer_size];
-  std::atomic<uint32_t> size{0};
-  std::mutex mutex;
+// Lets the writer sleep until the encoder thread made progress. The data
+// itself is exchanged through a lock-free ring, the mutex is only taken
+// when the writer actually has to wait.
+class AudioBufferSignal {
+ public:
+  template <typename Predicate>
+  bool wait_for(std::atomic_bool& waiting, std::chrono::milliseconds timeout, Predicate pred) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto ret = cond_.wait_for(lock, timeout, pred);
+    waiting.store(false);
+    return ret;
+  }
+
+  void notify(const std::atomic_bool& waiting) {
+    // Pairs with storing the waiting flag: either the waiter sees the new
+    // state when evaluating its predicate or we see it waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiting.load())
+      return;
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    cond_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+};
+
+enum class AudioCodec {
+  MP3,
+  // Low delay with frames down to 2.5ms for interactive use
+  Opus,
+};
+
+struct AudioEncoderConfig {
+  AudioCodec codec{AudioCodec::MP3};
+  // Opus only, MP3 frames always hold 1152 samples
+  uint32_t frame_duration_us{20000};
+  uint32_t bit_rate{64000};
+  // Opus only, from 0 (fastest) to 10 (best quality)
+  uint32_t complexity{max_complexity};
+
+  bool operator==(const AudioEncoderConfig& other) const {
+    return codec == other.codec && frame_duration_us == other.frame_duration_us &&
+           bit_rate == other.bit_rate && complexity == other.complexity;
+  }
+
+  bool is_valid() const {
+    if (bit_rate < min_bit_rate || bit_rate > max_bit_rate || complexity > max_complexity)
+      return false;
+    if (codec == AudioCodec::MP3)
+      return true;
+    return std::find(std::begin(opus_frame_durations_us), std::end(opus_frame_durations_us),
+                     frame_duration_us) != std::end(opus_frame_durations_us);
+  }
+};
+
+// Presentation time of the audio data starting at a byte position in the stream.
+struct AudioTimestamp {
+  uint64_t position;
+  uint64_t time_ns;
 };
 
 struct Context {
@@ -66,10 +193,43 @@ struct Context {
   AVCodecContext*  codec_context{nullptr};
   AVStream* stream{nullptr};
   AVFrame*  frame{nullptr};
-  AVPacket  pkt;
+  // Encoder thread only: the pool packet the encoder outputs to next and the
+  // packet which takes the output while the muxer holds the whole pool.
+  AVPacket* packet{nullptr};
+  AVPacket* overflow_packet{nullptr};
+  uint64_t  dropped_packets{0};
   uint8_t*  frame_buffer{nullptr};
   size_t    frame_buffer_size{0};
-  uint32_t  pts_index{0};
+  size_t    bytes_per_sec{0};
+  // Audio data which the encoder can't take as is gets converted from the
+  // input buffer into the frame buffer first.
+  AnboxAudioFormat input_format{AUDIO_FORMAT_INVALID};
+  AnboxAudioFormat codec_format{AUDIO_FORMAT_INVALID};
+  uint8_t   input_channels{0};
+  uint8_t   codec_channels{0};
+  uint8_t*  input_buffer{nullptr};
+  size_t    input_frame_size{0};
+  // Codecs which don't support the rate of the stream get it resampled. The
+  // resampler output is collected until it fills a whole frame.
+  uint32_t  input_rate{0};
+  std::unique_ptr<AudioResampler> resampler;
+  std::vector<float> resampler_input;
+  std::vector<float> resampler_output;
+  size_t    resampled_frames{0};
+  // Encoder thread only: the byte position of the next frame in the stream
+  // and the timestamps it is currently extrapolating from. These survive
+  // switching the codec, the stream itself goes on.
+  uint64_t  position{0};
+  uint64_t  start_position{0};
+  // Position of the audio data read from the ring so far
+  uint64_t  read_position{0};
+  uint64_t  encoded_frames{0};
+  AudioTimestamp anchor{0, 0};
+  AudioTimestamp next_anchor{0, 0};
+  bool      has_anchor{false};
+  bool      has_next_anchor{false};
+  uint64_t  start_time_ns{0};
+  int64_t   last_pts{-1};
 };
 
 static AVSampleFormat audio_format_to_av_sample_format(AnboxAudioFormat format) {
@@ -81,9 +241,10 @@ static AVSampleFormat audio_format_to_av_sample_format(AnboxAudioFormat format)
   case AUDIO_FORMAT_PCM_32_BIT:
     return AV_SAMPLE_FMT_S32;
   case AUDIO_FORMAT_PCM_FLOAT:
-    return AV_SAMPLE_FMT_FLT;
+  // Converted to float before encoding
   case AUDIO_FORMAT_PCM_8_24_BIT:
   case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+    return AV_SAMPLE_FMT_FLT;
   default:
     return AV_SAMPLE_FMT_NONE;
   }
@@ -114,7 +275,14 @@ static int audio_channel_to_av_channel_format(uint8_t channels) {
   switch (channels) {
   case 1:
     return AV_CH_LAYOUT_MONO;
+  // Anything beyond stereo is mixed down to stereo by pcm::remix() before encoding
   case 2:
+  case 3:
+  case 4:
+  case 5:
+  case 6:
+  case 7:
+  case 8:
     return AV_CH_LAYOUT_STEREO;
   default:
     return -EINVAL;
@@ -142,45 +310,373 @@ static int audio_encode(AVCodecContext *codec_context, AVPacket *packet, AVFrame
   return 0;
 }
 
-class AudioStreamingPlatformAudioProcessor : public AudioProcessor {
+#if defined(HAVE_ENCODE_BUFFER)
+// Hands out the payload buffers of encoded packets from the AVBufferPool set
+// as opaque of the codec context. Unreferencing the packet returns it.
+static int get_pooled_encode_buffer(AVCodecContext* codec_context, AVPacket* packet, int flags) {
+  auto pool = static_cast<AVBufferPool*>(codec_context->opaque);
+  if (!pool || packet->size > packet_payload_size - AV_INPUT_BUFFER_PADDING_SIZE)
+    return avcodec_default_get_encode_buffer(codec_context, packet, flags);
+
+  packet->buf = av_buffer_pool_get(pool);
+  if (!packet->buf)
+    return AVERROR(ENOMEM);
+  packet->data = packet->buf->data;
+  memset(packet->data + packet->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+  return 0;
+}
+#endif
+
+// Sends a packet to the single stream of the muxer. The muxer doesn't take
+// over the payload, which is released right after, i.e. goes back into the
+// payload pool.
+static void write_packet(AVFormatContext* format_context, AVPacket* packet) {
+  av_write_frame(format_context, packet);
+  av_packet_unref(packet);
+}
+
+// Receives recorded audio from a local socket and buffers it until
+// AudioProcessor::read_data asks for it. Reads are paced to real time like
+// with a microphone, so a read returns at the latest once the audio it asks
+// for is due. Whatever did not arrive until then is filled up with silence.
+class AudioCaptureStream {
  public:
-  AudioStreamingPlatformAudioProcessor(const AnboxAudioSpec& audio_spec);
+  static std::unique_ptr<AudioCaptureStream> create(const AnboxAudioSpec& spec) {
+    // L16 is the only payload we take, so the stream must be 16 bit as well
+    if (spec.format != AUDIO_FORMAT_PCM_16_BIT || spec.channels == 0 || spec.freq == 0) {
+      errno = EINVAL;
+      return nullptr;
+    }
+
+    const int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      return nullptr;
+
+    const int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(input_port);
+    inet_pton(AF_INET, input_address, &addr.sin_addr);
+    if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+      const int err = errno;
+      ::close(fd);
+      errno = err;
+      return nullptr;
+    }
+
+    // Lets the receiver sleep until a packet arrives instead of polling for
+    // the stop condition
+    const int stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stop_fd < 0) {
+      const int err = errno;
+      ::close(fd);
+      errno = err;
+      return nullptr;
+    }
+
+    const size_t frame_size = spec.channels * pcm::bytes_per_sample(spec.format);
+    auto ring = AudioSharedRing::create(capture_buffer_size, spec.samples * frame_size);
+    if (!ring) {
+      const int err = errno;
+      ::close(stop_fd);
+      ::close(fd);
+      errno = err;
+      return nullptr;
+    }
+    return std::unique_ptr<AudioCaptureStream>(new AudioCaptureStream(spec, fd, stop_fd, std::move(ring)));
+  }
+
+  ~AudioCaptureStream() {
+    const uint64_t value = 1;
+    if (::write(stop_fd_, &value, sizeof(value)) < 0)
+      std::cerr << "Failed to stop audio capture " << strerror(errno) << std::endl;
+    if (receive_thread_.joinable())
+      receive_thread_.join();
+    ::close(stop_fd_);
+    ::close(socket_fd_);
+  }
+
+  ssize_t read(uint8_t* data, size_t size) {
+    if (reset_.exchange(false)) {
+      drop(ring_->size());
+      buffering_ = true;
+      next_read_ = std::chrono::steady_clock::time_point{};
+    }
+
+    // A caller which fell behind doesn't get to catch up, otherwise the
+    // following reads would return immediately and drain the buffer.
+    const auto now = std::chrono::steady_clock::now();
+    next_read_ = std::max(next_read_, now) + std::chrono::nanoseconds(size * nsecs_per_sec / bytes_per_sec_);
+    const auto deadline = next_read_;
+
+    size_t copied = 0;
+    for (;;) {
+      if (buffering_ && ring_->size() >= target_bytes_)
+        buffering_ = false;
+
+      if (!buffering_) {
+        const auto depth = ring_->size();
+        if (depth > max_bytes_)
+          drop(depth - target_bytes_);
+        copied += ring_->read(data + copied, size - copied);
+        if (copied == size)
+          break;
+      }
+
+      const auto remaining = deadline - std::chrono::steady_clock::now();
+      if (remaining.count() <= 0)
+        break;
+      // Every read drains the ring, so the next packet rings the doorbell
+      const auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+          remaining + std::chrono::milliseconds(1) - std::chrono::nanoseconds(1));
+      ring_->wait(buffering_ ? target_bytes_ : 1, static_cast<int>(timeout.count()));
+    }
+
+    if (copied < size) {
+      memset(data + copied, 0, size - copied);
+      if (!buffering_) {
+        underruns_++;
+        buffering_ = true;
+        ANBOX_TRACE_COUNTER("audio_streaming", "capture_underruns", underruns_);
+      }
+    }
+    ANBOX_TRACE_COUNTER("audio_streaming", "capture_buffer_depth", ring_->size());
+    return static_cast<ssize_t>(size);
+  }
+
+  // Start over with an empty jitter buffer once the stream is reactivated
+  void reset() { reset_.store(true); }
+
+ private:
+  AudioCaptureStream(const AnboxAudioSpec& spec, int socket_fd, int stop_fd,
+                     std::unique_ptr<AudioSharedRing> ring) :
+    socket_fd_{socket_fd},
+    stop_fd_{stop_fd},
+    ring_{std::move(ring)},
+    frame_size_{spec.channels * pcm::bytes_per_sample(spec.format)},
+    bytes_per_sec_{spec.freq * frame_size_},
+    target_bytes_{align(bytes_per_sec_ * jitter_buffer_target.count() / 1000)},
+    max_bytes_{align(std::min<size_t>(bytes_per_sec_ * jitter_buffer_max.count() / 1000,
+                                      ring_->capacity()))},
+    payload_type_{spec.channels == 1 ? rtp_payload_type_l16_mono : rtp_payload_type_l16_stereo},
+    scratch_(max_datagram_size) {
+    receive_thread_ = std::thread(&AudioCaptureStream::receive_audio_data, this);
+  }
+
+  size_t align(size_t size) const { return size - size % frame_size_; }
+
+  void drop(size_t size) {
+    while (size > 0) {
+      const auto count = ring_->read(scratch_.data(), std::min(size, scratch_.size()));
+      if (count == 0)
+        break;
+      size -= count;
+    }
+  }
+
+  void receive_audio_data() {
+    std::vector<uint8_t> packet(max_datagram_size);
+    std::vector<uint8_t> silence(max_datagram_size, 0);
+    bool has_sequence = false;
+    uint16_t expected_sequence = 0;
+    for (;;) {
+      struct pollfd pfds[2] = {{socket_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+      if (::poll(pfds, 2, -1) <= 0)
+        continue;
+      if (pfds[1].revents & POLLIN)
+        break;
+      if (!(pfds[0].revents & POLLIN))
+        continue;
+
+      const auto size = ::recv(socket_fd_, packet.data(), packet.size(), 0);
+      if (size < static_cast<ssize_t>(rtp_header_size))
+        continue;
+
+      // Only the fixed part of the header matters, CSRCs and extensions are skipped
+      const auto version = packet[0] >> 6;
+      const auto payload_type = packet[1] & 0x7f;
+      if (version != rtp_version ||
+          (payload_type != payload_type_ && payload_type < rtp_first_dynamic_payload_type))
+        continue;
+      size_t offset = rtp_header_size + (packet[0] & 0x0f) * 4;
+      if (packet[0] & 0x10) {
+        if (static_cast<size_t>(size) < offset + 4)
+          continue;
+        offset += 4 + ((packet[offset + 2] << 8) | packet[offset + 3]) * 4;
+      }
+      if (static_cast<size_t>(size) <= offset)
+        continue;
+      const auto payload_size = align(size - offset);
+
+      // Late packets are dropped as their place in the stream is gone already,
+      // lost ones are concealed with silence to keep the timing intact.
+      const uint16_t sequence = (packet[2] << 8) | packet[3];
+      if (has_sequence) {
+        const auto gap = static_cast<int16_t>(sequence - expected_sequence);
+        if (gap < 0)
+          continue;
+        for (int n = 0; n < gap && ring_->size() < target_bytes_; n++)
+          ring_->write(silence.data(), std::min(payload_size, silence.size()));
+      }
+      has_sequence = true;
+      expected_sequence = sequence + 1;
+
+      // L16 samples are in network byte order
+      auto samples = reinterpret_cast<uint16_t*>(packet.data() + offset);
+      for (size_t n = 0; n < payload_size / sizeof(uint16_t); n++)
+        samples[n] = ntohs(samples[n]);
+      ring_->write(packet.data() + offset, payload_size);
+    }
+  }
+
+  const int socket_fd_;
+  const int stop_fd_;
+  const std::unique_ptr<AudioSharedRing> ring_;
+  const size_t frame_size_;
+  const size_t bytes_per_sec_;
+  const size_t target_bytes_;
+  const size_t max_bytes_;
+  const uint8_t payload_type_;
+  std::atomic_bool reset_{false};
+  std::thread receive_thread_;
+  // Only touched by the reader
+  std::vector<uint8_t> scratch_;
+  bool buffering_{true};
+  uint64_t underruns_{0};
+  std::chrono::steady_clock::time_point next_read_;
+};
+
+class AudioStreamingPlatformAudioProcessor final : public AudioProcessor {
+ public:
+  AudioStreamingPlatformAudioProcessor(const AnboxAudioSpec& audio_spec,
+                                       const AnboxAudioSpec& audio_input_spec);
   ~AudioStreamingPlatformAudioProcessor() override;
 
   size_t process_data(const uint8_t* data, size_t size) override;
   ssize_t write_data(const uint8_t* data, size_t size) override;
+  ssize_t write_datav(const AnboxIoVec* iov, size_t count) override;
+  ssize_t write_data_timestamped(const uint8_t* data, size_t size, uint64_t timestamp_ns) override;
   ssize_t read_data(uint8_t* data, size_t size) override;
+  int get_presentation_position(uint64_t* frames, uint64_t* time_ns) override;
+  int standby(AnboxAudioStreamType type) override;
+  int activate(AnboxAudioStreamType type) override;
+
+  uint32_t period_size() const;
+  int shared_ring(AnboxAudioSharedRing* desc) const;
+  AudioEncoderConfig encoder_config() const;
+  int set_encoder_config(const AudioEncoderConfig& config);
 
  private:
-  int configure_audio(const AnboxAudioSpec& audio_spec);
+  int configure_audio(const AnboxAudioSpec& audio_spec, const AudioEncoderConfig& config);
+  void start_pipeline();
+  void stop_pipeline();
   void process_audio_data();
+  void read_input(uint8_t* buffer, size_t size);
+  void drop_input();
+  void encode_frame();
+  void receive_packets();
+  void mux_audio_data();
+  int64_t next_frame_pts();
   int flush_encoder();
   void close_audio_processor();
 
-  AudioBuffer audio_buffer_;
+  // Audio data is queued in shared memory so Anbox can write it directly
+  // through the AUDIO_SHARED_RING configuration item.
+  std::unique_ptr<AudioSharedRing> audio_ring_;
+  AudioBufferSignal signal_;
+  std::atomic_bool writer_waiting_{false};
+  // Only touched by the writer
+  uint64_t bytes_written_{0};
+  SpscRing<AudioTimestamp, max_pending_timestamps, SpscRingPolicy::OverwriteOldest> timestamps_;
+  std::mutex position_mutex_;
+  uint64_t presented_frames_{0};
+  uint64_t presented_time_ns_{0};
+  // Encoding and sending run as separate stages, so a slow network doesn't
+  // hold up the encoder and through it write_data. Packets come from a fixed
+  // pool and travel to the muxer and back through a pair of queues. Encoders
+  // supporting AV_CODEC_CAP_DR1 take the payloads from a pool as well, with
+  // older libavcodec versions or other encoders every payload is allocated.
+  std::vector<AVPacket*> packet_pool_;
+  AVBufferPool* payload_pool_{nullptr};
+  BlockingQueue<AVPacket*, packet_pool_size> encoded_packets_;
+  SpscRing<AVPacket*, packet_pool_size> free_packets_;
   std::atomic_bool finished_{false};
+  // While the output stream is in standby the encoder thread sleeps on the
+  // condition variable, the muxer on its empty queue. So an idle processor
+  // doesn't cost any CPU time.
+  std::mutex standby_mutex_;
+  std::condition_variable standby_cond_;
+  std::atomic_bool standby_{false};
+  // Set while no encoder could be configured at all, write_data then fails
+  std::atomic_bool failed_{false};
   std::thread process_thread_;
+  std::thread mux_thread_;
   std::unique_ptr<Context> context_{nullptr};
+  std::unique_ptr<AudioCaptureStream> capture_;
+  // Serializes switching the encoder configuration
+  mutable std::mutex config_mutex_;
+  const AnboxAudioSpec audio_spec_;
+  AudioEncoderConfig config_;
 };
 
 AudioStreamingPlatformAudioProcessor::AudioStreamingPlatformAudioProcessor(
-   const AnboxAudioSpec& audio_spec) {
-  // Launch the audio processing thread once audio output is configured.
-  if (configure_audio(audio_spec) == 0)
-    process_thread_ = std::thread(&AudioStreamingPlatformAudioProcessor::process_audio_data, this);
+   const AnboxAudioSpec& audio_spec, const AnboxAudioSpec& audio_input_spec) :
+  audio_spec_{audio_spec} {
+  for (size_t n = 0; n < packet_pool_size; n++) {
+    auto packet = av_packet_alloc();
+    if (!packet)
+      break;
+    packet_pool_.push_back(packet);
+    free_packets_.push(packet);
+  }
+#if defined(HAVE_ENCODE_BUFFER)
+  payload_pool_ = av_buffer_pool_init(packet_payload_size, nullptr);
+#endif
+
+  // Launch the audio processing threads once audio output is configured.
+  if (packet_pool_.size() == packet_pool_size && configure_audio(audio_spec_, config_) == 0)
+    start_pipeline();
   else
     std::cerr << "Failed to create audio processor " << strerror(errno) << std::endl;
+
+  capture_ = AudioCaptureStream::create(audio_input_spec);
+  if (!capture_)
+    std::cerr << "Failed to set up audio capture " << strerror(errno) << std::endl;
 }
 
 
 AudioStreamingPlatformAudioProcessor::~AudioStreamingPlatformAudioProcessor() {
-  finished_.store(true);
+  stop_pipeline();
+  close_audio_processor();
+  for (auto& packet : packet_pool_)
+    av_packet_free(&packet);
+  // Frees the pool once the last payload got released
+  av_buffer_pool_uninit(&payload_pool_);
+}
+
+void AudioStreamingPlatformAudioProcessor::start_pipeline() {
+  finished_.store(false);
+  process_thread_ = std::thread(&AudioStreamingPlatformAudioProcessor::process_audio_data, this);
+  mux_thread_ = std::thread(&AudioStreamingPlatformAudioProcessor::mux_audio_data, this);
+}
+
+void AudioStreamingPlatformAudioProcessor::stop_pipeline() {
+  {
+    std::lock_guard<std::mutex> lock(standby_mutex_);
+    finished_.store(true);
+  }
+  standby_cond_.notify_all();
+  if (audio_ring_)
+    audio_ring_->interrupt();
   if (process_thread_.joinable())
     process_thread_.join();
-
-  close_audio_processor();
-  if (!context_)
-    context_.reset();
+  // The encoder is gone, so we can take over as producer and wake up the
+  // muxer with an empty packet. If the queue is full it isn't sleeping.
+  encoded_packets_.push(nullptr);
+  if (mux_thread_.joinable())
+    mux_thread_.join();
 }
 
 size_t AudioStreamingPlatformAudioProcessor::process_data(const uint8_t* data, size_t size) {
@@ -190,42 +686,183 @@ size_t AudioStreamingPlatformAudioProcessor::process_data(const uint8_t* data, s
 }
 
 ssize_t AudioStreamingPlatformAudioProcessor::write_data(const uint8_t* data, size_t size) {
-  if (!data || size == 0)
+  const AnboxIoVec iov{data, size};
+  return write_datav(&iov, 1);
+}
+
+ssize_t AudioStreamingPlatformAudioProcessor::write_datav(const AnboxIoVec* iov, size_t count) {
+  ANBOX_TRACE_EVENT1("audio_streaming", "write_datav", "count", count);
+  if (!iov || count == 0 || !audio_ring_ || failed_)
     return -EIO;
 
-  // Sleep for a while if the audio buffer is full
-  // and let the audio process thread do its work.
-  while ((audio_buffer_.size + size) >= max_audio_buffer_size)
-      std::this_thread::sleep_for(std::chrono::seconds(1));
+  size_t size = 0;
+  for (size_t n = 0; n < count; n++) {
+    if (!iov[n].data && iov[n].size > 0)
+      return -EIO;
+    size += iov[n].size;
+  }
+  if (size == 0 || audio_ring_->corrupted())
+    return -EIO;
+
+  // Writing to a stream in standby implicitly activates it again
+  if (standby_)
+    activate(AUDIO_OUTPUT_STREAM);
+
+  // Wait for the audio process thread to consume data if the audio buffer
+  // is full, but never longer than max_write_blocking_time in total.
+  const auto deadline = std::chrono::steady_clock::now() + max_write_blocking_time;
+  size_t written = 0, index = 0, offset = 0;
+  for (;;) {
+    while (index < count) {
+      const auto chunk = audio_ring_->write(iov[index].data + offset, iov[index].size - offset);
+      written += chunk;
+      offset += chunk;
+      if (offset < iov[index].size)
+        break;
+      index++;
+      offset = 0;
+    }
+    if (written == size)
+      break;
+
+    const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0)
+      break;
+    signal_.wait_for(writer_waiting_, remaining, [&]() {
+      return audio_ring_->size() < audio_ring_->capacity() || finished_;
+    });
+  }
 
-  std::unique_lock<std::mutex> lock(audio_buffer_.mutex);
-  memcpy(audio_buffer_.data + audio_buffer_.size,  data, size);
-  audio_buffer_.size += size;
+  bytes_written_ += written;
+  ANBOX_TRACE_COUNTER("audio_streaming", "audio_buffer_size", audio_ring_->size());
+  return written > 0 ? static_cast<ssize_t>(written) : -EAGAIN;
+}
 
-  return size;
+ssize_t AudioStreamingPlatformAudioProcessor::write_data_timestamped(const uint8_t* data, size_t size,
+                                                                     uint64_t timestamp_ns) {
+  const auto position = bytes_written_;
+  const AnboxIoVec iov{data, size};
+  const auto ret = write_datav(&iov, 1);
+  // The encoder derives the timestamps of the following frames from this one
+  if (ret > 0)
+    timestamps_.push(AudioTimestamp{position, timestamp_ns});
+  return ret;
 }
 
 ssize_t AudioStreamingPlatformAudioProcessor::read_data(uint8_t* data, size_t size) {
-  if (!data || size == 0)
+  ANBOX_TRACE_EVENT1("audio_streaming", "read_data", "size", size);
+  if (!data || size == 0 || !capture_)
     return -EIO;
 
-  // Generate a simple sine wave
-  for (size_t i = 0; i < size; i++)
-    data[i] = static_cast<uint8_t>(round(UCHAR_MAX / 2 + UCHAR_MAX * sin(2*M_PI*i)));
+  return capture_->read(data, size);
+}
 
-  return size;
+int AudioStreamingPlatformAudioProcessor::get_presentation_position(uint64_t* frames, uint64_t* time_ns) {
+  if (!frames || !time_ns)
+    return -EINVAL;
+
+  std::lock_guard<std::mutex> lock(position_mutex_);
+  if (presented_time_ns_ == 0)
+    return -EAGAIN;
+
+  *frames = presented_frames_;
+  *time_ns = presented_time_ns_;
+  return 0;
 }
 
-int AudioStreamingPlatformAudioProcessor::configure_audio(const AnboxAudioSpec& audio_spec) {
+int AudioStreamingPlatformAudioProcessor::standby(AnboxAudioStreamType type) {
+  if (type == AUDIO_INPUT_STREAM) {
+    if (capture_)
+      capture_->reset();
+    return 0;
+  }
+
+  // The encoder finishes the frames still queued and parks itself
+  standby_.store(true);
+  if (audio_ring_)
+    audio_ring_->interrupt();
+  return 0;
+}
+
+int AudioStreamingPlatformAudioProcessor::activate(AnboxAudioStreamType type) {
+  if (type != AUDIO_OUTPUT_STREAM)
+    return 0;
+
+  {
+    std::lock_guard<std::mutex> lock(standby_mutex_);
+    standby_.store(false);
+  }
+  standby_cond_.notify_all();
+  return 0;
+}
+
+uint32_t AudioStreamingPlatformAudioProcessor::period_size() const {
+  // Anbox should hand over audio data in chunks of one encoder frame
+  std::lock_guard<std::mutex> lock(config_mutex_);
+  if (!context_ || !context_->format_context)
+    return 0;
+  return static_cast<uint32_t>(context_->input_frame_size * context_->input_rate / context_->bytes_per_sec);
+}
+
+int AudioStreamingPlatformAudioProcessor::shared_ring(AnboxAudioSharedRing* desc) const {
+  if (!audio_ring_)
+    return -ENODEV;
+
+  *desc = audio_ring_->descriptor();
+  return 0;
+}
+
+AudioEncoderConfig AudioStreamingPlatformAudioProcessor::encoder_config() const {
+  std::lock_guard<std::mutex> lock(config_mutex_);
+  return config_;
+}
+
+int AudioStreamingPlatformAudioProcessor::set_encoder_config(const AudioEncoderConfig& config) {
+  if (!config.is_valid())
+    return -EINVAL;
+
+  std::lock_guard<std::mutex> lock(config_mutex_);
+  if (!context_)
+    return -EIO;
+
+  // The audio ring stays in place, so writers carry on while the encoder is
+  // replaced and only the audio queued meanwhile sees the added delay.
+  stop_pipeline();
+  close_audio_processor();
+  auto ret = configure_audio(audio_spec_, config);
+  if (ret < 0) {
+    std::cerr << "Failed to switch audio encoder, keeping the previous one" << std::endl;
+    close_audio_processor();
+    if (configure_audio(audio_spec_, config_) < 0) {
+      // Without an encoder nobody drains the ring, so rather than letting
+      // every write time out, fail them right away until a later config
+      // brings the encoder back.
+      std::cerr << "Failed to restore audio encoder, dropping all audio" << std::endl;
+      close_audio_processor();
+      failed_ = true;
+      return -EIO;
+    }
+  } else {
+    config_ = config;
+  }
+  failed_ = false;
+  start_pipeline();
+  return ret;
+}
+
+int AudioStreamingPlatformAudioProcessor::configure_audio(const AnboxAudioSpec& audio_spec,
+                                                          const AudioEncoderConfig& config) {
   // Register all codecs and formats.
   av_register_all();
 
   // Initialize the network components.
   avformat_network_init();
 
+  const bool opus = config.codec == AudioCodec::Opus;
   int channel_layout  = 0;
   AVSampleFormat sample_fmt = AV_SAMPLE_FMT_NONE;
-  auto codec = avcodec_find_encoder(AV_CODEC_ID_MP3);
+  auto codec = avcodec_find_encoder(opus ? AV_CODEC_ID_OPUS : AV_CODEC_ID_MP3);
   if (!codec) {
     std::cerr << "Failed to find the encoder." << std::endl;
     return -ENOENT;
@@ -243,19 +880,48 @@ int AudioStreamingPlatformAudioProcessor::configure_audio(const AnboxAudioSpec&
     return -ENOENT;
   }
 
+  // Opus takes 16 bit or float samples at a few fixed rates only
+  uint32_t sample_rate = audio_spec.freq;
+  if (opus) {
+    if (std::find(std::begin(opus_sample_rates), std::end(opus_sample_rates), sample_rate) ==
+        std::end(opus_sample_rates))
+      sample_rate = opus_sample_rates[0];
+    if (sample_fmt != AV_SAMPLE_FMT_S16 || sample_rate != audio_spec.freq)
+      sample_fmt = AV_SAMPLE_FMT_FLT;
+  }
+
   auto codec_context = avcodec_alloc_context3(codec);
   if (!codec_context) {
     std::cerr << "Failed to allocate codec context." << std::endl;
     return -ENOMEM;
   }
 
-  codec_context->bit_rate = 64000;
-  codec_context->sample_rate = audio_spec.freq;
+  codec_context->bit_rate = config.bit_rate;
+  codec_context->sample_rate = sample_rate;
   codec_context->sample_fmt = sample_fmt;
   codec_context->channel_layout = channel_layout;
   codec_context->channels = av_get_channel_layout_nb_channels(codec_context->channel_layout);
   codec_context->codec_type = AVMEDIA_TYPE_AUDIO;
-  if (avcodec_open2(codec_context, codec, nullptr) < 0) {
+  codec_context->time_base = AVRational{1, static_cast<int>(sample_rate)};
+#if defined(HAVE_ENCODE_BUFFER)
+  if (payload_pool_ && (codec->capabilities & AV_CODEC_CAP_DR1)) {
+    codec_context->opaque = payload_pool_;
+    codec_context->get_encode_buffer = &get_pooled_encode_buffer;
+  }
+#endif
+
+  AVDictionary* options = nullptr;
+  if (opus) {
+    // libopus takes the complexity through the compression level
+    codec_context->compression_level = config.complexity;
+    char frame_duration[16];
+    snprintf(frame_duration, sizeof(frame_duration), "%g", config.frame_duration_us / 1000.0);
+    av_dict_set(&options, "frame_duration", frame_duration, 0);
+    av_dict_set(&options, "application", "lowdelay", 0);
+  }
+  auto ret = avcodec_open2(codec_context, codec, &options);
+  av_dict_free(&options);
+  if (ret < 0) {
     std::cerr << "Failed to open codec context." << std::endl;
     avcodec_close(codec_context);
     return -EIO;
@@ -295,7 +961,7 @@ int AudioStreamingPlatformAudioProcessor::configure_audio(const AnboxAudioSpec&
   AVDictionary* metadata = nullptr;
   av_dict_set(&metadata, "anbox-platform", "platform-audio-streaming", 0);
   format_context->metadata = metadata;
-  auto ret = avformat_write_header(format_context, nullptr);
+  ret = avformat_write_header(format_context, nullptr);
   if (ret < 0) {
     std::cerr << "Failed to write header" << std::endl;
     avcodec_close(codec_context);
@@ -336,47 +1002,282 @@ int AudioStreamingPlatformAudioProcessor::configure_audio(const AnboxAudioSpec&
   }
 
   // Keep the critical data as the private members in audio processor for resources release on close.
-  context_ = std::make_unique<Context>();
+  // The context outlives switching the codec as it tracks the position in the stream.
+  if (!context_)
+    context_ = std::make_unique<Context>();
   context_->format_context = format_context;
   context_->frame = frame;
   context_->stream = stream;
   context_->frame_buffer = frame_buffer;
   context_->frame_buffer_size = size;
   context_->codec_context = codec_context;
+  context_->input_format = audio_spec.format;
+  context_->codec_format = sample_fmt == AV_SAMPLE_FMT_FLT ? AUDIO_FORMAT_PCM_FLOAT : audio_spec.format;
+  context_->input_channels = audio_spec.channels;
+  context_->codec_channels = static_cast<uint8_t>(frame->channels);
+  context_->input_rate = audio_spec.freq;
+  const auto bytes_per_frame = audio_spec.channels * pcm::bytes_per_sample(audio_spec.format);
+  context_->bytes_per_sec = bytes_per_frame * audio_spec.freq;
+  context_->start_position = context_->position;
+  context_->encoded_frames = 0;
+  context_->start_time_ns = 0;
+  context_->last_pts = -1;
+
+  size_t input_frames = frame->nb_samples;
+  context_->resampler.reset();
+  context_->resampled_frames = 0;
+  if (sample_rate != audio_spec.freq) {
+    context_->resampler = AudioResampler::create(audio_spec.freq, sample_rate, context_->codec_channels,
+                                                 AudioResamplerQuality::Medium);
+    if (!context_->resampler) {
+      std::cerr << "Failed to create resampler: " << strerror(errno) << std::endl;
+      return -EINVAL;
+    }
+    // Read just enough input for one frame, the remainder carries over
+    input_frames = (static_cast<uint64_t>(frame->nb_samples) * audio_spec.freq + sample_rate - 1) / sample_rate;
+    context_->resampler_input.resize(input_frames * context_->codec_channels);
+    context_->resampler_output.resize((frame->nb_samples + context_->resampler->max_output_frames(input_frames)) *
+                                      context_->codec_channels);
+  }
+  context_->input_frame_size = input_frames * bytes_per_frame;
+  if (context_->resampler ||
+      context_->input_format != context_->codec_format ||
+      context_->input_channels != context_->codec_channels)
+    context_->input_buffer = reinterpret_cast<uint8_t*>(av_malloc(context_->input_frame_size));
+
+  context_->overflow_packet = av_packet_alloc();
+  if (!context_->overflow_packet) {
+    std::cerr << "Failed to allocate packet." << std::endl;
+    return -ENOMEM;
+  }
 
-  av_new_packet(&context_->pkt, size);
+  // One period matches one encoder frame, so the encoder thread is only
+  // woken up once a whole frame is ready to be encoded.
+  if (audio_ring_) {
+    audio_ring_->set_period_bytes(context_->input_frame_size);
+    return 0;
+  }
+  audio_ring_ = AudioSharedRing::create(audio_buffer_size, context_->input_frame_size);
+  if (!audio_ring_) {
+    std::cerr << "Failed to create shared audio ring: " << strerror(errno) << std::endl;
+    return -ENOMEM;
+  }
 
   return 0;
 }
 
+int64_t AudioStreamingPlatformAudioProcessor::next_frame_pts() {
+  const auto position = context_->position;
+  const auto bytes_per_sec = context_->bytes_per_sec;
+
+  // Move to the newest timestamp which was given for audio data at or before
+  // the start of the frame. Timestamps of later writes are kept for later.
+  for (;;) {
+    if (!context_->has_next_anchor)
+      context_->has_next_anchor = timestamps_.pop(context_->next_anchor);
+    if (!context_->has_next_anchor || context_->next_anchor.position > position)
+      break;
+    context_->anchor = context_->next_anchor;
+    context_->has_anchor = true;
+    context_->has_next_anchor = false;
+  }
+
+  // Without any timestamp (e.g. audio data from the shared ring) the stream
+  // is assumed to be presented continuously from the first encoded frame on.
+  if (context_->start_time_ns == 0)
+    context_->start_time_ns = context_->has_anchor ? context_->anchor.time_ns : monotonic_time_ns();
+  const auto anchor = context_->has_anchor ? context_->anchor :
+      AudioTimestamp{0, context_->start_time_ns};
+
+  const auto time_ns = anchor.time_ns + mul_div(position - anchor.position, nsecs_per_sec, bytes_per_sec);
+  int64_t pts = 0;
+  if (time_ns > context_->start_time_ns)
+    pts = static_cast<int64_t>(mul_div(time_ns - context_->start_time_ns,
+                                       context_->codec_context->sample_rate, nsecs_per_sec));
+
+  // Jitter of the timestamps must never make the stream go backwards
+  pts = std::max(pts, context_->last_pts + 1);
+  context_->last_pts = pts;
+  return pts;
+}
+
 void AudioStreamingPlatformAudioProcessor::process_audio_data() {
   if (!context_)
     return;
 
-  const auto frame_buffer_size = context_->frame_buffer_size;
-  auto format_context = context_->format_context;
+  const auto input_frame_size = context_->input_frame_size;
+  const auto input_frames = input_frame_size / (context_->bytes_per_sec / context_->input_rate);
+  const auto channels = context_->codec_channels;
   auto frame = context_->frame;
-  int encoded{0};
   while (!finished_) {
-    std::unique_lock<std::mutex> lock(audio_buffer_.mutex);
-    if (audio_buffer_.size > frame_buffer_size) {
-      memcpy(context_->frame_buffer, audio_buffer_.data, frame_buffer_size);
-      frame->data[0] = context_->frame_buffer;
-      frame->pts = (context_->pts_index++) * frame_duration;
-
-      auto ret = audio_encode(context_->codec_context, &context_->pkt, frame, &encoded);
-      if(ret < 0)
+    // Once the frames queued before the standby are encoded, what's left is
+    // too short for a frame and dropped before going to sleep.
+    if (standby_ && audio_ring_->size() < input_frame_size) {
+      // Holding the lock keeps activate() and with it write_datav() out
+      // until the leftovers are dropped. If the stream got activated in the
+      // meantime, the queued audio is fresh and must be encoded instead.
+      std::unique_lock<std::mutex> lock(standby_mutex_);
+      if (!standby_)
         continue;
+      drop_input();
+      standby_cond_.wait(lock, [this]() { return !standby_ || finished_; });
+      continue;
+    }
 
-      if (encoded==1){
-        context_->pkt.stream_index = context_->stream->index;
-        av_interleaved_write_frame(format_context, &context_->pkt);
-        av_packet_unref(&context_->pkt);
+    // Sleep until a whole frame is available, interrupt() wakes us up to
+    // stop or to go into standby.
+    if (!audio_ring_->wait(input_frame_size, -1))
+      continue;
+
+    if (context_->resampler) {
+      read_input(context_->input_buffer, input_frame_size);
+      pcm::remix(context_->input_buffer, context_->input_channels,
+                 context_->input_buffer, channels,
+                 context_->input_format, input_frames);
+      pcm::to_float(context_->input_buffer, context_->input_format,
+                    context_->resampler_input.data(), input_frames * channels);
+
+      auto& output = context_->resampler_output;
+      const auto ret = context_->resampler->process(
+          context_->resampler_input.data(), input_frames,
+          output.data() + context_->resampled_frames * channels,
+          output.size() / channels - context_->resampled_frames);
+      if (ret > 0)
+        context_->resampled_frames += ret;
+
+      const size_t frame_samples = frame->nb_samples * channels;
+      while (context_->resampled_frames >= static_cast<size_t>(frame->nb_samples)) {
+        memcpy(context_->frame_buffer, output.data(), frame_samples * sizeof(float));
+        context_->resampled_frames -= frame->nb_samples;
+        memmove(output.data(), output.data() + frame_samples,
+                context_->resampled_frames * channels * sizeof(float));
+        encode_frame();
       }
+      continue;
+    }
 
-      audio_buffer_.size -= frame_buffer_size;
-      memmove(audio_buffer_.data, audio_buffer_.data + frame_buffer_size, audio_buffer_.size);
+    if (context_->input_buffer) {
+      read_input(context_->input_buffer, input_frame_size);
+      pcm::remix(context_->input_buffer, context_->input_channels,
+                 context_->input_buffer, channels,
+                 context_->input_format, frame->nb_samples);
+      pcm::convert(context_->input_buffer, context_->input_format,
+                   context_->frame_buffer, context_->codec_format,
+                   frame->nb_samples * channels);
+    } else {
+      read_input(context_->frame_buffer, input_frame_size);
     }
+    encode_frame();
+  }
+}
+
+void AudioStreamingPlatformAudioProcessor::read_input(uint8_t* buffer, size_t size) {
+  context_->read_position += audio_ring_->read(buffer, size);
+  signal_.notify(writer_waiting_);
+}
+
+void AudioStreamingPlatformAudioProcessor::drop_input() {
+  // Only what was queued up to now is dropped, a writer may already be
+  // filling the ring again and its audio belongs to the resumed stream.
+  auto buffer = context_->input_buffer ? context_->input_buffer : context_->frame_buffer;
+  auto remaining = audio_ring_->size();
+  while (remaining > 0) {
+    const auto chunk = std::min(remaining, context_->input_frame_size);
+    read_input(buffer, chunk);
+    remaining -= chunk;
+  }
+
+  // The audio held back by the resampler is dropped as well, so the stream
+  // resumes without any leftovers from before the standby.
+  if (context_->resampler) {
+    context_->resampler->reset();
+    context_->resampled_frames = 0;
+  }
+
+  // Dropped audio still counts as presented, it just wasn't audible
+  const auto bytes_per_frame = context_->bytes_per_sec / context_->input_rate;
+  const auto frames = context_->read_position > context_->position ?
+      (context_->read_position - context_->position) / bytes_per_frame : 0;
+  context_->position = context_->start_position = context_->read_position;
+  context_->encoded_frames = 0;
+  if (frames > 0) {
+    std::lock_guard<std::mutex> lock(position_mutex_);
+    presented_frames_ += frames;
+  }
+}
+
+void AudioStreamingPlatformAudioProcessor::encode_frame() {
+  auto frame = context_->frame;
+  frame->data[0] = context_->frame_buffer;
+  frame->pts = next_frame_pts();
+  ANBOX_TRACE_EVENT1("audio_streaming", "encode_frame", "pts", frame->pts);
+
+  // With resampling a frame doesn't cover a whole number of input frames,
+  // so the position is derived from the total number of encoded samples.
+  const auto bytes_per_frame = context_->bytes_per_sec / context_->input_rate;
+  context_->encoded_frames += frame->nb_samples;
+  const auto position = context_->start_position + context_->encoded_frames * context_->input_rate /
+      context_->codec_context->sample_rate * bytes_per_frame;
+  const auto frames = (position - context_->position) / bytes_per_frame;
+  context_->position = position;
+
+  if (avcodec_send_frame(context_->codec_context, frame) < 0) {
+    std::cerr << "Failed to do audio encode" << std::endl;
+    return;
+  }
+  receive_packets();
+
+  {
+    std::lock_guard<std::mutex> lock(position_mutex_);
+    presented_frames_ += frames;
+    presented_time_ns_ = monotonic_time_ns();
+  }
+}
+
+void AudioStreamingPlatformAudioProcessor::receive_packets() {
+  for (;;) {
+    if (!context_->packet)
+      free_packets_.pop(context_->packet);
+
+    // When the muxer can't keep up the pool runs dry. The stream is live,
+    // so rather than stalling the encoder the packet is dropped.
+    const auto packet = context_->packet ? context_->packet : context_->overflow_packet;
+    const auto ret = avcodec_receive_packet(context_->codec_context, packet);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+      break;
+    if (ret < 0) {
+      std::cerr << "Failed to do audio encode" << std::endl;
+      break;
+    }
+
+    if (!context_->packet) {
+      av_packet_unref(packet);
+      ANBOX_TRACE_COUNTER("audio_streaming", "dropped_packets", ++context_->dropped_packets);
+      continue;
+    }
+
+    packet->stream_index = context_->stream->index;
+    av_packet_rescale_ts(packet, context_->codec_context->time_base, context_->stream->time_base);
+    // Can't fail, the queue holds the whole pool
+    encoded_packets_.push(packet);
+    context_->packet = nullptr;
+    ANBOX_TRACE_COUNTER("audio_streaming", "mux_queue_depth", encoded_packets_.size());
+  }
+}
+
+void AudioStreamingPlatformAudioProcessor::mux_audio_data() {
+  if (!context_)
+    return;
+
+  AVPacket* packet = nullptr;
+  while (!finished_) {
+    // stop_pipeline() sends an empty packet to wake us up
+    if (!encoded_packets_.pop(packet, -1) || !packet)
+      continue;
+
+    ANBOX_TRACE_EVENT1("audio_streaming", "mux_packet", "pts", packet->pts);
+    write_packet(context_->format_context, packet);
+    free_packets_.push(packet);
   }
 }
 
@@ -405,76 +1306,76 @@ int AudioStreamingPlatformAudioProcessor::flush_encoder() {
 }
 
 void AudioStreamingPlatformAudioProcessor::close_audio_processor() {
-  if (!context_)
+  if (!context_ || !context_->format_context)
     return;
 
+  // Both stages are stopped, send what is still queued before the rest
+  // the encoder holds back. All packets go back into the pool.
+  AVPacket* packet = nullptr;
+  while (encoded_packets_.try_pop(packet)) {
+    if (!packet)
+      continue;
+    write_packet(context_->format_context, packet);
+    free_packets_.push(packet);
+  }
+  if (context_->packet) {
+    free_packets_.push(context_->packet);
+    context_->packet = nullptr;
+  }
+
   if (flush_encoder() < 0)
     std::cerr << "Failed to flush audio encoder." << std::endl;
 
-  auto format_context = context_->format_context;
-  if (!format_context)
-    return;
+  av_packet_free(&context_->overflow_packet);
 
+  auto format_context = context_->format_context;
   av_write_trailer(format_context);
 
   // Release resources.
   auto stream = context_->stream;
   if (stream) {
-    avcodec_close(context_->codec_context);
-    av_free(context_->frame);
+    avcodec_free_context(&context_->codec_context);
+    av_frame_free(&context_->frame);
     av_free(context_->frame_buffer);
+    av_free(context_->input_buffer);
+    context_->frame_buffer = nullptr;
+    context_->input_buffer = nullptr;
   }
 
   avio_close(format_context->pb);
   avformat_free_context(format_context);
+  context_->format_context = nullptr;
+  context_->stream = nullptr;
 }
 
-class AudioStreamingPlatformInputProcessor : public InputProcessor {
+class AudioStreamingPlatformInputProcessor final : public InputProcessor {
   public:
     AudioStreamingPlatformInputProcessor() {}
     ~AudioStreamingPlatformInputProcessor() override = default;
 
     int read_event(AnboxInputEvent* event, int timeout) override;
     int inject_event(AnboxInputEvent event) override;
+    int read_events(AnboxInputEvent* events, size_t max_events, int timeout) override;
+    int inject_events(const AnboxInputEvent* events, size_t count) override;
+    int event_fd() const override;
   private:
-    std::queue<AnboxInputEvent> event_queue_;
-    std::mutex mutex_;
+    BlockingQueue<AnboxInputEvent, 1024> event_queue_;
 };
 
 int AudioStreamingPlatformInputProcessor::inject_event(AnboxInputEvent event) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  event_queue_.push(event);
+  if (!event_queue_.push(event))
+    return -EAGAIN;
 
   return 0;
 }
 
 int AudioStreamingPlatformInputProcessor::read_event(AnboxInputEvent* event, int timeout) {
-  // Create a event loop thread with std::async asynchronous function.
-  // The event loop thread handle the input messages from the queue.
-  // The execution is blocked at future::get until
-  // 1. The next event becomes available..
-  // 2. A default AnboxInputEvent instance is returned when timeout is triggered
-  //    and the event queue is empty at the same time.
-  std::atomic_bool finished{false};
-  if (timeout == 0)
-    finished.store(true);
-  auto fut = std::async(
-    std::launch::async, [&]() {
-      do {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (event_queue_.size() > 0){
-          auto ev = event_queue_.front();
-          event_queue_.pop();
-          return ev;
-        }
-      } while(!finished);
-      return AnboxInputEvent{KEYBOARD, 0, EV_MAX, 0, 0};
-    });
-
-  if (timeout > 0 && fut.wait_for(chrono::milliseconds(timeout)) == std::future_status::timeout)
-    finished.store(true);
+  // Blocks until either the next event becomes available or the timeout
+  // is triggered while the event queue is still empty.
+  AnboxInputEvent new_event;
+  if (!event_queue_.pop(new_event, timeout))
+    return -EIO;
 
-  auto new_event = fut.get();
   if (new_event.type >= EV_SYN && new_event.type < EV_MAX) {
     event->device_type = new_event.device_type;
     event->device_id = new_event.device_id;
@@ -487,6 +1388,43 @@ int AudioStreamingPlatformInputProcessor::read_event(AnboxInputEvent* event, int
   return -EIO;
 }
 
+int AudioStreamingPlatformInputProcessor::inject_events(const AnboxInputEvent* events, size_t count) {
+  if (!events && count > 0)
+    return -EINVAL;
+
+  for (size_t n = 0; n < count; n++) {
+    if (!event_queue_.push(events[n]))
+      return -EAGAIN;
+  }
+
+  return 0;
+}
+
+int AudioStreamingPlatformInputProcessor::read_events(AnboxInputEvent* events, size_t max_events, int timeout) {
+  if (!events || max_events == 0)
+    return -EINVAL;
+
+  // Only the first event is subject to the timeout. Everything else which is
+  // already queued (e.g. the rest of a multi-touch frame) is drained
+  // without waiting.
+  auto ret = read_event(&events[0], timeout);
+  if (ret < 0)
+    return ret;
+
+  size_t n = 1;
+  AnboxInputEvent ev;
+  while (n < max_events && event_queue_.try_pop(ev)) {
+    if (ev.type >= EV_SYN && ev.type < EV_MAX)
+      events[n++] = ev;
+  }
+
+  return static_cast<int>(n);
+}
+
+int AudioStreamingPlatformInputProcessor::event_fd() const {
+  return event_queue_.fd();
+}
+
 class AudioStreamingPlatformGraphicsProcessor : public GraphicsProcessor {
  public:
   AudioStreamingPlatformGraphicsProcessor() {}
@@ -531,7 +1469,7 @@ int AudioStreamingPlatformProxy::send_message(
 class AudioStreamingPlatform : public anbox::Platform {
  public:
   AudioStreamingPlatform(const AnboxPlatformConfiguration* configuration) :
-    audio_processor_(std::make_unique<AudioStreamingPlatformAudioProcessor>(audio_out_spec_)),
+    audio_processor_(std::make_unique<AudioStreamingPlatformAudioProcessor>(audio_out_spec_, audio_in_spec_)),
     input_processor_(std::make_unique<AudioStreamingPlatformInputProcessor>()),
     graphics_processor_(std::make_unique<AudioStreamingPlatformGraphicsProcessor>()),
     anbox_proxy_(std::make_unique<AudioStreamingPlatformProxy>()) {
@@ -539,15 +1477,30 @@ class AudioStreamingPlatform : public anbox::Platform {
     }
   ~AudioStreamingPlatform() override = default;
 
-  AudioProcessor* audio_processor() override;
-  InputProcessor* input_processor() override;
+  AudioStreamingPlatformAudioProcessor* audio_processor() override;
+  AudioStreamingPlatformInputProcessor* input_processor() override;
   GraphicsProcessor* graphics_processor() override;
   AnboxProxy* anbox_proxy() override;
   bool ready() const override;
   int wait_until_ready() override;
   int get_config_item(AnboxPlatformConfigurationKey key, void* data, size_t data_size) override;
+  int set_config_item(AnboxPlatformConfigurationKey key, void* data, size_t data_size) override;
+  int set_config_items(const AnboxPlatformConfigurationItem* items, size_t count) override;
 
  private:
+  int get_encoder_config_item(int id, void* data, size_t data_size) const;
+  static int parse_encoder_config_item(int id, const void* data, size_t data_size,
+                                       AudioEncoderConfig& config);
+
+  AnboxPlatformConfigurationItemInfo config_items_[4] = {
+    {audio_codec_config_id, "audio_codec", STRING},
+    {audio_frame_duration_config_id, "audio_frame_duration_us", UINT32},
+    {audio_bit_rate_config_id, "audio_bit_rate", UINT32},
+    {audio_complexity_config_id, "audio_complexity", UINT32},
+  };
+  AnboxPlatformConfigurationItemInfo* config_item_list_[4] = {
+    &config_items_[0], &config_items_[1], &config_items_[2], &config_items_[3],
+  };
   AnboxDisplaySpec display_spec_{1280, 720, 0};
   AnboxAudioSpec audio_out_spec_{44100, AUDIO_FORMAT_PCM_16_BIT, 1, 4096};
   AnboxAudioSpec audio_in_spec_{44100, AUDIO_FORMAT_PCM_16_BIT, 1, 4096};
@@ -557,11 +1510,11 @@ class AudioStreamingPlatform : public anbox::Platform {
   const std::unique_ptr<AudioStreamingPlatformProxy> anbox_proxy_;
 };
 
-AudioProcessor* AudioStreamingPlatform::audio_processor() {
+AudioStreamingPlatformAudioProcessor* AudioStreamingPlatform::audio_processor() {
   return audio_processor_.get();
 }
 
-InputProcessor* AudioStreamingPlatform::input_processor() {
+AudioStreamingPlatformInputProcessor* AudioStreamingPlatform::input_processor() {
   return input_processor_.get();
 }
 
@@ -628,12 +1581,150 @@ int AudioStreamingPlatform::get_config_item(AnboxPlatformConfigurationKey key,
     memcpy(spec, &audio_in_spec_, sizeof(AnboxAudioSpec));
     break;
   }
+  case AUDIO_SPEC2: {
+    if (data_size != sizeof(AnboxAudioSpec2))
+      return -ENOMEM;
+
+    // The period follows the frame size of the current codec
+    auto spec = reinterpret_cast<AnboxAudioSpec2*>(data);
+    *spec = AnboxAudioSpec2{audio_out_spec_.freq, audio_out_spec_.format, audio_out_spec_.channels,
+                            audio_out_spec_.samples, audio_processor_->period_size()};
+    break;
+  }
+  case AUDIO_INPUT_SPEC2: {
+    if (data_size != sizeof(AnboxAudioSpec2))
+      return -ENOMEM;
+
+    auto spec = reinterpret_cast<AnboxAudioSpec2*>(data);
+    *spec = AnboxAudioSpec2{audio_in_spec_.freq, audio_in_spec_.format, audio_in_spec_.channels,
+                            audio_in_spec_.samples, 0};
+    break;
+  }
+  case AUDIO_SHARED_RING: {
+    if (data_size != sizeof(AnboxAudioSharedRing))
+      return -ENOMEM;
+
+    return audio_processor_->shared_ring(reinterpret_cast<AnboxAudioSharedRing*>(data));
+  }
+  case PLATFORM_CONFIGURATION_INFO: {
+    if (data_size != sizeof(AnboxPlatformConfigurationInfo))
+      return -ENOMEM;
+
+    auto info = reinterpret_cast<AnboxPlatformConfigurationInfo*>(data);
+    info->num_items = sizeof(config_item_list_) / sizeof(config_item_list_[0]);
+    info->items = config_item_list_;
+    break;
+  }
   default:
+    if (key >= PLATFORM_CONFIGURATION_ID_START && key <= PLATFORM_CONFIGURATION_ID_END)
+      return get_encoder_config_item(key, data, data_size);
     return -EINVAL;
   }
 
   return 0;
 }
+
+int AudioStreamingPlatform::get_encoder_config_item(int id, void* data, size_t data_size) const {
+  const auto config = audio_processor_->encoder_config();
+  if (id == audio_codec_config_id) {
+    const auto codec = config.codec == AudioCodec::Opus ? audio_codec_opus : audio_codec_mp3;
+    if (strlen(codec) + 1 > data_size)
+      return -ENOMEM;
+    memcpy(data, codec, strlen(codec) + 1);
+    return 0;
+  }
+
+  uint32_t value = 0;
+  if (id == audio_frame_duration_config_id)
+    value = config.frame_duration_us;
+  else if (id == audio_bit_rate_config_id)
+    value = config.bit_rate;
+  else if (id == audio_complexity_config_id)
+    value = config.complexity;
+  else
+    return -EINVAL;
+
+  if (data_size != sizeof(uint32_t))
+    return -ENOMEM;
+  memcpy(data, &value, sizeof(uint32_t));
+  return 0;
+}
+
+int AudioStreamingPlatform::parse_encoder_config_item(int id, const void* data, size_t data_size,
+                                                      AudioEncoderConfig& config) {
+  // A reset brings back the default of the item
+  const AudioEncoderConfig defaults;
+  const bool reset = !data && data_size == 0;
+  if (!reset && !data)
+    return -EINVAL;
+
+  if (id == audio_codec_config_id) {
+    if (reset) {
+      config.codec = defaults.codec;
+      return 0;
+    }
+    const std::string codec(static_cast<const char*>(data), strnlen(static_cast<const char*>(data), data_size));
+    if (codec == audio_codec_mp3)
+      config.codec = AudioCodec::MP3;
+    else if (codec == audio_codec_opus)
+      config.codec = AudioCodec::Opus;
+    else
+      return -EINVAL;
+    return 0;
+  }
+
+  uint32_t* field = nullptr;
+  uint32_t default_value = 0;
+  if (id == audio_frame_duration_config_id) {
+    field = &config.frame_duration_us;
+    default_value = defaults.frame_duration_us;
+  } else if (id == audio_bit_rate_config_id) {
+    field = &config.bit_rate;
+    default_value = defaults.bit_rate;
+  } else if (id == audio_complexity_config_id) {
+    field = &config.complexity;
+    default_value = defaults.complexity;
+  } else {
+    return -EINVAL;
+  }
+
+  if (reset) {
+    *field = default_value;
+    return 0;
+  }
+  if (data_size != sizeof(uint32_t))
+    return -ENOMEM;
+  memcpy(field, data, sizeof(uint32_t));
+  return 0;
+}
+
+int AudioStreamingPlatform::set_config_item(AnboxPlatformConfigurationKey key, void* data, size_t data_size) {
+  const AnboxPlatformConfigurationItem item{key, data, data_size};
+  return set_config_items(&item, 1);
+}
+
+int AudioStreamingPlatform::set_config_items(const AnboxPlatformConfigurationItem* items, size_t count) {
+  if (!items && count > 0)
+    return -EINVAL;
+
+  // Validate the whole batch first so e.g. the codec and its frame duration
+  // are switched together with a single restart of the encoder.
+  auto config = audio_processor_->encoder_config();
+  for (size_t n = 0; n < count; n++) {
+    const auto key = items[n].key;
+    if (key < PLATFORM_CONFIGURATION_ID_START || key > PLATFORM_CONFIGURATION_ID_END)
+      return -EINVAL;
+    const auto ret = parse_encoder_config_item(key, items[n].data, items[n].data_size, config);
+    if (ret < 0)
+      return ret;
+  }
+  if (!config.is_valid())
+    return -EINVAL;
+
+  if (config == audio_processor_->encoder_config())
+    return 0;
+  return audio_processor_->set_encoder_config(config) < 0 ? -EIO : 0;
+}
 } // namespace anbox
 
-ANBOX_PLATFORM_PLUGIN_DESCRIBE(anbox::AudioStreamingPlatform, "audio_streaming", "Canonical", "An audio streaming platform plugin with libav")
+ANBOX_PLATFORM_PLUGIN_DESCRIBE_FINAL(anbox::AudioStreamingPlatform, "audio_streaming", "Canonical", "An audio streaming platform plugin with libav")
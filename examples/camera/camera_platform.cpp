@@ -17,26 +17,30 @@
  */
 
 #include "anbox-platform-sdk/plugin.h"
+#include "anbox-platform-sdk/blocking_queue.h"
+#include "anbox-platform-sdk/trace.h"
+#include "anbox-platform-sdk/video_frame_pool.h"
 
-#include <chrono>
 #include <atomic>
-#include <future>
-#include <queue>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <poll.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 
 #define RETURN_ON_ERROR(frame)          \
   do {                                  \
-    if (frame.data)                     \
-      free(frame.data);                 \
+    release_frame(frame);               \
     return -EIO;                        \
   } while (0)
 
-namespace chrono = std::chrono;
-
 #ifndef SYSTEM_LIBDIR
 #define SYSTEM_LIBDIR
 #endif
@@ -92,19 +96,58 @@ int CameraPlatformInputProcessor::inject_event(AnboxInputEvent event) {
 class CameraPlatformCameraProcessor : public CameraProcessor {
   public:
     CameraPlatformCameraProcessor() {}
-    ~CameraPlatformCameraProcessor() override = default;
+    ~CameraPlatformCameraProcessor() override;
 
     int get_device_specs(AnboxCameraSpec** specs, size_t *specs_len) override;
     int open_device(AnboxCameraSpec spec, AnboxCameraOrientation orientation) override;
+    int open_device_with_options(AnboxCameraSpec spec, AnboxCameraOrientation orientation,
+                                 const AnboxCameraDeliveryOptions* options) override;
     int close_device() override;
     int read_frame(AnboxVideoFrame* frame, int timeout) override;
     int inject_frame(AnboxVideoFrame frame) override;
+    int read_frame_with_release(AnboxVideoFrame* frame, AnboxCallback* release, int timeout) override;
+    int inject_frame_with_release(AnboxVideoFrame frame, AnboxCallback* release) override;
+    int read_frame2(AnboxVideoFrame2* frame, int timeout) override;
+    int inject_frame2(const AnboxVideoFrame2* frame) override;
+    int event_fd() const override;
+    int get_dropped_frames(uint64_t* count) override;
 
   private:
-    std::queue<AnboxVideoFrame> frame_queue_;
-    std::mutex mutex_;
+    // Frames travel through the queue together with the callback releasing
+    // their video buffer, which is free() for frames from inject_frame().
+    // Frames injected by file descriptor are only described by frame2 and
+    // are copied just when they are read by pointer, and vice versa. The
+    // timestamp and sequence number always live in frame2.
+    struct QueuedFrame {
+      AnboxVideoFrame frame;
+      AnboxVideoFrame2 frame2;
+      AnboxCallback release;
+    };
+
+    static void release_frame(const QueuedFrame& frame);
+    int push_frame(QueuedFrame frame);
+    bool is_valid_frame(const QueuedFrame& frame) const;
+    bool dequeue_frame(QueuedFrame* frame, int timeout);
+    int pop_frame(QueuedFrame* frame, int timeout);
+    void count_dropped_frame();
+
+    // Queued frames own their video buffer, so a full queue rejects new
+    // frames rather than silently dropping (and leaking) old ones. In
+    // mailbox mode the producer drops the oldest frames itself and releases
+    // them, which makes it a second consumer of the queue. Readers always
+    // dequeue under consumer_mutex_, whatever the mode, as it can be
+    // switched by open_device_with_options() while they wait.
+    BlockingQueue<QueuedFrame, 128> frame_queue_;
+    std::mutex consumer_mutex_;
+    // Maximum number of queued frames in mailbox mode or 0 in queue mode
+    std::atomic<uint32_t> mailbox_frames_{0};
+    std::atomic<uint64_t> dropped_frames_{0};
+    // Frames which have to be copied for the consumer are taken from here
+    VideoFramePool frame_pool_{VideoFramePool::default_max_frames, VideoFrameMemory::Memfd};
     AnboxCameraSpec select_camera_spec_{VIDEO_FRAME_FORMAT_UNKNOWN, CAMERA_FACING_MODE_REAR, 0, 0, 0};
     AnboxCameraOrientation current_camera_orientation_;
+    // Counts every injected frame, including the ones which were rejected
+    std::atomic<uint64_t> next_sequence_{0};
 };
 
 int CameraPlatformCameraProcessor::get_device_specs(AnboxCameraSpec** specs, size_t *specs_len) {
@@ -124,6 +167,21 @@ int CameraPlatformCameraProcessor::get_device_specs(AnboxCameraSpec** specs, siz
 }
 
 int CameraPlatformCameraProcessor::open_device(AnboxCameraSpec spec, AnboxCameraOrientation orientation) {
+  return open_device_with_options(spec, orientation, nullptr);
+}
+
+int CameraPlatformCameraProcessor::open_device_with_options(AnboxCameraSpec spec, AnboxCameraOrientation orientation,
+                                                            const AnboxCameraDeliveryOptions* options) {
+  uint32_t mailbox_frames = 0;
+  if (options && options->mode == CAMERA_DELIVERY_MODE_MAILBOX) {
+    if (options->max_frames == 0 || options->max_frames > frame_queue_.capacity())
+      return -EINVAL;
+    mailbox_frames = options->max_frames;
+  } else if (options && options->mode != CAMERA_DELIVERY_MODE_QUEUE) {
+    return -EINVAL;
+  }
+
+  mailbox_frames_ = mailbox_frames;
   select_camera_spec_ = spec;
   current_camera_orientation_ = orientation;
   return 0;
@@ -131,66 +189,253 @@ int CameraPlatformCameraProcessor::open_device(AnboxCameraSpec spec, AnboxCamera
 
 int CameraPlatformCameraProcessor::close_device() {
   select_camera_spec_ = AnboxCameraSpec{VIDEO_FRAME_FORMAT_UNKNOWN, CAMERA_FACING_MODE_REAR, 0, 0, 0};
+  mailbox_frames_ = 0;
+  frame_pool_.trim();
   return 0;
 }
 
-int CameraPlatformCameraProcessor::inject_frame(AnboxVideoFrame frame) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  frame_queue_.push(frame);
+int CameraPlatformCameraProcessor::get_dropped_frames(uint64_t* count) {
+  if (!count)
+    return -EINVAL;
+  *count = dropped_frames_.load(std::memory_order_relaxed);
   return 0;
 }
 
-int CameraPlatformCameraProcessor::read_frame(AnboxVideoFrame* frame, int timeout) {
-  if (frame == NULL)
+void CameraPlatformCameraProcessor::count_dropped_frame() {
+  const auto dropped = dropped_frames_.fetch_add(1, std::memory_order_relaxed) + 1;
+  ANBOX_TRACE_COUNTER("camera", "dropped_frames", dropped);
+}
+
+CameraPlatformCameraProcessor::~CameraPlatformCameraProcessor() {
+  QueuedFrame frame;
+  while (frame_queue_.try_pop(frame))
+    release_frame(frame);
+}
+
+void CameraPlatformCameraProcessor::release_frame(const QueuedFrame& frame) {
+  if (frame.release.callback)
+    frame.release.callback(frame.release.user_data);
+}
+
+int CameraPlatformCameraProcessor::push_frame(QueuedFrame frame) {
+  // Frames which don't carry their capture time are stamped on arrival. The
+  // sequence number is taken even if the queue is full, so the reader sees
+  // the gap of a dropped frame.
+  if (frame.frame2.timestamp_ns == 0) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    frame.frame2.timestamp_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+  }
+  frame.frame2.sequence = next_sequence_.fetch_add(1, std::memory_order_relaxed);
+
+  const auto mailbox_frames = mailbox_frames_.load(std::memory_order_relaxed);
+  if (mailbox_frames > 0) {
+    std::lock_guard<std::mutex> lock(consumer_mutex_);
+    QueuedFrame oldest;
+    while (frame_queue_.size() >= mailbox_frames && frame_queue_.try_pop(oldest)) {
+      release_frame(oldest);
+      count_dropped_frame();
+    }
+  }
+
+  if (!frame_queue_.push(frame)) {
+    count_dropped_frame();
+    return -EAGAIN;
+  }
+  return 0;
+}
+
+int CameraPlatformCameraProcessor::inject_frame(AnboxVideoFrame frame) {
+  QueuedFrame queued_frame{frame, {}, AnboxCallback{&::free, frame.data}};
+  queued_frame.frame2.fd = -1;
+  return push_frame(queued_frame);
+}
+
+int CameraPlatformCameraProcessor::inject_frame_with_release(AnboxVideoFrame frame, AnboxCallback* release) {
+  if (!release)
     return -EINVAL;
 
+  QueuedFrame queued_frame{frame, {}, *release};
+  queued_frame.frame2.fd = -1;
+  return push_frame(queued_frame);
+}
+
+int CameraPlatformCameraProcessor::inject_frame2(const AnboxVideoFrame2* frame) {
+  if (!frame)
+    return -EINVAL;
+
+  return push_frame(QueuedFrame{{nullptr, 0}, *frame, frame->release});
+}
+
+bool CameraPlatformCameraProcessor::is_valid_frame(const QueuedFrame& frame) const {
+  const auto& spec = select_camera_spec_;
+  if (frame.frame2.fd < 0)
+    return frame.frame.data && frame.frame.size > 0 && frame.frame.size == VideoFramePool::frame_size(spec);
+
+  AnboxVideoFrame2 packed;
+  if (!VideoFramePool::describe(spec, &packed))
+    return false;
+
+  const auto& frame2 = frame.frame2;
+  if (frame2.format != spec.format || frame2.width != spec.width || frame2.height != spec.height ||
+      frame2.num_planes != packed.num_planes)
+    return false;
+
+  // Every row of every plane has to be inside of the memory
+  for (uint8_t n = 0; n < frame2.num_planes; n++) {
+    const size_t rows = VideoFramePool::plane_rows(spec, n);
+    if (frame2.stride[n] < packed.stride[n] ||
+        frame2.offset[n] + (rows - 1) * frame2.stride[n] + packed.stride[n] > frame2.size)
+      return false;
+  }
+
+  // The size is declared by the peer, mapping beyond the real end of the
+  // memory would raise SIGBUS once touched. dma-bufs only report their size
+  // through lseek(2).
+  struct stat st;
+  if (::fstat(frame2.fd, &st) < 0)
+    return false;
+  off_t real_size = st.st_size;
+  if (!S_ISREG(st.st_mode))
+    real_size = ::lseek(frame2.fd, 0, SEEK_END);
+  return real_size >= 0 && static_cast<uint64_t>(real_size) >= frame2.size;
+}
+
+bool CameraPlatformCameraProcessor::dequeue_frame(QueuedFrame* frame, int timeout) {
+  // In mailbox mode the producer may drop frames at any time, and the mode
+  // can change while we wait, so always dequeue while holding the lock and
+  // wait for new frames on the eventfd of the queue without it.
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(consumer_mutex_);
+      if (frame_queue_.try_pop(*frame))
+        return true;
+    }
+
+    if (timeout == 0 || frame_queue_.fd() < 0)
+      return false;
+
+    int wait_ms = -1;
+    if (timeout > 0) {
+      const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now()).count();
+      if (remaining <= 0)
+        return false;
+      wait_ms = static_cast<int>(remaining);
+    }
+
+    struct pollfd pfd{frame_queue_.fd(), POLLIN, 0};
+    if (::poll(&pfd, 1, wait_ms) < 0 && errno != EINTR)
+      return false;
+  }
+}
+
+int CameraPlatformCameraProcessor::pop_frame(QueuedFrame* frame, int timeout) {
   if (select_camera_spec_.format == VIDEO_FRAME_FORMAT_UNKNOWN)
     return -EIO;
 
-  std::atomic_bool finished{false};
-  if (timeout == 0)
-    finished.store(true);
-  auto fut = std::async(
-    std::launch::async, [&]() {
-      do {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (frame_queue_.size() > 0){
-          auto dt = frame_queue_.front();
-          frame_queue_.pop();
-          return dt;
-        }
-      } while(!finished);
-      return AnboxVideoFrame{nullptr, 0};
-    });
-
-  if (timeout > 0 && fut.wait_for(chrono::milliseconds(timeout)) == std::future_status::timeout)
-    finished.store(true);
-
-  const auto new_frame = fut.get();
-  if (new_frame.data == NULL || new_frame.size == 0)
+  if (!dequeue_frame(frame, timeout))
+    return -EIO;
+
+  if (!is_valid_frame(*frame))
+    RETURN_ON_ERROR(*frame);
+  return 0;
+}
+
+int CameraPlatformCameraProcessor::read_frame(AnboxVideoFrame* frame, int timeout) {
+  AnboxCallback release{nullptr, nullptr};
+  const auto ret = read_frame_with_release(frame, &release, timeout);
+  if (ret < 0 || release.callback == &::free)
+    return ret;
+
+  // The caller takes over the video buffer and frees it, so a frame from a
+  // pool has to be copied.
+  auto data = static_cast<uint8_t*>(malloc(frame->size));
+  if (data)
+    memcpy(data, frame->data, frame->size);
+  if (release.callback)
+    release.callback(release.user_data);
+  if (!data)
+    return -ENOMEM;
+  frame->data = data;
+  return 0;
+}
+
+int CameraPlatformCameraProcessor::read_frame_with_release(AnboxVideoFrame* frame, AnboxCallback* release,
+                                                           int timeout) {
+  if (frame == NULL || release == NULL)
+    return -EINVAL;
+
+  QueuedFrame new_frame;
+  const auto ret = pop_frame(&new_frame, timeout);
+  if (ret < 0)
+    return ret;
+
+  if (new_frame.frame2.fd < 0) {
+    //NOTE: to avoid extra video frame copy, here we do a shadow copy
+    //for the underlying video buffer. The caller releases it through
+    //the callback after using the video frame.
+    *frame = new_frame.frame;
+    *release = new_frame.release;
+    return 0;
+  }
+
+  // Frames injected by file descriptor are packed into a frame of our own
+  const auto& frame2 = new_frame.frame2;
+  AnboxVideoFrame packed;
+  AnboxVideoFrame2 layout;
+  if (frame_pool_.acquire(select_camera_spec_, &packed, release) < 0 ||
+      !VideoFramePool::describe(select_camera_spec_, &layout))
     RETURN_ON_ERROR(new_frame);
 
-  switch (select_camera_spec_.format) {
-  case AnboxVideoColorSpaceFormat::VIDEO_FRAME_FORMAT_RGBA:
-    if (new_frame.size != select_camera_spec_.width * select_camera_spec_.height * 4)
-      RETURN_ON_ERROR(new_frame);
-  break;
-  case AnboxVideoColorSpaceFormat::VIDEO_FRAME_FORMAT_YUV420:
-    if (new_frame.size !=  select_camera_spec_.width * select_camera_spec_.height * 3 / 2)
-      RETURN_ON_ERROR(new_frame);
-  break;
-  default:
+  auto src = static_cast<const uint8_t*>(::mmap(nullptr, frame2.size, PROT_READ, MAP_SHARED, frame2.fd, 0));
+  if (src == MAP_FAILED) {
+    release->callback(release->user_data);
     RETURN_ON_ERROR(new_frame);
   }
+  for (uint8_t n = 0; n < layout.num_planes; n++) {
+    const size_t rows = VideoFramePool::plane_rows(select_camera_spec_, n);
+    for (size_t row = 0; row < rows; row++)
+      memcpy(packed.data + layout.offset[n] + row * layout.stride[n],
+             src + frame2.offset[n] + row * frame2.stride[n], layout.stride[n]);
+  }
+  ::munmap(const_cast<uint8_t*>(src), frame2.size);
+  release_frame(new_frame);
 
-  //NOTE: to avoid extra video frame copy, here we do a shadow copy
-  //for the underlying video buffer. It's the caller's responsibility
-  //to release the resource after using the video frame.
-  frame->data = new_frame.data;
-  frame->size = new_frame.size;
+  *frame = packed;
   return 0;
 }
 
+int CameraPlatformCameraProcessor::read_frame2(AnboxVideoFrame2* frame, int timeout) {
+  if (frame == NULL)
+    return -EINVAL;
+
+  QueuedFrame new_frame;
+  const auto ret = pop_frame(&new_frame, timeout);
+  if (ret < 0)
+    return ret;
+
+  // Frames injected by file descriptor are handed on as they are
+  if (new_frame.frame2.fd >= 0) {
+    *frame = new_frame.frame2;
+    return 0;
+  }
+
+  uint8_t* data = nullptr;
+  if (frame_pool_.acquire(select_camera_spec_, frame, &data) < 0)
+    RETURN_ON_ERROR(new_frame);
+  memcpy(data, new_frame.frame.data, new_frame.frame.size);
+  frame->timestamp_ns = new_frame.frame2.timestamp_ns;
+  frame->sequence = new_frame.frame2.sequence;
+  release_frame(new_frame);
+  return 0;
+}
+
+int CameraPlatformCameraProcessor::event_fd() const {
+  return frame_queue_.fd();
+}
+
 class CameraGraphicsProcessor : public GraphicsProcessor {
  public:
   CameraGraphicsProcessor() {}
@@ -17,18 +17,12 @@
  */
 
 #include "anbox-platform-sdk/plugin.h"
+#include "anbox-platform-sdk/blocking_queue.h"
 
-#include <chrono>
-#include <atomic>
-#include <future>
-#include <queue>
 #include <iostream>
 #include <memory>
-#include <mutex>
 #include <string.h>
 
-namespace chrono = std::chrono;
-
 #ifndef SYSTEM_LIBDIR
 #define SYSTEM_LIBDIR
 #endif
@@ -87,38 +81,23 @@ class GpsPlatformGpsProcessor : public GpsProcessor {
 
     int read_data(AnboxGpsData* data, int timeout) override;
     int inject_data(AnboxGpsData data) override;
+    int event_fd() const override;
   private:
-    std::queue<AnboxGpsData> data_queue_;
-    std::mutex mutex_;
+    // Outdated location fixes are useless, so once the consumer falls
+    // behind the oldest ones get dropped in favour of new ones.
+    BlockingQueue<AnboxGpsData, 1024, SpscRingPolicy::OverwriteOldest> data_queue_;
 };
 
 int GpsPlatformGpsProcessor::inject_data(AnboxGpsData data) {
-  std::unique_lock<std::mutex> lock(mutex_);
   data_queue_.push(data);
   return 0;
 }
 
 int GpsPlatformGpsProcessor::read_data(AnboxGpsData* data, int timeout) {
-  std::atomic_bool finished{false};
-  if (timeout == 0)
-    finished.store(true);
-  auto fut = std::async(
-    std::launch::async, [&]() {
-      do {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (data_queue_.size() > 0){
-          auto dt = data_queue_.front();
-          data_queue_.pop();
-          return dt;
-        }
-      } while(!finished);
-      return AnboxGpsData{AnboxGpsDataType::Unknown};
-    });
-
-  if (timeout > 0 && fut.wait_for(chrono::milliseconds(timeout)) == std::future_status::timeout)
-    finished.store(true);
-
-  auto new_gps_data = fut.get();
+  AnboxGpsData new_gps_data;
+  if (!data_queue_.pop(new_gps_data, timeout))
+    return -EIO;
+
   switch (new_gps_data.data_type) {
     case AnboxGpsDataType::GGA:
     case AnboxGpsDataType::RMC:
@@ -130,6 +109,10 @@ int GpsPlatformGpsProcessor::read_data(AnboxGpsData* data, int timeout) {
   }
 }
 
+int GpsPlatformGpsProcessor::event_fd() const {
+  return data_queue_.fd();
+}
+
 class GpsGraphicsProcessor : public GraphicsProcessor {
  public:
   GpsGraphicsProcessor() {}
@@ -17,18 +17,12 @@
  */
 
 #include "anbox-platform-sdk/plugin.h"
+#include "anbox-platform-sdk/blocking_queue.h"
 
-#include <chrono>
-#include <atomic>
-#include <future>
-#include <queue>
 #include <iostream>
 #include <memory>
-#include <mutex>
 #include <string.h>
 
-namespace chrono = std::chrono;
-
 #ifndef SYSTEM_LIBDIR
 #define SYSTEM_LIBDIR
 #endif
@@ -89,9 +83,11 @@ class SensorPlatformSensorProcessor : public SensorProcessor {
     AnboxSensorType supported_sensors() const override;
     int read_data(AnboxSensorData* data, int timeout) override;
     int inject_data(AnboxSensorData data) override;
+    int event_fd() const override;
   private:
-    std::queue<AnboxSensorData> data_queue_;
-    std::mutex mutex_;
+    // Sensor samples are only meaningful while fresh, so once the consumer
+    // falls behind the oldest ones get dropped in favour of new ones.
+    BlockingQueue<AnboxSensorData, 1024, SpscRingPolicy::OverwriteOldest> data_queue_;
 };
 
 AnboxSensorType SensorPlatformSensorProcessor::supported_sensors() const {
@@ -99,32 +95,15 @@ AnboxSensorType SensorPlatformSensorProcessor::supported_sensors() const {
 }
 
 int SensorPlatformSensorProcessor::inject_data(AnboxSensorData data) {
-  std::unique_lock<std::mutex> lock(mutex_);
   data_queue_.push(data);
   return 0;
 }
 
 int SensorPlatformSensorProcessor::read_data(AnboxSensorData* data, int timeout) {
-  std::atomic_bool finished{false};
-  if (timeout == 0)
-    finished.store(true);
-  auto fut = std::async(
-    std::launch::async, [&]() {
-      do {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (data_queue_.size() > 0){
-          auto dt = data_queue_.front();
-          data_queue_.pop();
-          return dt;
-        }
-      } while(!finished);
-      return AnboxSensorData{AnboxSensorType::NONE};
-    });
-
-  if (timeout > 0 && fut.wait_for(chrono::milliseconds(timeout)) == std::future_status::timeout)
-    finished.store(true);
-
-  auto new_sensor_data = fut.get();
+  AnboxSensorData new_sensor_data;
+  if (!data_queue_.pop(new_sensor_data, timeout))
+    return -EIO;
+
   data->sensor_type = new_sensor_data.sensor_type;
   switch (new_sensor_data.sensor_type) {
     case AnboxSensorType::ACCELERATION:
@@ -167,6 +146,10 @@ int SensorPlatformSensorProcessor::read_data(AnboxSensorData* data, int timeout)
   }
 }
 
+int SensorPlatformSensorProcessor::event_fd() const {
+  return data_queue_.fd();
+}
+
 class SensorPlatform : public anbox::Platform {
  public:
   SensorPlatform(const AnboxPlatformConfiguration* configuration) :
@@ -0,0 +1,927 @@
+/*
+ * This file is part of Anbox Platform SDK
+ *
+ * Copyright 2021 Canonical Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANBOX_SDK_AUDIO_PCM_H_
+#define ANBOX_SDK_AUDIO_PCM_H_
+
+#include "anbox-platform-sdk/types.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ANBOX_PCM_HAVE_X86 1
+#define ANBOX_PCM_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON) && defined(ANBOX_PLATFORM_SDK_NEON)
+// The NEON kernels are opt-in until they are verified against the scalar ones
+// on AArch64 hardware.
+#include <arm_neon.h>
+#define ANBOX_PCM_HAVE_NEON 1
+#endif
+
+namespace anbox {
+namespace pcm {
+/**
+ * @brief Instruction set a set of PCM kernels is implemented with.
+ */
+enum class SimdLevel {
+  /** Portable C++ implementation, available everywhere. */
+  Scalar,
+  /** x86-64 SSE2, available on every x86-64 CPU. */
+  SSE2,
+  /** x86-64 AVX2, selected when the CPU supports it. */
+  AVX2,
+  /** AArch64 Advanced SIMD, only built with ANBOX_PLATFORM_SDK_NEON defined. */
+  NEON,
+};
+
+/**
+ * @brief The low level PCM kernels of one instruction set.
+ *
+ * Samples are converted to and from float in the range [-1.0, 1.0).
+ * Conversions to integer formats round to the nearest value and saturate.
+ * All kernels but dot_float produce the same results for every SimdLevel,
+ * dot_float sums in a different order and may differ in the last bits.
+ */
+struct Kernels {
+  SimdLevel level;
+  const char* name;
+  void (*s16_to_float)(const int16_t* src, float* dst, size_t count);
+  void (*float_to_s16)(const float* src, int16_t* dst, size_t count);
+  /** Computes dst = src * scale. */
+  void (*s32_to_float)(const int32_t* src, float* dst, size_t count, float scale);
+  /** Computes dst = clamp(src * scale, -scale, max). */
+  void (*float_to_s32)(const float* src, int32_t* dst, size_t count, float scale, float max);
+  void (*gain_float)(float* data, size_t count, float gain);
+  void (*gain_s16)(int16_t* data, size_t count, float gain);
+  void (*mono_to_stereo_float)(const float* src, float* dst, size_t frames);
+  void (*stereo_to_mono_float)(const float* src, float* dst, size_t frames);
+  void (*mono_to_stereo_s16)(const int16_t* src, int16_t* dst, size_t frames);
+  void (*stereo_to_mono_s16)(const int16_t* src, int16_t* dst, size_t frames);
+  /** Computes the sum of a[n] * b[n], e.g. for FIR filters. */
+  float (*dot_float)(const float* a, const float* b, size_t count);
+};
+
+namespace internal {
+constexpr float s16_scale = 32768.0f;
+constexpr float s32_scale = 2147483648.0f;
+// Largest float below 2^31, anything above overflows the conversion to int32
+constexpr float s32_max = 2147483520.0f;
+constexpr float q8_23_scale = 8388608.0f;
+constexpr float q8_23_max = 8388607.0f;
+// Number of samples converted through the stack at once by the generic helpers
+constexpr size_t block_samples = 256;
+constexpr size_t max_channels = 8;
+
+inline float clamp(float value, float min, float max) {
+  return std::min(std::max(value, min), max);
+}
+
+namespace scalar {
+inline void s16_to_float(const int16_t* src, float* dst, size_t count) {
+  for (size_t n = 0; n < count; n++)
+    dst[n] = src[n] * (1.0f / s16_scale);
+}
+
+inline void float_to_s16(const float* src, int16_t* dst, size_t count) {
+  for (size_t n = 0; n < count; n++)
+    dst[n] = static_cast<int16_t>(lrintf(clamp(src[n] * s16_scale, -s16_scale, s16_scale - 1.0f)));
+}
+
+inline void s32_to_float(const int32_t* src, float* dst, size_t count, float scale) {
+  for (size_t n = 0; n < count; n++)
+    dst[n] = static_cast<float>(src[n]) * scale;
+}
+
+inline void float_to_s32(const float* src, int32_t* dst, size_t count, float scale, float max) {
+  for (size_t n = 0; n < count; n++)
+    dst[n] = static_cast<int32_t>(lrintf(clamp(src[n] * scale, -scale, max)));
+}
+
+inline void gain_float(float* data, size_t count, float gain) {
+  for (size_t n = 0; n < count; n++)
+    data[n] *= gain;
+}
+
+inline void gain_s16(int16_t* data, size_t count, float gain) {
+  for (size_t n = 0; n < count; n++)
+    data[n] = static_cast<int16_t>(lrintf(clamp(data[n] * gain, -s16_scale, s16_scale - 1.0f)));
+}
+
+inline void mono_to_stereo_float(const float* src, float* dst, size_t frames) {
+  for (size_t n = 0; n < frames; n++)
+    dst[2 * n] = dst[2 * n + 1] = src[n];
+}
+
+inline void stereo_to_mono_float(const float* src, float* dst, size_t frames) {
+  for (size_t n = 0; n < frames; n++)
+    dst[n] = (src[2 * n] + src[2 * n + 1]) * 0.5f;
+}
+
+inline void mono_to_stereo_s16(const int16_t* src, int16_t* dst, size_t frames) {
+  for (size_t n = 0; n < frames; n++)
+    dst[2 * n] = dst[2 * n + 1] = src[n];
+}
+
+inline void stereo_to_mono_s16(const int16_t* src, int16_t* dst, size_t frames) {
+  for (size_t n = 0; n < frames; n++)
+    dst[n] = static_cast<int16_t>((src[2 * n] + src[2 * n + 1]) >> 1);
+}
+
+inline float dot_float(const float* a, const float* b, size_t count) {
+  float sum = 0.0f;
+  for (size_t n = 0; n < count; n++)
+    sum += a[n] * b[n];
+  return sum;
+}
+} // namespace scalar
+
+#if defined(ANBOX_PCM_HAVE_X86)
+namespace sse2 {
+inline __m128 load_s16_as_float(__m128i v, bool high) {
+  const auto wide = high ? _mm_unpackhi_epi16(v, v) : _mm_unpacklo_epi16(v, v);
+  return _mm_cvtepi32_ps(_mm_srai_epi32(wide, 16));
+}
+
+inline __m128i float_to_s16x8(__m128 lo, __m128 hi) {
+  const auto min = _mm_set1_ps(-s16_scale);
+  const auto max = _mm_set1_ps(s16_scale - 1.0f);
+  lo = _mm_min_ps(_mm_max_ps(lo, min), max);
+  hi = _mm_min_ps(_mm_max_ps(hi, min), max);
+  return _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+}
+
+inline void s16_to_float(const int16_t* src, float* dst, size_t count) {
+  const auto scale = _mm_set1_ps(1.0f / s16_scale);
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+    _mm_storeu_ps(dst + n, _mm_mul_ps(load_s16_as_float(v, false), scale));
+    _mm_storeu_ps(dst + n + 4, _mm_mul_ps(load_s16_as_float(v, true), scale));
+  }
+  scalar::s16_to_float(src + n, dst + n, count - n);
+}
+
+inline void float_to_s16(const float* src, int16_t* dst, size_t count) {
+  const auto scale = _mm_set1_ps(s16_scale);
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    const auto lo = _mm_mul_ps(_mm_loadu_ps(src + n), scale);
+    const auto hi = _mm_mul_ps(_mm_loadu_ps(src + n + 4), scale);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), float_to_s16x8(lo, hi));
+  }
+  scalar::float_to_s16(src + n, dst + n, count - n);
+}
+
+inline void s32_to_float(const int32_t* src, float* dst, size_t count, float scale) {
+  const auto s = _mm_set1_ps(scale);
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+    _mm_storeu_ps(dst + n, _mm_mul_ps(_mm_cvtepi32_ps(v), s));
+  }
+  scalar::s32_to_float(src + n, dst + n, count - n, scale);
+}
+
+inline void float_to_s32(const float* src, int32_t* dst, size_t count, float scale, float max) {
+  const auto s = _mm_set1_ps(scale);
+  const auto lo = _mm_set1_ps(-scale);
+  const auto hi = _mm_set1_ps(max);
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4) {
+    auto v = _mm_mul_ps(_mm_loadu_ps(src + n), s);
+    v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), _mm_cvtps_epi32(v));
+  }
+  scalar::float_to_s32(src + n, dst + n, count - n, scale, max);
+}
+
+inline void gain_float(float* data, size_t count, float gain) {
+  const auto g = _mm_set1_ps(gain);
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4)
+    _mm_storeu_ps(data + n, _mm_mul_ps(_mm_loadu_ps(data + n), g));
+  scalar::gain_float(data + n, count - n, gain);
+}
+
+inline void gain_s16(int16_t* data, size_t count, float gain) {
+  const auto g = _mm_set1_ps(gain);
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + n));
+    const auto lo = _mm_mul_ps(load_s16_as_float(v, false), g);
+    const auto hi = _mm_mul_ps(load_s16_as_float(v, true), g);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + n), float_to_s16x8(lo, hi));
+  }
+  scalar::gain_s16(data + n, count - n, gain);
+}
+
+inline void mono_to_stereo_float(const float* src, float* dst, size_t frames) {
+  size_t n = 0;
+  for (; n + 4 <= frames; n += 4) {
+    const auto v = _mm_loadu_ps(src + n);
+    _mm_storeu_ps(dst + 2 * n, _mm_unpacklo_ps(v, v));
+    _mm_storeu_ps(dst + 2 * n + 4, _mm_unpackhi_ps(v, v));
+  }
+  scalar::mono_to_stereo_float(src + n, dst + 2 * n, frames - n);
+}
+
+inline void stereo_to_mono_float(const float* src, float* dst, size_t frames) {
+  const auto half = _mm_set1_ps(0.5f);
+  size_t n = 0;
+  for (; n + 4 <= frames; n += 4) {
+    const auto a = _mm_loadu_ps(src + 2 * n);
+    const auto b = _mm_loadu_ps(src + 2 * n + 4);
+    const auto left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    const auto right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    _mm_storeu_ps(dst + n, _mm_mul_ps(_mm_add_ps(left, right), half));
+  }
+  scalar::stereo_to_mono_float(src + 2 * n, dst + n, frames - n);
+}
+
+inline void mono_to_stereo_s16(const int16_t* src, int16_t* dst, size_t frames) {
+  size_t n = 0;
+  for (; n + 8 <= frames; n += 8) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * n), _mm_unpacklo_epi16(v, v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * n + 8), _mm_unpackhi_epi16(v, v));
+  }
+  scalar::mono_to_stereo_s16(src + n, dst + 2 * n, frames - n);
+}
+
+inline void stereo_to_mono_s16(const int16_t* src, int16_t* dst, size_t frames) {
+  // Multiplying with ones and adding adjacent pairs sums left and right
+  // without any risk of overflow.
+  const auto ones = _mm_set1_epi16(1);
+  size_t n = 0;
+  for (; n + 8 <= frames; n += 8) {
+    const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * n));
+    const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * n + 8));
+    const auto lo = _mm_srai_epi32(_mm_madd_epi16(a, ones), 1);
+    const auto hi = _mm_srai_epi32(_mm_madd_epi16(b, ones), 1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), _mm_packs_epi32(lo, hi));
+  }
+  scalar::stereo_to_mono_s16(src + 2 * n, dst + n, frames - n);
+}
+
+inline float dot_float(const float* a, const float* b, size_t count) {
+  auto sum = _mm_setzero_ps();
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4)
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + n), _mm_loadu_ps(b + n)));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum) + scalar::dot_float(a + n, b + n, count - n);
+}
+} // namespace sse2
+
+namespace avx2 {
+ANBOX_PCM_TARGET_AVX2 inline __m256 load_s16_as_float(const int16_t* src) {
+  const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+}
+
+ANBOX_PCM_TARGET_AVX2 inline __m256i float_to_s16x16(__m256 lo, __m256 hi) {
+  const auto min = _mm256_set1_ps(-s16_scale);
+  const auto max = _mm256_set1_ps(s16_scale - 1.0f);
+  lo = _mm256_min_ps(_mm256_max_ps(lo, min), max);
+  hi = _mm256_min_ps(_mm256_max_ps(hi, min), max);
+  // Packing works per 128 bit lane, so the 64 bit halves need reordering
+  const auto packed = _mm256_packs_epi32(_mm256_cvtps_epi32(lo), _mm256_cvtps_epi32(hi));
+  return _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void s16_to_float(const int16_t* src, float* dst, size_t count) {
+  const auto scale = _mm256_set1_ps(1.0f / s16_scale);
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8)
+    _mm256_storeu_ps(dst + n, _mm256_mul_ps(load_s16_as_float(src + n), scale));
+  scalar::s16_to_float(src + n, dst + n, count - n);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void float_to_s16(const float* src, int16_t* dst, size_t count) {
+  const auto scale = _mm256_set1_ps(s16_scale);
+  size_t n = 0;
+  for (; n + 16 <= count; n += 16) {
+    const auto lo = _mm256_mul_ps(_mm256_loadu_ps(src + n), scale);
+    const auto hi = _mm256_mul_ps(_mm256_loadu_ps(src + n + 8), scale);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n), float_to_s16x16(lo, hi));
+  }
+  scalar::float_to_s16(src + n, dst + n, count - n);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void s32_to_float(const int32_t* src, float* dst, size_t count, float scale) {
+  const auto s = _mm256_set1_ps(scale);
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n));
+    _mm256_storeu_ps(dst + n, _mm256_mul_ps(_mm256_cvtepi32_ps(v), s));
+  }
+  scalar::s32_to_float(src + n, dst + n, count - n, scale);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void float_to_s32(const float* src, int32_t* dst, size_t count,
+                                               float scale, float max) {
+  const auto s = _mm256_set1_ps(scale);
+  const auto lo = _mm256_set1_ps(-scale);
+  const auto hi = _mm256_set1_ps(max);
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    auto v = _mm256_mul_ps(_mm256_loadu_ps(src + n), s);
+    v = _mm256_min_ps(_mm256_max_ps(v, lo), hi);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n), _mm256_cvtps_epi32(v));
+  }
+  scalar::float_to_s32(src + n, dst + n, count - n, scale, max);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void gain_float(float* data, size_t count, float gain) {
+  const auto g = _mm256_set1_ps(gain);
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8)
+    _mm256_storeu_ps(data + n, _mm256_mul_ps(_mm256_loadu_ps(data + n), g));
+  scalar::gain_float(data + n, count - n, gain);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void gain_s16(int16_t* data, size_t count, float gain) {
+  const auto g = _mm256_set1_ps(gain);
+  size_t n = 0;
+  for (; n + 16 <= count; n += 16) {
+    const auto lo = _mm256_mul_ps(load_s16_as_float(data + n), g);
+    const auto hi = _mm256_mul_ps(load_s16_as_float(data + n + 8), g);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + n), float_to_s16x16(lo, hi));
+  }
+  scalar::gain_s16(data + n, count - n, gain);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void mono_to_stereo_float(const float* src, float* dst, size_t frames) {
+  size_t n = 0;
+  for (; n + 8 <= frames; n += 8) {
+    const auto v = _mm256_loadu_ps(src + n);
+    const auto lo = _mm256_unpacklo_ps(v, v);
+    const auto hi = _mm256_unpackhi_ps(v, v);
+    _mm256_storeu_ps(dst + 2 * n, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(dst + 2 * n + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+  scalar::mono_to_stereo_float(src + n, dst + 2 * n, frames - n);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void stereo_to_mono_float(const float* src, float* dst, size_t frames) {
+  const auto half = _mm256_set1_ps(0.5f);
+  size_t n = 0;
+  for (; n + 8 <= frames; n += 8) {
+    const auto a = _mm256_loadu_ps(src + 2 * n);
+    const auto b = _mm256_loadu_ps(src + 2 * n + 8);
+    const auto left = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    const auto right = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    const auto sum = _mm256_mul_ps(_mm256_add_ps(left, right), half);
+    const auto ordered = _mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_ps(dst + n, _mm256_castpd_ps(ordered));
+  }
+  scalar::stereo_to_mono_float(src + 2 * n, dst + n, frames - n);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void mono_to_stereo_s16(const int16_t* src, int16_t* dst, size_t frames) {
+  size_t n = 0;
+  for (; n + 16 <= frames; n += 16) {
+    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n));
+    const auto lo = _mm256_unpacklo_epi16(v, v);
+    const auto hi = _mm256_unpackhi_epi16(v, v);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * n), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * n + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  scalar::mono_to_stereo_s16(src + n, dst + 2 * n, frames - n);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline void stereo_to_mono_s16(const int16_t* src, int16_t* dst, size_t frames) {
+  const auto ones = _mm256_set1_epi16(1);
+  size_t n = 0;
+  for (; n + 16 <= frames; n += 16) {
+    const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * n));
+    const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * n + 16));
+    const auto lo = _mm256_srai_epi32(_mm256_madd_epi16(a, ones), 1);
+    const auto hi = _mm256_srai_epi32(_mm256_madd_epi16(b, ones), 1);
+    const auto packed = _mm256_packs_epi32(lo, hi);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n),
+                        _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  scalar::stereo_to_mono_s16(src + 2 * n, dst + n, frames - n);
+}
+
+ANBOX_PCM_TARGET_AVX2 inline float dot_float(const float* a, const float* b, size_t count) {
+  auto sum = _mm256_setzero_ps();
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8)
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + n), _mm256_loadu_ps(b + n)));
+  auto half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+  return _mm_cvtss_f32(half) + scalar::dot_float(a + n, b + n, count - n);
+}
+} // namespace avx2
+#endif
+
+#if defined(ANBOX_PCM_HAVE_NEON)
+namespace neon {
+inline int16x8_t float_to_s16x8(float32x4_t lo, float32x4_t hi) {
+  const auto min = vdupq_n_f32(-s16_scale);
+  const auto max = vdupq_n_f32(s16_scale - 1.0f);
+  lo = vminq_f32(vmaxq_f32(lo, min), max);
+  hi = vminq_f32(vmaxq_f32(hi, min), max);
+  return vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(lo)), vqmovn_s32(vcvtnq_s32_f32(hi)));
+}
+
+inline void s16_to_float(const int16_t* src, float* dst, size_t count) {
+  const float scale = 1.0f / s16_scale;
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    const auto v = vld1q_s16(src + n);
+    vst1q_f32(dst + n, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+    vst1q_f32(dst + n + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+  }
+  scalar::s16_to_float(src + n, dst + n, count - n);
+}
+
+inline void float_to_s16(const float* src, int16_t* dst, size_t count) {
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    const auto lo = vmulq_n_f32(vld1q_f32(src + n), s16_scale);
+    const auto hi = vmulq_n_f32(vld1q_f32(src + n + 4), s16_scale);
+    vst1q_s16(dst + n, float_to_s16x8(lo, hi));
+  }
+  scalar::float_to_s16(src + n, dst + n, count - n);
+}
+
+inline void s32_to_float(const int32_t* src, float* dst, size_t count, float scale) {
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4)
+    vst1q_f32(dst + n, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + n)), scale));
+  scalar::s32_to_float(src + n, dst + n, count - n, scale);
+}
+
+inline void float_to_s32(const float* src, int32_t* dst, size_t count, float scale, float max) {
+  const auto lo = vdupq_n_f32(-scale);
+  const auto hi = vdupq_n_f32(max);
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4) {
+    auto v = vmulq_n_f32(vld1q_f32(src + n), scale);
+    v = vminq_f32(vmaxq_f32(v, lo), hi);
+    vst1q_s32(dst + n, vcvtnq_s32_f32(v));
+  }
+  scalar::float_to_s32(src + n, dst + n, count - n, scale, max);
+}
+
+inline void gain_float(float* data, size_t count, float gain) {
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4)
+    vst1q_f32(data + n, vmulq_n_f32(vld1q_f32(data + n), gain));
+  scalar::gain_float(data + n, count - n, gain);
+}
+
+inline void gain_s16(int16_t* data, size_t count, float gain) {
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    const auto v = vld1q_s16(data + n);
+    const auto lo = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), gain);
+    const auto hi = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), gain);
+    vst1q_s16(data + n, float_to_s16x8(lo, hi));
+  }
+  scalar::gain_s16(data + n, count - n, gain);
+}
+
+inline void mono_to_stereo_float(const float* src, float* dst, size_t frames) {
+  size_t n = 0;
+  for (; n + 4 <= frames; n += 4) {
+    const auto v = vld1q_f32(src + n);
+    vst2q_f32(dst + 2 * n, (float32x4x2_t{{v, v}}));
+  }
+  scalar::mono_to_stereo_float(src + n, dst + 2 * n, frames - n);
+}
+
+inline void stereo_to_mono_float(const float* src, float* dst, size_t frames) {
+  size_t n = 0;
+  for (; n + 4 <= frames; n += 4) {
+    const auto v = vld2q_f32(src + 2 * n);
+    vst1q_f32(dst + n, vmulq_n_f32(vaddq_f32(v.val[0], v.val[1]), 0.5f));
+  }
+  scalar::stereo_to_mono_float(src + 2 * n, dst + n, frames - n);
+}
+
+inline void mono_to_stereo_s16(const int16_t* src, int16_t* dst, size_t frames) {
+  size_t n = 0;
+  for (; n + 8 <= frames; n += 8) {
+    const auto v = vld1q_s16(src + n);
+    vst2q_s16(dst + 2 * n, (int16x8x2_t{{v, v}}));
+  }
+  scalar::mono_to_stereo_s16(src + n, dst + 2 * n, frames - n);
+}
+
+inline void stereo_to_mono_s16(const int16_t* src, int16_t* dst, size_t frames) {
+  size_t n = 0;
+  for (; n + 8 <= frames; n += 8) {
+    const auto v = vld2q_s16(src + 2 * n);
+    const auto lo = vshrq_n_s32(vaddl_s16(vget_low_s16(v.val[0]), vget_low_s16(v.val[1])), 1);
+    const auto hi = vshrq_n_s32(vaddl_s16(vget_high_s16(v.val[0]), vget_high_s16(v.val[1])), 1);
+    vst1q_s16(dst + n, vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+  }
+  scalar::stereo_to_mono_s16(src + 2 * n, dst + n, frames - n);
+}
+
+inline float dot_float(const float* a, const float* b, size_t count) {
+  auto sum = vdupq_n_f32(0.0f);
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4)
+    sum = vmlaq_f32(sum, vld1q_f32(a + n), vld1q_f32(b + n));
+  return vaddvq_f32(sum) + scalar::dot_float(a + n, b + n, count - n);
+}
+} // namespace neon
+#endif
+
+#define ANBOX_PCM_KERNELS(level, ns) \
+  Kernels{level, #ns, &internal::ns::s16_to_float, &internal::ns::float_to_s16, \
+          &internal::ns::s32_to_float, &internal::ns::float_to_s32, &internal::ns::gain_float, \
+          &internal::ns::gain_s16, &internal::ns::mono_to_stereo_float, \
+          &internal::ns::stereo_to_mono_float, &internal::ns::mono_to_stereo_s16, \
+          &internal::ns::stereo_to_mono_s16, &internal::ns::dot_float}
+
+inline SimdLevel detect_simd_level() {
+#if defined(ANBOX_PCM_HAVE_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SimdLevel::AVX2;
+  return SimdLevel::SSE2;
+#elif defined(ANBOX_PCM_HAVE_NEON)
+  return SimdLevel::NEON;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+} // namespace internal
+
+/**
+ * @brief Get the kernels implemented with a specific instruction set.
+ *
+ * This is mostly useful for tests and benchmarks, everything else should
+ * use kernels() which picks the best implementation for the running CPU.
+ *
+ * @param level the instruction set of the kernels.
+ * @return the kernels or nullptr if \a level is not supported by the build or the CPU.
+ */
+inline const Kernels* kernels_for(SimdLevel level) {
+  static const Kernels scalar_kernels = ANBOX_PCM_KERNELS(SimdLevel::Scalar, scalar);
+#if defined(ANBOX_PCM_HAVE_X86)
+  static const Kernels sse2_kernels = ANBOX_PCM_KERNELS(SimdLevel::SSE2, sse2);
+  static const Kernels avx2_kernels = ANBOX_PCM_KERNELS(SimdLevel::AVX2, avx2);
+#elif defined(ANBOX_PCM_HAVE_NEON)
+  static const Kernels neon_kernels = ANBOX_PCM_KERNELS(SimdLevel::NEON, neon);
+#endif
+
+  switch (level) {
+  case SimdLevel::Scalar:
+    return &scalar_kernels;
+#if defined(ANBOX_PCM_HAVE_X86)
+  case SimdLevel::SSE2:
+    return &sse2_kernels;
+  case SimdLevel::AVX2:
+    return internal::detect_simd_level() == SimdLevel::AVX2 ? &avx2_kernels : nullptr;
+#elif defined(ANBOX_PCM_HAVE_NEON)
+  case SimdLevel::NEON:
+    return &neon_kernels;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+/**
+ * @brief Get the best kernels for the running CPU. The CPU is only probed on the first call.
+ */
+inline const Kernels& kernels() {
+  static const Kernels* best = kernels_for(internal::detect_simd_level());
+  return *best;
+}
+
+/**
+ * @brief Size of a single sample in bytes or 0 if \a format is not a known PCM format.
+ */
+inline size_t bytes_per_sample(AnboxAudioFormat format) {
+  switch (format) {
+  case AUDIO_FORMAT_PCM_8_BIT:
+    return 1;
+  case AUDIO_FORMAT_PCM_16_BIT:
+    return 2;
+  case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+    return 3;
+  case AUDIO_FORMAT_PCM_32_BIT:
+  case AUDIO_FORMAT_PCM_8_24_BIT:
+  case AUDIO_FORMAT_PCM_FLOAT:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Convert \a count samples of \a format to float.
+ *
+ * @return 0 on success or -EINVAL if \a format is not a known PCM format.
+ */
+inline int to_float(const void* src, AnboxAudioFormat format, float* dst, size_t count) {
+  const auto& k = kernels();
+  switch (format) {
+  case AUDIO_FORMAT_PCM_8_BIT: {
+    const auto in = static_cast<const uint8_t*>(src);
+    for (size_t n = 0; n < count; n++)
+      dst[n] = (static_cast<int>(in[n]) - 128) * (1.0f / 128.0f);
+    return 0;
+  }
+  case AUDIO_FORMAT_PCM_16_BIT:
+    k.s16_to_float(static_cast<const int16_t*>(src), dst, count);
+    return 0;
+  case AUDIO_FORMAT_PCM_24_BIT_PACKED: {
+    const auto in = static_cast<const uint8_t*>(src);
+    for (size_t n = 0; n < count; n++) {
+      // Shift the sign bit of the 24 bit sample into the top of a 32 bit one
+      const auto value = static_cast<int32_t>(static_cast<uint32_t>(in[3 * n]) << 8 |
+                                              static_cast<uint32_t>(in[3 * n + 1]) << 16 |
+                                              static_cast<uint32_t>(in[3 * n + 2]) << 24);
+      dst[n] = static_cast<float>(value) * (1.0f / internal::s32_scale);
+    }
+    return 0;
+  }
+  case AUDIO_FORMAT_PCM_32_BIT:
+    k.s32_to_float(static_cast<const int32_t*>(src), dst, count, 1.0f / internal::s32_scale);
+    return 0;
+  case AUDIO_FORMAT_PCM_8_24_BIT:
+    k.s32_to_float(static_cast<const int32_t*>(src), dst, count, 1.0f / internal::q8_23_scale);
+    return 0;
+  case AUDIO_FORMAT_PCM_FLOAT:
+    memmove(dst, src, count * sizeof(float));
+    return 0;
+  default:
+    return -EINVAL;
+  }
+}
+
+/**
+ * @brief Convert \a count float samples to \a format, clipping everything outside of [-1.0, 1.0).
+ *
+ * @return 0 on success or -EINVAL if \a format is not a known PCM format.
+ */
+inline int from_float(const float* src, AnboxAudioFormat format, void* dst, size_t count) {
+  const auto& k = kernels();
+  switch (format) {
+  case AUDIO_FORMAT_PCM_8_BIT: {
+    const auto out = static_cast<uint8_t*>(dst);
+    for (size_t n = 0; n < count; n++)
+      out[n] = static_cast<uint8_t>(lrintf(internal::clamp(src[n] * 128.0f, -128.0f, 127.0f)) + 128);
+    return 0;
+  }
+  case AUDIO_FORMAT_PCM_16_BIT:
+    k.float_to_s16(src, static_cast<int16_t*>(dst), count);
+    return 0;
+  case AUDIO_FORMAT_PCM_24_BIT_PACKED: {
+    const auto out = static_cast<uint8_t*>(dst);
+    for (size_t n = 0; n < count; n++) {
+      const auto value = static_cast<int32_t>(lrintf(
+          internal::clamp(src[n] * internal::q8_23_scale, -internal::q8_23_scale, internal::q8_23_max)));
+      out[3 * n] = static_cast<uint8_t>(value);
+      out[3 * n + 1] = static_cast<uint8_t>(value >> 8);
+      out[3 * n + 2] = static_cast<uint8_t>(value >> 16);
+    }
+    return 0;
+  }
+  case AUDIO_FORMAT_PCM_32_BIT:
+    k.float_to_s32(src, static_cast<int32_t*>(dst), count, internal::s32_scale, internal::s32_max);
+    return 0;
+  case AUDIO_FORMAT_PCM_8_24_BIT:
+    k.float_to_s32(src, static_cast<int32_t*>(dst), count, internal::q8_23_scale, internal::q8_23_max);
+    return 0;
+  case AUDIO_FORMAT_PCM_FLOAT:
+    memmove(dst, src, count * sizeof(float));
+    return 0;
+  default:
+    return -EINVAL;
+  }
+}
+
+/**
+ * @brief Convert \a count samples from \a src_format to \a dst_format.
+ *
+ * Conversions between 16 bit and float samples run directly, everything
+ * else is converted through float in small blocks on the stack, so no
+ * memory is allocated. \a src and \a dst may point to the same buffer as
+ * long as samples of \a dst_format are not larger than those of \a src_format.
+ *
+ * @return 0 on success or -EINVAL if one of the formats is not a known PCM format.
+ */
+inline int convert(const void* src, AnboxAudioFormat src_format,
+                   void* dst, AnboxAudioFormat dst_format, size_t count) {
+  const auto src_size = bytes_per_sample(src_format);
+  const auto dst_size = bytes_per_sample(dst_format);
+  if (src_size == 0 || dst_size == 0)
+    return -EINVAL;
+
+  if (src_format == dst_format) {
+    memmove(dst, src, count * src_size);
+    return 0;
+  }
+  if (src_format == AUDIO_FORMAT_PCM_FLOAT)
+    return from_float(static_cast<const float*>(src), dst_format, dst, count);
+  if (dst_format == AUDIO_FORMAT_PCM_FLOAT)
+    return to_float(src, src_format, static_cast<float*>(dst), count);
+
+  float block[internal::block_samples];
+  auto in = static_cast<const uint8_t*>(src);
+  auto out = static_cast<uint8_t*>(dst);
+  for (size_t n = 0; n < count; n += internal::block_samples) {
+    const auto samples = std::min(internal::block_samples, count - n);
+    to_float(in, src_format, block, samples);
+    from_float(block, dst_format, out, samples);
+    in += samples * src_size;
+    out += samples * dst_size;
+  }
+  return 0;
+}
+
+/**
+ * @brief Scale \a count samples of \a format in place by \a gain, clipping the result.
+ *
+ * @return 0 on success or -EINVAL if \a format is not a known PCM format.
+ */
+inline int apply_gain(void* data, AnboxAudioFormat format, size_t count, float gain) {
+  const auto sample_size = bytes_per_sample(format);
+  if (sample_size == 0)
+    return -EINVAL;
+
+  const auto& k = kernels();
+  if (format == AUDIO_FORMAT_PCM_16_BIT) {
+    k.gain_s16(static_cast<int16_t*>(data), count, gain);
+    return 0;
+  }
+  if (format == AUDIO_FORMAT_PCM_FLOAT) {
+    k.gain_float(static_cast<float*>(data), count, gain);
+    return 0;
+  }
+
+  float block[internal::block_samples];
+  auto bytes = static_cast<uint8_t*>(data);
+  for (size_t n = 0; n < count; n += internal::block_samples) {
+    const auto samples = std::min(internal::block_samples, count - n);
+    to_float(bytes, format, block, samples);
+    k.gain_float(block, samples, gain);
+    from_float(block, format, bytes, samples);
+    bytes += samples * sample_size;
+  }
+  return 0;
+}
+
+namespace internal {
+// Mixes one frame of 3 to 8 channels down to stereo. The channels are in the
+// order of the Android output channel masks, centre and surround channels
+// are mixed in at -3 dB as in ITU-R BS.775 and the LFE channel is dropped.
+// The result is normalized, so it can't clip.
+inline void downmix_to_stereo(const float* in, uint8_t channels, float* out) {
+  constexpr float c = 0.70710678f;
+  static constexpr float weights[max_channels - 2][max_channels][2] = {
+    // FL FR FC
+    {{1.0f, 0.0f}, {0.0f, 1.0f}, {c, c}},
+    // FL FR BL BR
+    {{1.0f, 0.0f}, {0.0f, 1.0f}, {c, 0.0f}, {0.0f, c}},
+    // FL FR FC BL BR
+    {{1.0f, 0.0f}, {0.0f, 1.0f}, {c, c}, {c, 0.0f}, {0.0f, c}},
+    // FL FR FC LFE BL BR
+    {{1.0f, 0.0f}, {0.0f, 1.0f}, {c, c}, {0.0f, 0.0f}, {c, 0.0f}, {0.0f, c}},
+    // FL FR FC LFE BL BR BC
+    {{1.0f, 0.0f}, {0.0f, 1.0f}, {c, c}, {0.0f, 0.0f}, {c, 0.0f}, {0.0f, c}, {0.5f, 0.5f}},
+    // FL FR FC LFE BL BR SL SR
+    {{1.0f, 0.0f}, {0.0f, 1.0f}, {c, c}, {0.0f, 0.0f}, {c, 0.0f}, {0.0f, c}, {c, 0.0f}, {0.0f, c}},
+  };
+  const auto& layout = weights[channels - 3];
+  float left = 0.0f, right = 0.0f, total = 0.0f;
+  for (uint8_t ch = 0; ch < channels; ch++) {
+    left += layout[ch][0] * in[ch];
+    right += layout[ch][1] * in[ch];
+    total += layout[ch][0];
+  }
+  out[0] = left / total;
+  out[1] = right / total;
+}
+
+// Generic remixing of interleaved float frames for everything but mono <-> stereo
+inline void remix_float(const float* src, uint8_t src_channels, float* dst, uint8_t dst_channels,
+                        size_t frames) {
+  for (size_t n = 0; n < frames; n++) {
+    const auto in = src + n * src_channels;
+    const auto out = dst + n * dst_channels;
+    if (src_channels > 2 && dst_channels <= 2) {
+      float stereo[2];
+      downmix_to_stereo(in, src_channels, stereo);
+      if (dst_channels == 1) {
+        out[0] = 0.5f * (stereo[0] + stereo[1]);
+      } else {
+        out[0] = stereo[0];
+        out[1] = stereo[1];
+      }
+    } else if (dst_channels == 1) {
+      float sum = 0.0f;
+      for (uint8_t c = 0; c < src_channels; c++)
+        sum += in[c];
+      out[0] = sum / src_channels;
+    } else if (src_channels == 1) {
+      for (uint8_t c = 0; c < dst_channels; c++)
+        out[c] = in[0];
+    } else {
+      float frame[max_channels];
+      for (uint8_t c = 0; c < dst_channels; c++)
+        frame[c] = c < src_channels ? in[c] : 0.0f;
+      memcpy(out, frame, dst_channels * sizeof(float));
+    }
+  }
+}
+} // namespace internal
+
+/**
+ * @brief Change the number of channels of \a frames interleaved frames.
+ *
+ * Mono is duplicated into every output channel. More than two channels are
+ * mixed down to stereo with the centre and surround channels at -3 dB and
+ * without the LFE channel, mono averages both channels of that. Other
+ * layouts keep the channels they have in common and leave additional output
+ * channels silent. Up to 8 channels are supported, in the order of the
+ * Android output channel masks. Mixing down may happen in place, mixing up
+ * requires separate buffers.
+ *
+ * @return 0 on success or -EINVAL if \a format or the channel counts are not supported.
+ */
+inline int remix(const void* src, uint8_t src_channels, void* dst, uint8_t dst_channels,
+                 AnboxAudioFormat format, size_t frames) {
+  const auto sample_size = bytes_per_sample(format);
+  if (sample_size == 0 || src_channels == 0 || dst_channels == 0 ||
+      src_channels > internal::max_channels || dst_channels > internal::max_channels)
+    return -EINVAL;
+
+  if (src_channels == dst_channels) {
+    memmove(dst, src, frames * src_channels * sample_size);
+    return 0;
+  }
+
+  const auto& k = kernels();
+  if (format == AUDIO_FORMAT_PCM_16_BIT && src_channels == 1 && dst_channels == 2) {
+    k.mono_to_stereo_s16(static_cast<const int16_t*>(src), static_cast<int16_t*>(dst), frames);
+    return 0;
+  }
+  if (format == AUDIO_FORMAT_PCM_16_BIT && src_channels == 2 && dst_channels == 1) {
+    k.stereo_to_mono_s16(static_cast<const int16_t*>(src), static_cast<int16_t*>(dst), frames);
+    return 0;
+  }
+  if (format == AUDIO_FORMAT_PCM_FLOAT && src_channels == 1 && dst_channels == 2) {
+    k.mono_to_stereo_float(static_cast<const float*>(src), static_cast<float*>(dst), frames);
+    return 0;
+  }
+  if (format == AUDIO_FORMAT_PCM_FLOAT && src_channels == 2 && dst_channels == 1) {
+    k.stereo_to_mono_float(static_cast<const float*>(src), static_cast<float*>(dst), frames);
+    return 0;
+  }
+
+  constexpr size_t block_frames = internal::block_samples / internal::max_channels;
+  float in_block[internal::block_samples];
+  float out_block[internal::block_samples];
+  auto in = static_cast<const uint8_t*>(src);
+  auto out = static_cast<uint8_t*>(dst);
+  for (size_t n = 0; n < frames; n += block_frames) {
+    const auto count = std::min(block_frames, frames - n);
+    to_float(in, format, in_block, count * src_channels);
+    internal::remix_float(in_block, src_channels, out_block, dst_channels, count);
+    from_float(out_block, format, out, count * dst_channels);
+    in += count * src_channels * sample_size;
+    out += count * dst_channels * sample_size;
+  }
+  return 0;
+}
+} // namespace pcm
+} // namespace anbox
+
+#undef ANBOX_PCM_KERNELS
+
+#endif
@@ -67,6 +67,81 @@ class AudioProcessor {
       return -EIO;
     }
 
+    /**
+     * @brief Write multiple chunks of audio data
+     *
+     * This function allows writing audio data which is spread across several
+     * non-contiguous buffers in a single call, e.g. the output of multiple mixer
+     * buffers. The chunks are written in order as if they were one contiguous
+     * chunk of audio data. Plugins which queue audio data in a ring buffer or
+     * send it over a socket can override this to avoid coalescing the chunks first.
+     *
+     * The default implementation calls write_data for each chunk and stops at
+     * the first chunk which could not be written entirely.
+     *
+     * @param iov Array of audio data chunks that are passed from the anbox container.
+     * @param count the number of chunks in \a iov.
+     * @return The number of bytes actually written on success, otherwise returns a negative value on error
+     */
+    virtual ssize_t write_datav(const AnboxIoVec* iov, size_t count) {
+      if (!iov || count == 0)
+        return -EIO;
+
+      ssize_t total = 0;
+      for (size_t n = 0; n < count; n++) {
+        if (iov[n].size == 0)
+          continue;
+        const auto written = write_data(iov[n].data, iov[n].size);
+        if (written < 0)
+          return total > 0 ? total : written;
+        total += written;
+        if (static_cast<size_t>(written) < iov[n].size)
+          break;
+      }
+      return total;
+    }
+
+    /**
+     * @brief Write a chunk of audio data together with its presentation time
+     *
+     * This function works like write_data but additionally passes the time
+     * at which the first sample of \a data is meant to be presented, taken
+     * from CLOCK_MONOTONIC. Plugins which stream audio can use it to keep
+     * audio and video in sync or to compensate for clock drift instead of
+     * deriving timestamps from the number of samples written.
+     *
+     * The default implementation drops the timestamp and calls write_data.
+     *
+     * @param data Pointer to the chunk of audio data that is passed from the anbox container.
+     * @param size the number of bytes to be written.
+     * @param timestamp_ns presentation time of the first sample in nanoseconds.
+     * @return The number of bytes actually written on success, otherwise returns a negative value on error
+     */
+    virtual ssize_t write_data_timestamped(const uint8_t* data, size_t size, uint64_t timestamp_ns) {
+      (void) timestamp_ns;
+      return write_data(data, size);
+    }
+
+    /**
+     * @brief Query how much audio data the platform has presented so far
+     *
+     * Reports the number of audio frames (samples per channel) of the output
+     * stream which have been presented, e.g. played out or sent to a client,
+     * and the CLOCK_MONOTONIC time at which the last of them was presented.
+     * Comparing this to the amount of audio data written lets Anbox measure
+     * the latency of the platform and size its buffering accordingly.
+     *
+     * @param frames the number of audio frames presented since the output stream was started.
+     * @param time_ns the time in nanoseconds at which \a frames was reached.
+     * @return 0 on success, otherwise returns a negative value on error or if the
+     * platform doesn't track the presentation position.
+     */
+    virtual int get_presentation_position(uint64_t* frames, uint64_t* time_ns) {
+      (void) frames;
+      (void) time_ns;
+      return -EIO;
+    }
+
     /**
      * @brief Read a chunk of audio data
      *
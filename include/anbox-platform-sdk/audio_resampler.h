@@ -0,0 +1,297 @@
+/*
+ * This file is part of Anbox Platform SDK
+ *
+ * Copyright 2021 Canonical Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANBOX_SDK_AUDIO_RESAMPLER_H_
+#define ANBOX_SDK_AUDIO_RESAMPLER_H_
+
+#include "anbox-platform-sdk/audio_pcm.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace anbox {
+/**
+ * @brief Trade-off between CPU usage and quality of an AudioResampler.
+ */
+enum class AudioResamplerQuality {
+  /** 8 taps per phase, suitable for voice. */
+  Low,
+  /** 16 taps per phase. */
+  Medium,
+  /** 32 taps per phase, transparent for music. */
+  High,
+};
+
+/**
+ * @brief AudioResampler converts an interleaved audio stream from one sample
+ * rate to another.
+ *
+ * It implements a polyphase FIR filter for the rational ratio between both
+ * rates with a Kaiser windowed sinc prototype. The stream can be passed in
+ * chunks of any size, e.g. straight from AudioProcessor::write_data, and the
+ * filter state is kept in between. All buffers are allocated by create(), so
+ * processing never allocates memory. The inner loop runs on the best
+ * anbox::pcm::Kernels::dot_float for the CPU.
+ *
+ * Resampling changes the number of frames, so the output is written to a
+ * separate buffer which must hold at least max_output_frames() frames.
+ */
+class AudioResampler {
+ public:
+  /**
+   * @brief Create a new resampler.
+   *
+   * @param in_rate the sample rate of the input stream in Hz.
+   * @param out_rate the sample rate of the output stream in Hz.
+   * @param channels the number of interleaved channels, at most 8.
+   * @param quality the quality of the filter.
+   * @return the new resampler or nullptr with errno set to EINVAL if the
+   * parameters are not supported.
+   */
+  static std::unique_ptr<AudioResampler> create(uint32_t in_rate, uint32_t out_rate, uint8_t channels,
+                                                AudioResamplerQuality quality = AudioResamplerQuality::Medium) {
+    if (in_rate == 0 || out_rate == 0 || channels == 0 || channels > pcm::internal::max_channels) {
+      errno = EINVAL;
+      return nullptr;
+    }
+
+    const auto divisor = gcd(in_rate, out_rate);
+    const auto phases = out_rate / divisor;
+    if (phases > max_phases) {
+      errno = EINVAL;
+      return nullptr;
+    }
+    return std::unique_ptr<AudioResampler>(
+        new AudioResampler(in_rate / divisor, phases, channels, quality));
+  }
+
+  ~AudioResampler() = default;
+  AudioResampler(const AudioResampler &) = delete;
+  AudioResampler& operator=(const AudioResampler &) = delete;
+
+  /**
+   * @brief Resample a chunk of float samples.
+   *
+   * @param in the interleaved input frames.
+   * @param in_frames the number of frames in \a in.
+   * @param out receives the interleaved output frames.
+   * @param out_frames the number of frames \a out can hold, must be at least
+   * max_output_frames(\a in_frames).
+   * @return the number of frames written to \a out or -ENOSPC if \a out is too small.
+   */
+  ssize_t process(const float* in, size_t in_frames, float* out, size_t out_frames) {
+    if (out_frames < max_output_frames(in_frames))
+      return -ENOSPC;
+
+    size_t produced = 0;
+    do {
+      produced += filter(out + produced * channels_);
+      const auto count = std::min(in_frames, capacity_ - fill_);
+      for (size_t n = 0; n < count; n++) {
+        for (uint8_t c = 0; c < channels_; c++)
+          history_[c * capacity_ + fill_ + n] = in[n * channels_ + c];
+      }
+      fill_ += count;
+      in += count * channels_;
+      in_frames -= count;
+    } while (in_frames > 0);
+    produced += filter(out + produced * channels_);
+    return static_cast<ssize_t>(produced);
+  }
+
+  /**
+   * @brief Resample a chunk of 16 bit samples.
+   *
+   * Works like process() but converts from and to 16 bit samples on the fly.
+   */
+  ssize_t process_s16(const int16_t* in, size_t in_frames, int16_t* out, size_t out_frames) {
+    if (out_frames < max_output_frames(in_frames))
+      return -ENOSPC;
+
+    const auto& k = pcm::kernels();
+    size_t produced = 0;
+    while (in_frames > 0) {
+      const auto count = std::min(in_frames, block_frames);
+      k.s16_to_float(in, scratch_in_.data(), count * channels_);
+      const auto ret = process(scratch_in_.data(), count, scratch_out_.data(), scratch_out_frames_);
+      if (ret < 0)
+        return ret;
+      k.float_to_s16(scratch_out_.data(), out + produced * channels_, ret * channels_);
+      produced += ret;
+      in += count * channels_;
+      in_frames -= count;
+    }
+    return static_cast<ssize_t>(produced);
+  }
+
+  /**
+   * @brief Upper bound of the number of frames process() writes for \a in_frames input frames.
+   */
+  size_t max_output_frames(size_t in_frames) const {
+    return ((in_frames + taps_) * phases_ + step_ - 1) / step_ + 1;
+  }
+
+  /**
+   * @brief Number of input frames the filter holds back until enough
+   * following frames arrived to compute the output for them.
+   */
+  size_t latency_frames() const { return taps_ / 2; }
+
+  /**
+   * @brief Drop all buffered audio data, e.g. when the stream went into standby.
+   */
+  void reset() {
+    std::fill(history_.begin(), history_.end(), 0.0f);
+    fill_ = taps_ / 2 - 1;
+    index_ = 0;
+    phase_ = 0;
+  }
+
+ private:
+  static constexpr uint32_t max_phases = 1024;
+  static constexpr size_t block_frames = 256;
+
+  static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+      const auto t = a % b;
+      a = b;
+      b = t;
+    }
+    return a;
+  }
+
+  // Zeroth order modified Bessel function of the first kind for the Kaiser window
+  static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+      term *= (x / (2.0 * k)) * (x / (2.0 * k));
+      sum += term;
+    }
+    return sum;
+  }
+
+  AudioResampler(uint32_t step, uint32_t phases, uint8_t channels, AudioResamplerQuality quality) :
+    step_{step}, phases_{phases}, channels_{channels} {
+    double beta = 0.0, rolloff = 0.0;
+    switch (quality) {
+    case AudioResamplerQuality::Low:
+      taps_ = 8;
+      beta = 5.0;
+      rolloff = 0.85;
+      break;
+    case AudioResamplerQuality::Medium:
+      taps_ = 16;
+      beta = 7.0;
+      rolloff = 0.9;
+      break;
+    case AudioResamplerQuality::High:
+    default:
+      taps_ = 32;
+      beta = 9.0;
+      rolloff = 0.95;
+      break;
+    }
+
+    // Each phase holds the taps for one fractional position between two
+    // input frames. When reducing the rate, the cutoff has to move down to
+    // the new Nyquist frequency.
+    const double cutoff = rolloff * std::min(1.0, static_cast<double>(phases_) / step_);
+    const double half = taps_ / 2.0;
+    coeffs_.resize(phases_ * taps_);
+    for (uint32_t p = 0; p < phases_; p++) {
+      const double frac = static_cast<double>(p) / phases_;
+      double sum = 0.0;
+      for (size_t j = 0; j < taps_; j++) {
+        const double d = static_cast<double>(j) - (half - 1.0) - frac;
+        const double x = M_PI * cutoff * d;
+        const double sinc = d == 0.0 ? 1.0 : sin(x) / x;
+        const double w = d / half;
+        const double window = fabs(w) >= 1.0 ? 0.0 : bessel_i0(beta * sqrt(1.0 - w * w)) / bessel_i0(beta);
+        coeffs_[p * taps_ + j] = static_cast<float>(sinc * window);
+        sum += sinc * window;
+      }
+      // Unity gain at DC for every phase
+      for (size_t j = 0; j < taps_; j++)
+        coeffs_[p * taps_ + j] = static_cast<float>(coeffs_[p * taps_ + j] / sum);
+    }
+
+    capacity_ = taps_ + block_frames;
+    history_.resize(capacity_ * channels_);
+    scratch_in_.resize(block_frames * channels_);
+    scratch_out_frames_ = max_output_frames(block_frames);
+    scratch_out_.resize(scratch_out_frames_ * channels_);
+    reset();
+  }
+
+  // Produce every output frame the buffered input allows and drop the input
+  // frames which are not needed anymore.
+  size_t filter(float* out) {
+    const auto dot = pcm::kernels().dot_float;
+    size_t produced = 0;
+    while (index_ + taps_ <= fill_) {
+      const auto coeffs = coeffs_.data() + phase_ * taps_;
+      for (uint8_t c = 0; c < channels_; c++)
+        out[produced * channels_ + c] = dot(history_.data() + c * capacity_ + index_, coeffs, taps_);
+      produced++;
+
+      phase_ += step_;
+      index_ += phase_ / phases_;
+      phase_ %= phases_;
+    }
+
+    const auto drop = std::min(index_, fill_);
+    if (drop > 0) {
+      for (uint8_t c = 0; c < channels_; c++) {
+        auto channel = history_.data() + c * capacity_;
+        memmove(channel, channel + drop, (fill_ - drop) * sizeof(float));
+      }
+      fill_ -= drop;
+      index_ -= drop;
+    }
+    return produced;
+  }
+
+  // Input frames consumed per output frame is step_ / phases_
+  const uint32_t step_;
+  const uint32_t phases_;
+  const uint8_t channels_;
+  size_t taps_{0};
+  std::vector<float> coeffs_;
+
+  // Planar history of the input so the filter runs on contiguous memory
+  size_t capacity_{0};
+  std::vector<float> history_;
+  size_t fill_{0};
+  size_t index_{0};
+  uint32_t phase_{0};
+
+  std::vector<float> scratch_in_;
+  std::vector<float> scratch_out_;
+  size_t scratch_out_frames_{0};
+};
+} // namespace anbox
+
+#endif
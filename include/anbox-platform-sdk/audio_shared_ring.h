@@ -0,0 +1,369 @@
+/*
+ * This file is part of Anbox Platform SDK
+ *
+ * Copyright 2021 Canonical Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANBOX_SDK_AUDIO_SHARED_RING_H_
+#define ANBOX_SDK_AUDIO_SHARED_RING_H_
+
+#include "anbox-platform-sdk/types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace anbox {
+/**
+ * @brief AudioSharedRing is a single producer / single consumer audio ring
+ * living in shared memory, as described by AnboxAudioSharedRingHeader.
+ *
+ * The platform creates the ring with create() and hands out descriptor()
+ * through the AUDIO_SHARED_RING configuration item. The other side maps it
+ * with attach(). Audio data is then exchanged with a single copy into and a
+ * single copy out of the shared memory.
+ *
+ * The cursors are written by the peer, so they are not trusted: if they claim
+ * more than capacity() bytes are queued, the ring is treated as corrupted and
+ * neither write() nor read() touches the audio data anymore.
+ *
+ * The eventfd works as doorbell like in BlockingQueue: the producer only
+ * signals it when the ring goes from empty to non-empty or when the queued
+ * audio data reaches one period. The consumer sleeps in poll(2) while
+ * waiting for data.
+ */
+class AudioSharedRing {
+ public:
+  /**
+   * @brief Create a new ring backed by a memfd.
+   *
+   * @param capacity size of the audio data in bytes, must be a power of two.
+   * @param period_bytes the number of bytes in one period of audio data.
+   * @return the new ring or nullptr with errno set on failure.
+   */
+  static std::unique_ptr<AudioSharedRing> create(uint32_t capacity, uint32_t period_bytes) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+      errno = EINVAL;
+      return nullptr;
+    }
+
+    const size_t size = sizeof(AnboxAudioSharedRingHeader) + capacity;
+    const int memfd = ::memfd_create("anbox-audio-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0)
+      return nullptr;
+
+    if (::ftruncate(memfd, size) < 0) {
+      close_preserving_errno(memfd);
+      return nullptr;
+    }
+    // The peer relies on the size, so it must never change
+    ::fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    const int eventfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventfd < 0) {
+      close_preserving_errno(memfd);
+      return nullptr;
+    }
+
+    auto ring = map(memfd, eventfd, size);
+    if (!ring)
+      return nullptr;
+
+    auto header = ring->header_;
+    header->magic = ANBOX_AUDIO_SHARED_RING_MAGIC;
+    header->version = ANBOX_AUDIO_SHARED_RING_VERSION;
+    header->capacity = capacity;
+    header->period_bytes = period_bytes;
+    ring->capacity_ = capacity;
+    return ring;
+  }
+
+  /**
+   * @brief Map a ring created by the other side.
+   *
+   * The file descriptors of \a desc are duplicated, so the caller keeps
+   * ownership of them.
+   *
+   * @param desc the descriptor of the ring.
+   * @return the mapped ring or nullptr with errno set on failure.
+   */
+  static std::unique_ptr<AudioSharedRing> attach(const AnboxAudioSharedRing& desc) {
+    struct stat st;
+    if (desc.size < sizeof(AnboxAudioSharedRingHeader) || ::fstat(desc.memfd, &st) < 0 ||
+        static_cast<size_t>(st.st_size) < desc.size) {
+      errno = EINVAL;
+      return nullptr;
+    }
+
+    const int memfd = ::fcntl(desc.memfd, F_DUPFD_CLOEXEC, 0);
+    if (memfd < 0)
+      return nullptr;
+    const int eventfd = ::fcntl(desc.eventfd, F_DUPFD_CLOEXEC, 0);
+    if (eventfd < 0) {
+      close_preserving_errno(memfd);
+      return nullptr;
+    }
+
+    auto ring = map(memfd, eventfd, desc.size);
+    if (!ring)
+      return nullptr;
+
+    const auto header = ring->header_;
+    const uint32_t capacity = header->capacity;
+    if (header->magic != ANBOX_AUDIO_SHARED_RING_MAGIC ||
+        header->version != ANBOX_AUDIO_SHARED_RING_VERSION ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        sizeof(AnboxAudioSharedRingHeader) + capacity > desc.size) {
+      errno = EPROTO;
+      return nullptr;
+    }
+    ring->capacity_ = capacity;
+    return ring;
+  }
+
+  ~AudioSharedRing() {
+    ::munmap(header_, size_);
+    ::close(memfd_);
+    ::close(eventfd_);
+  }
+  AudioSharedRing(const AudioSharedRing &) = delete;
+  AudioSharedRing& operator=(const AudioSharedRing &) = delete;
+
+  /**
+   * @brief Append up to \a size bytes. Must only be called by the producer.
+   *
+   * @return the number of bytes actually appended, 0 if the ring is full or corrupted.
+   */
+  size_t write(const uint8_t* data, size_t size) {
+    const auto tail = __atomic_load_n(&header_->write_cursor, __ATOMIC_RELAXED);
+    const auto head = __atomic_load_n(&header_->read_cursor, __ATOMIC_ACQUIRE);
+    const auto queued = tail - head;
+    if (queued > capacity_)
+      return 0;
+
+    const auto count = std::min<uint64_t>(size, capacity_ - queued);
+    if (count == 0)
+      return 0;
+
+    const auto offset = tail & (capacity_ - 1);
+    const auto first = std::min<uint64_t>(count, capacity_ - offset);
+    memcpy(data_ + offset, data, first);
+    memcpy(data_, data + first, count - first);
+    __atomic_store_n(&header_->write_cursor, tail + count, __ATOMIC_RELEASE);
+
+    // Pairs with the fence in wait(), see BlockingQueue::push()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto now_queued = this->size();
+    const auto period = period_bytes();
+    if (now_queued == count || (now_queued >= period && now_queued - count < period))
+      notify();
+    return count;
+  }
+
+  /**
+   * @brief Remove up to \a size bytes. Must only be called by the consumer.
+   *
+   * @return the number of bytes actually removed, 0 if the ring is empty or corrupted.
+   */
+  size_t read(uint8_t* data, size_t size) {
+    const auto head = __atomic_load_n(&header_->read_cursor, __ATOMIC_RELAXED);
+    const auto tail = __atomic_load_n(&header_->write_cursor, __ATOMIC_ACQUIRE);
+    const auto queued = tail - head;
+    if (queued > capacity_)
+      return 0;
+
+    const auto count = std::min<uint64_t>(size, queued);
+    if (count == 0)
+      return 0;
+
+    const auto offset = head & (capacity_ - 1);
+    const auto first = std::min<uint64_t>(count, capacity_ - offset);
+    memcpy(data, data_ + offset, first);
+    memcpy(data + first, data_, count - first);
+    __atomic_store_n(&header_->read_cursor, head + count, __ATOMIC_RELEASE);
+    return count;
+  }
+
+  /**
+   * @brief Wait until at least \a min_size bytes are queued. Must only be
+   * called by the consumer.
+   *
+   * The producer only signals the consumer for the first byte and when the
+   * queued data reaches one period, so waiting for more than one period is
+   * not supported and \a min_size is capped to period_bytes().
+   *
+   * @param min_size the number of bytes to wait for.
+   * @param timeout the maximum time in milliseconds to wait. A timeout of 0
+   * returns immediately, a negative value waits forever.
+   * @return true if at least \a min_size bytes are queued, false on timeout
+   * or when interrupt() was called.
+   */
+  bool wait(size_t min_size, int timeout) {
+    min_size = std::max<size_t>(1, std::min<size_t>(min_size, period_bytes()));
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    for (;;) {
+      if (size() >= min_size)
+        return true;
+
+      // Reset the doorbell before re-checking so a racing write is not lost
+      clear();
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (size() >= min_size)
+        return true;
+
+      if (timeout == 0 || interrupted_.exchange(false))
+        return false;
+
+      int wait_ms = -1;
+      if (timeout > 0) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+          return false;
+        wait_ms = static_cast<int>(remaining);
+      }
+
+      struct pollfd pfd{eventfd_, POLLIN, 0};
+      if (::poll(&pfd, 1, wait_ms) < 0 && errno != EINTR)
+        return false;
+    }
+  }
+
+  /**
+   * @brief Signal the consumer, e.g. to make it re-check a stop condition.
+   */
+  void notify() {
+    const uint64_t value = 1;
+    ssize_t ret;
+    do {
+      ret = ::write(eventfd_, &value, sizeof(value));
+    } while (ret < 0 && errno == EINTR);
+  }
+
+  /**
+   * @brief Make the consumer return from wait() even if the data it waits
+   * for is not there, e.g. to stop it or to park it while the stream is in
+   * standby. A consumer which is not waiting right now returns from its next
+   * wait().
+   */
+  void interrupt() {
+    interrupted_.store(true);
+    notify();
+  }
+
+  /**
+   * @brief Number of bytes currently queued, 0 if the ring is corrupted.
+   */
+  size_t size() const {
+    const auto head = __atomic_load_n(&header_->read_cursor, __ATOMIC_ACQUIRE);
+    const auto tail = __atomic_load_n(&header_->write_cursor, __ATOMIC_ACQUIRE);
+    const auto queued = tail - head;
+    return queued > capacity_ ? 0 : queued;
+  }
+
+  /**
+   * @brief Whether the peer moved the cursors more than capacity() bytes apart.
+   */
+  bool corrupted() const {
+    const auto head = __atomic_load_n(&header_->read_cursor, __ATOMIC_ACQUIRE);
+    const auto tail = __atomic_load_n(&header_->write_cursor, __ATOMIC_ACQUIRE);
+    return tail - head > capacity_;
+  }
+
+  /**
+   * @brief Size of the audio data in bytes.
+   */
+  size_t capacity() const { return capacity_; }
+
+  /**
+   * @brief The number of bytes in one period of audio data.
+   */
+  uint32_t period_bytes() const { return __atomic_load_n(&header_->period_bytes, __ATOMIC_RELAXED); }
+
+  /**
+   * @brief Change the number of bytes in one period, e.g. when the consumer
+   * switched to a codec with a different frame size.
+   */
+  void set_period_bytes(uint32_t period_bytes) {
+    __atomic_store_n(&header_->period_bytes, period_bytes, __ATOMIC_RELAXED);
+    // Let a consumer waiting for the old period re-check
+    notify();
+  }
+
+  /**
+   * @brief The eventfd signalled when the ring turns non-empty.
+   */
+  int event_fd() const { return eventfd_; }
+
+  /**
+   * @brief Descriptor of the ring to hand out to the other side. The file
+   * descriptors remain owned by the ring.
+   */
+  AnboxAudioSharedRing descriptor() const {
+    return AnboxAudioSharedRing{memfd_, eventfd_, size_};
+  }
+
+ private:
+  AudioSharedRing(int memfd, int eventfd, void* memory, size_t size) :
+    memfd_{memfd}, eventfd_{eventfd}, size_{size},
+    header_{static_cast<AnboxAudioSharedRingHeader*>(memory)},
+    data_{static_cast<uint8_t*>(memory) + sizeof(AnboxAudioSharedRingHeader)} {}
+
+  static std::unique_ptr<AudioSharedRing> map(int memfd, int eventfd, size_t size) {
+    void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (memory == MAP_FAILED) {
+      close_preserving_errno(memfd);
+      close_preserving_errno(eventfd);
+      return nullptr;
+    }
+    return std::unique_ptr<AudioSharedRing>(new AudioSharedRing(memfd, eventfd, memory, size));
+  }
+
+  static void close_preserving_errno(int fd) {
+    const int err = errno;
+    ::close(fd);
+    errno = err;
+  }
+
+  void clear() {
+    uint64_t value;
+    ssize_t ret;
+    do {
+      ret = ::read(eventfd_, &value, sizeof(value));
+    } while (ret < 0 && errno == EINTR);
+  }
+
+  const int memfd_;
+  const int eventfd_;
+  const size_t size_;
+  AnboxAudioSharedRingHeader* const header_;
+  uint8_t* const data_;
+  uint32_t capacity_{0};
+  std::atomic_bool interrupted_{false};
+};
+} // namespace anbox
+
+#endif
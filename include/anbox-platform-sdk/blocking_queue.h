@@ -0,0 +1,197 @@
+/*
+ * This file is part of Anbox Platform SDK
+ *
+ * Copyright 2021 Canonical Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANBOX_SDK_BLOCKING_QUEUE_H_
+#define ANBOX_SDK_BLOCKING_QUEUE_H_
+
+#include "anbox-platform-sdk/spsc_ring.h"
+
+#include <atomic>
+#include <chrono>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace anbox {
+/**
+ * @brief BlockingQueue is a fixed capacity single producer / single consumer
+ * queue whose consumer can wait for new elements with a timeout.
+ *
+ * Elements are stored in a SpscRing, so queuing and dequeuing never takes a
+ * lock or allocates memory. An eventfd is used as doorbell: the producer only
+ * rings it when the queue goes from empty to non-empty and a blocked consumer
+ * sleeps in poll(2), so waiting for data does not consume any CPU time.
+ *
+ * The eventfd is readable whenever elements are queued. It may occasionally
+ * be readable while the queue is empty, but never the other way around.
+ *
+ * @tparam T type of the queued elements.
+ * @tparam N capacity of the queue, must be a power of two.
+ * @tparam Policy behavior of push() when the queue is full.
+ */
+template <typename T, size_t N, SpscRingPolicy Policy = SpscRingPolicy::Reject>
+class BlockingQueue {
+ public:
+  BlockingQueue() : fd_{create_eventfd()} {}
+  ~BlockingQueue() {
+    if (fd_ >= 0)
+      ::close(fd_);
+  }
+  BlockingQueue(const BlockingQueue &) = delete;
+  BlockingQueue& operator=(const BlockingQueue &) = delete;
+
+  /**
+   * @brief Queue a new element and wake up the consumer if it is waiting.
+   * Must only be called from the producer thread.
+   *
+   * @param item the element to queue.
+   * @return true if the element was queued, false if the queue is full and
+   * the policy is SpscRingPolicy::Reject.
+   */
+  bool push(const T& item) {
+    if (!ring_.push(item))
+      return false;
+
+    // Pairs with the fence in pop(): either the consumer sees the new element
+    // when re-checking the ring or we see that it drained the ring and ring
+    // the doorbell.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring_.size() == 1)
+      notify();
+    return true;
+  }
+
+  /**
+   * @brief Dequeue the oldest element, waiting for one to be queued if
+   * necessary. Must only be called from the consumer thread.
+   *
+   * @param item receives the dequeued element.
+   * @param timeout the maximum time in milliseconds to wait for an element.
+   * A timeout of 0 returns immediately, a negative value waits forever.
+   * @return true if an element was dequeued, false if the queue was still
+   * empty when the timeout expired.
+   */
+  bool pop(T& item, int timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    for (;;) {
+      if (ring_.pop(item))
+        return true;
+
+      // The queue is empty, reset the doorbell before re-checking the ring so
+      // a push racing with us is not lost.
+      clear();
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (ring_.pop(item)) {
+        // The doorbell is cleared now, so a push landing after our pop must
+        // either see the ring drained or be seen by the check below.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ring_.empty())
+          notify();
+        return true;
+      }
+
+      if (timeout == 0 || fd_ < 0)
+        return false;
+
+      int wait_ms = -1;
+      if (timeout > 0) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+          return false;
+        wait_ms = static_cast<int>(remaining);
+      }
+
+      struct pollfd pfd{fd_, POLLIN, 0};
+      if (::poll(&pfd, 1, wait_ms) < 0 && errno != EINTR)
+        return false;
+    }
+  }
+
+  /**
+   * @brief Dequeue the oldest element without waiting.
+   *
+   * @param item receives the dequeued element.
+   * @return true if an element was dequeued, false if the queue is empty.
+   */
+  bool try_pop(T& item) { return pop(item, 0); }
+
+  /**
+   * @brief The eventfd used to signal the consumer or a negative error code if
+   * it could not be created, in which case pop() never blocks.
+   *
+   * The eventfd is readable whenever elements are queued and can be handed out
+   * as is to poll/epoll users. It remains owned by the queue.
+   */
+  int fd() const { return fd_; }
+
+  /**
+   * @brief Number of elements currently queued.
+   */
+  size_t size() const { return ring_.size(); }
+
+  /**
+   * @brief Check if the queue has no element queued.
+   */
+  bool empty() const { return ring_.empty(); }
+
+  /**
+   * @brief Number of elements dropped by the SpscRingPolicy::OverwriteOldest policy.
+   */
+  size_t dropped() const { return ring_.dropped(); }
+
+  /**
+   * @brief Maximum number of elements the queue can hold.
+   */
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  static int create_eventfd() {
+    const int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return fd < 0 ? -errno : fd;
+  }
+
+  void notify() {
+    if (fd_ < 0)
+      return;
+    const uint64_t value = 1;
+    ssize_t ret;
+    do {
+      ret = ::write(fd_, &value, sizeof(value));
+    } while (ret < 0 && errno == EINTR);
+  }
+
+  void clear() {
+    if (fd_ < 0)
+      return;
+    uint64_t value;
+    ssize_t ret;
+    do {
+      ret = ::read(fd_, &value, sizeof(value));
+    } while (ret < 0 && errno == EINTR);
+  }
+
+  const int fd_;
+  SpscRing<T, N, Policy> ring_;
+};
+} // namespace anbox
+
+#endif
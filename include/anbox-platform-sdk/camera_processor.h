@@ -24,6 +24,8 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace anbox {
 /**
@@ -64,6 +66,45 @@ class CameraProcessor {
       return -EINVAL;
     }
 
+    /**
+     * @brief Open the camera device with a specific frame delivery.
+     *
+     * In CAMERA_DELIVERY_MODE_MAILBOX at most \a options->max_frames frames are
+     * kept. Once a new frame arrives while that many are waiting to be read, the
+     * oldest one is dropped and its video buffer released, so a consumer falling
+     * behind always gets the most recent frames. The delivery mode stays in
+     * effect until the device is closed.
+     *
+     * The default implementation supports CAMERA_DELIVERY_MODE_QUEUE only.
+     *
+     * @param spec the camera spec to open the device with, see open_device().
+     * @param orientation the current camera orientation in Android container.
+     * @param options the frame delivery to use or null for CAMERA_DELIVERY_MODE_QUEUE.
+     * @return 0 on success, otherwise returns EINVAL if the delivery mode is
+     * not supported or on any other error.
+     **/
+    virtual int open_device_with_options(AnboxCameraSpec spec, AnboxCameraOrientation orientation,
+                                         const AnboxCameraDeliveryOptions* options) {
+      if (options && options->mode != CAMERA_DELIVERY_MODE_QUEUE)
+        return -EINVAL;
+      return open_device(spec, orientation);
+    }
+
+    /**
+     * @brief Get the number of video frames dropped since the processor was created.
+     *
+     * Frames count as dropped when the mailbox delivery replaced them or when a
+     * full queue rejected them.
+     *
+     * @param count receives the number of dropped frames.
+     * @return 0 on success, otherwise returns EINVAL if the processor doesn't
+     * count dropped frames.
+     **/
+    virtual int get_dropped_frames(uint64_t* count) {
+      (void)count;
+      return -EINVAL;
+    }
+
     /**
      * @brief Close the camera device for not receiving video frames from the platform further
      * @return 0 on success, otherwise returns EINVAL on error occurs.
@@ -110,6 +151,129 @@ class CameraProcessor {
       (void) frame;
       return -EIO;
     }
+
+    /**
+     * @brief Read next available video frame together with the callback releasing it.
+     *
+     * Works like read_frame() but the video buffer stays owned by the processor,
+     * which allows it to recycle the buffer, e.g. through a VideoFramePool, instead
+     * of allocating a new one for every frame. Once Anbox doesn't use the frame
+     * anymore it calls \a release.
+     *
+     * The default implementation calls read_frame() and sets \a release to free
+     * the video buffer.
+     *
+     * @param frame Pointer to the available video frame to be sent to the anbox container.
+     * @param release receives the callback to call once the frame is not used anymore.
+     * @param timeout maximum number of milliseconds to wait for the next available frame,
+     * see read_frame().
+     * @return 0 on success, -EINVAL if \a release is null or -EIO if no video frame is available.
+     */
+    virtual int read_frame_with_release(AnboxVideoFrame* frame, AnboxCallback* release, int timeout) {
+      if (!release)
+        return -EINVAL;
+
+      const auto ret = read_frame(frame, timeout);
+      if (ret == 0)
+        *release = AnboxCallback{&::free, frame->data};
+      return ret;
+    }
+
+    /**
+     * @brief Inject a video frame together with the callback releasing it.
+     *
+     * Works like inject_frame() but the video buffer stays owned by the caller.
+     * On success the processor calls \a release once it doesn't use the frame
+     * anymore, which may happen on any thread. On failure the caller keeps
+     * the frame.
+     *
+     * The default implementation hands a copy of the frame to inject_frame()
+     * and releases the frame right away.
+     *
+     * @param frame a video frame to be pushed into the internal queue.
+     * @param release the callback releasing the frame.
+     * @return 0 on success, -EINVAL if \a release is null or another negative
+     * error code if the frame could not be queued.
+     * @note This function is only used in our test suite to facilitate our automation
+     *       tests and it is subject to change at any time.
+     **/
+    virtual int inject_frame_with_release(AnboxVideoFrame frame, AnboxCallback* release) {
+      if (!release)
+        return -EINVAL;
+
+      AnboxVideoFrame copy{nullptr, frame.size};
+      if (frame.data && frame.size > 0) {
+        copy.data = static_cast<uint8_t*>(malloc(frame.size));
+        if (!copy.data)
+          return -ENOMEM;
+        memcpy(copy.data, frame.data, frame.size);
+      }
+
+      const auto ret = inject_frame(copy);
+      if (ret < 0) {
+        free(copy.data);
+        return ret;
+      }
+      if (release->callback)
+        release->callback(release->user_data);
+      return 0;
+    }
+
+    /**
+     * @brief Read next available video frame as file descriptor.
+     *
+     * Works like read_frame_with_release() but the frame is stored in a memfd or
+     * dma-buf, so Anbox can pass it on without copying or even mapping it. The
+     * processor keeps owning the file descriptor until Anbox calls the release
+     * callback of the frame.
+     *
+     * The timestamp and sequence number of the frame allow Anbox to drop stale
+     * frames, to measure the capture latency and to detect skipped frames.
+     *
+     * @param frame receives the available video frame.
+     * @param timeout maximum number of milliseconds to wait for the next available frame,
+     * see read_frame().
+     * @return 0 on success, -EINVAL if \a frame is null or -EIO if no video frame is
+     * available or the processor does not support frames stored in a file descriptor.
+     */
+    virtual int read_frame2(AnboxVideoFrame2* frame, int timeout) {
+      (void) frame;
+      (void) timeout;
+      return -EIO;
+    }
+
+    /**
+     * @brief Inject a video frame stored in a memfd or dma-buf into AnboxPlatform.
+     *
+     * On success the processor calls the release callback of \a frame once it
+     * doesn't use the frame anymore, which may happen on any thread. Until then
+     * the file descriptor must stay open. On failure the caller keeps the frame.
+     *
+     * @param frame a video frame to be pushed into the internal queue.
+     * @return 0 on success, -EINVAL if \a frame is null or another negative error code
+     * if the frame could not be queued, e.g. -EIO if the processor does not support
+     * frames stored in a file descriptor.
+     * @note This function is only used in our test suite to facilitate our automation
+     *       tests and it is subject to change at any time.
+     **/
+    virtual int inject_frame2(const AnboxVideoFrame2* frame) {
+      (void) frame;
+      return -EIO;
+    }
+
+    /**
+     * @brief Provide a file descriptor which is readable while a video frame is ready.
+     *
+     * It lets Anbox wait for frames of all cameras in one poll loop and pick
+     * them up with read_frame() or read_frame2() without blocking. The
+     * descriptor is owned by the processor and must stay open while the
+     * processor exists.
+     *
+     * @return a file descriptor or a negative error code if the processor can't be polled.
+     */
+    virtual int event_fd() const {
+      return -EIO;
+    }
 };
 } // namespace anbox
 
@@ -21,6 +21,7 @@
 
 #include "anbox-platform-sdk/types.h"
 
+#include <errno.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <cstdint>
@@ -74,6 +75,19 @@ class GpsProcessor {
      *       tests and it is subject to change at any time.
      **/
     virtual int inject_data(AnboxGpsData data) = 0;
+
+    /**
+     * @brief Provide a file descriptor which becomes readable when new gps data arrives.
+     *
+     * Location updates are rare, so rather than waiting in read_data() Anbox
+     * polls this descriptor and reads the data with a timeout of 0. The
+     * processor keeps ownership of the descriptor.
+     *
+     * @return a file descriptor or a negative error code if the processor can't be polled.
+     */
+    virtual int event_fd() const {
+      return -EIO;
+    }
 };
 } // namespace anbox
 
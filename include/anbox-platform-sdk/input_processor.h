@@ -21,6 +21,9 @@
 
 #include "anbox-platform-sdk/types.h"
 
+#include <stddef.h>
+#include <errno.h>
+
 namespace anbox {
 /**
  * @brief InputProcessor allows a plugin to propagate input events to Anbox which
@@ -66,6 +69,79 @@ class InputProcessor {
      *       tests and it is subject to change at any time.
      **/
     virtual int inject_event(AnboxInputEvent event) = 0;
+
+    /**
+     * @brief Read a batch of available input events.
+     *
+     * Anbox will call read_events() to drain all input events which are
+     * currently available (e.g. a complete multi-touch frame terminated by
+     * a SYN_REPORT) with a single call. The \a timeout only applies to the
+     * first event; once an event is available the function must return
+     * without waiting for further events.
+     *
+     * The default implementation calls read_event() until either
+     * \a max_events are read or no further event is available. Plugins
+     * which keep their events in an internal queue should override it to
+     * drain the queue in one go.
+     *
+     * @param events Pointer to an array of at least \a max_events elements.
+     * @param max_events maximum number of events to read.
+     * @param timeout maximum number of milliseconds to wait for the first event,
+     * handled the same way as for read_event().
+     * @return the number of events read on success, otherwise a negative error code.
+     */
+    virtual int read_events(AnboxInputEvent* events, size_t max_events, int timeout) {
+      if (!events || max_events == 0)
+        return -EINVAL;
+
+      auto ret = read_event(&events[0], timeout);
+      if (ret < 0)
+        return ret;
+
+      size_t n = 1;
+      for (; n < max_events; n++) {
+        if (read_event(&events[n], 0) < 0)
+          break;
+      }
+      return static_cast<int>(n);
+    }
+
+    /**
+     * @brief Inject a batch of input events into AnboxPlatform.
+     *
+     * The default implementation calls inject_event() for each event and stops
+     * at the first failure.
+     *
+     * @param events Pointer to an array of \a count events.
+     * @param count number of events to be pushed into the internal queue.
+     * @return 0 on success, otherwise returns a negative error code.
+     * @note This function is only used in our test suite to facilitate our automation
+     *       tests and it is subject to change at any time.
+     **/
+    virtual int inject_events(const AnboxInputEvent* events, size_t count) {
+      if (!events && count > 0)
+        return -EINVAL;
+
+      for (size_t n = 0; n < count; n++) {
+        auto ret = inject_event(events[n]);
+        if (ret < 0)
+          return ret;
+      }
+      return 0;
+    }
+
+    /**
+     * @brief Provide a file descriptor which is readable while input events are queued.
+     *
+     * Anbox polls it together with its other file descriptors and drains the
+     * queue with read_events() once it fires. The file descriptor stays owned
+     * by the processor.
+     *
+     * @return a file descriptor or a negative error code if the processor can't be polled.
+     */
+    virtual int event_fd() const {
+      return -EIO;
+    }
 };
 } // namespace anbox
 
@@ -31,6 +31,7 @@
 #include "anbox-platform-sdk/anbox_proxy.h"
 #include "anbox-platform-sdk/video_decoder.h"
 #include "anbox-platform-sdk/vhal_connector.h"
+#include "anbox-platform-sdk/trace.h"
 
 namespace anbox {
 
@@ -269,14 +270,17 @@ class Platform {
   /**
    * @brief Register an external event tracing implementation withe platform.
    *
+   * The default implementation stores the callbacks in the process wide
+   * anbox::trace::Tracer so the ANBOX_TRACE_* macros submit their events to
+   * the Anbox runtime. Plugins overriding this method should call it too.
+   *
    * @param get_category_enabled_callback Callback the platform can use to determine if a certain tracing category is enabled
    * @param add_event_callback  Callback to submit a tracing event to the Anbox runtime
    */
   virtual void setup_event_tracer(
     AnboxTracerGetCategoryEnabledFunc get_category_enabled_callback,
     AnboxTracerAddEventFunc add_event_callback) {
-    (void) get_category_enabled_callback;
-    (void) add_event_callback;
+    trace::Tracer::instance().setup(get_category_enabled_callback, add_event_callback);
   }
 
  private:
@@ -310,4 +314,39 @@ extern "C" { \
       anbox_platform_plugin_unregister(platform); \
   } \
 }
+
+/**
+ * @brief A variant of ANBOX_PLATFORM_PLUGIN_DESCRIBE which dispatches hot
+ * processor calls statically.
+ *
+ * In addition to what ANBOX_PLATFORM_PLUGIN_DESCRIBE does, this registers a
+ * table of functions calling directly into the concrete processor types of
+ * \a platform_type, so the per-sample audio and per-event input, sensor, gps
+ * and camera calls from Anbox don't go through the virtual method table and
+ * the processor implementation can be inlined.
+ *
+ * For this to take effect, the processor getters of \a platform_type have to
+ * return the concrete processor type and the processor classes have to be
+ * marked final, e.g.
+ *
+ *     class MyAudioProcessor final : public anbox::AudioProcessor { ... };
+ *     class MyPlatform : public anbox::Platform {
+ *       MyAudioProcessor* audio_processor() override;
+ *       ...
+ *     };
+ *
+ **/
+#define ANBOX_PLATFORM_PLUGIN_DESCRIBE_FINAL(platform_type, name, vendor, description) \
+  AnboxPlatformDescriptor anbox_platform_descriptor __attribute((section(ANBOX_PLATFORM_DESCRIPTOR_SECTION))) = \
+    { name, vendor, description, ANBOX_PLATFORM_VERSION }; \
+extern "C" { \
+  ANBOX_EXPORT AnboxPlatform* anbox_initialize(const AnboxPlatformConfiguration* configuration) { \
+    auto platform = std::make_unique<platform_type>(configuration); \
+    return anbox_platform_plugin_register(std::move(platform), \
+      &anbox::internal::PlatformDispatch<platform_type>::table); \
+  } \
+  ANBOX_EXPORT void anbox_deinitialize(AnboxPlatform* platform) { \
+      anbox_platform_plugin_unregister(platform); \
+  } \
+}
 #endif
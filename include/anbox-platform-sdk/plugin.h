@@ -22,13 +22,45 @@
 #include "anbox-platform-sdk/platform.h"
 
 #include <memory>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Table of statically dispatched processor methods.
+ *
+ * Every entry calls the corresponding method on the concrete processor type
+ * of a platform instead of going through the virtual method table, which
+ * allows the compiler to inline the processor implementation into the C API.
+ * The table is generated by ANBOX_PLATFORM_PLUGIN_DESCRIBE_FINAL.
+ */
+struct AnboxPlatformDispatchTable {
+  ssize_t (*audio_processor_write_data)(anbox::AudioProcessor* processor, const uint8_t* data, size_t size);
+  ssize_t (*audio_processor_write_datav)(anbox::AudioProcessor* processor, const AnboxIoVec* iov, size_t count);
+  ssize_t (*audio_processor_write_data_timestamped)(anbox::AudioProcessor* processor, const uint8_t* data,
+                                                    size_t size, uint64_t timestamp_ns);
+  ssize_t (*audio_processor_read_data)(anbox::AudioProcessor* processor, uint8_t* data, size_t size);
+  int (*input_processor_read_event)(anbox::InputProcessor* processor, AnboxInputEvent* event, int timeout);
+  int (*input_processor_inject_event)(anbox::InputProcessor* processor, AnboxInputEvent event);
+  int (*input_processor_read_events)(anbox::InputProcessor* processor, AnboxInputEvent* events,
+                                     size_t max_events, int timeout);
+  int (*input_processor_inject_events)(anbox::InputProcessor* processor, const AnboxInputEvent* events,
+                                       size_t count);
+  int (*sensor_processor_read_data)(anbox::SensorProcessor* processor, AnboxSensorData* data, int timeout);
+  int (*gps_processor_read_data)(anbox::GpsProcessor* processor, AnboxGpsData* data, int timeout);
+  int (*camera_processor_read_frame)(anbox::CameraProcessor* processor, AnboxVideoFrame* frame, int timeout);
+  int (*camera_processor_read_frame_with_release)(anbox::CameraProcessor* processor, AnboxVideoFrame* frame,
+                                                  AnboxCallback* release, int timeout);
+  int (*camera_processor_read_frame2)(anbox::CameraProcessor* processor, AnboxVideoFrame2* frame, int timeout);
+};
 
 struct AnboxAudioProcessor {
   anbox::AudioProcessor* instance{nullptr};
+  const AnboxPlatformDispatchTable* dispatch{nullptr};
 };
 
 struct AnboxInputProcessor {
   anbox::InputProcessor* instance{nullptr};
+  const AnboxPlatformDispatchTable* dispatch{nullptr};
 };
 
 struct AnboxGraphicsProcessor {
@@ -37,14 +69,17 @@ struct AnboxGraphicsProcessor {
 
 struct AnboxSensorProcessor {
   anbox::SensorProcessor* instance{nullptr};
+  const AnboxPlatformDispatchTable* dispatch{nullptr};
 };
 
 struct AnboxGpsProcessor {
   anbox::GpsProcessor* instance{nullptr};
+  const AnboxPlatformDispatchTable* dispatch{nullptr};
 };
 
 struct AnboxCameraProcessor {
   anbox::CameraProcessor* instance{nullptr};
+  const AnboxPlatformDispatchTable* dispatch{nullptr};
 };
 
 struct AnboxProxy {
@@ -80,6 +115,17 @@ struct AnboxPlatform {
  */
 extern AnboxPlatform* anbox_platform_plugin_register(std::unique_ptr<anbox::Platform>&& platform);
 
+/**
+ * @brief Register a platform plugin together with a table of statically
+ * dispatched processor methods.
+ *
+ * Calls from Anbox into the processors covered by \a dispatch bypass the
+ * virtual method table. \a dispatch must stay valid for the lifetime of
+ * the returned AnboxPlatform instance.
+ */
+extern AnboxPlatform* anbox_platform_plugin_register(std::unique_ptr<anbox::Platform>&& platform,
+                                                     const AnboxPlatformDispatchTable* dispatch);
+
 /**
  * @brief Unregister a platform plugin.
  *
@@ -90,4 +136,104 @@ extern AnboxPlatform* anbox_platform_plugin_register(std::unique_ptr<anbox::Plat
  */
 extern void anbox_platform_plugin_unregister(AnboxPlatform*);
 
+namespace anbox {
+namespace internal {
+/**
+ * @brief Generates an AnboxPlatformDispatchTable for the platform type \a P.
+ *
+ * The concrete processor types are deduced from the return types of the
+ * processor getters of \a P. To allow the compiler to resolve the calls
+ * statically the getters have to be declared with the concrete processor
+ * type as (covariant) return type and the processor classes have to be
+ * marked final. Otherwise the calls remain virtual but still behave correctly.
+ */
+template <typename P>
+struct PlatformDispatch {
+  template <typename T>
+  using processor_type = typename std::remove_pointer<T>::type;
+
+  using audio_type = processor_type<decltype(std::declval<P&>().audio_processor())>;
+  using input_type = processor_type<decltype(std::declval<P&>().input_processor())>;
+  using sensor_type = processor_type<decltype(std::declval<P&>().sensor_processor())>;
+  using gps_type = processor_type<decltype(std::declval<P&>().gps_processor())>;
+  using camera_type = processor_type<decltype(std::declval<P&>().camera_processor())>;
+
+  static ssize_t audio_processor_write_data(AudioProcessor* processor, const uint8_t* data, size_t size) {
+    return static_cast<audio_type*>(processor)->write_data(data, size);
+  }
+
+  static ssize_t audio_processor_write_datav(AudioProcessor* processor, const AnboxIoVec* iov, size_t count) {
+    return static_cast<audio_type*>(processor)->write_datav(iov, count);
+  }
+
+  static ssize_t audio_processor_write_data_timestamped(AudioProcessor* processor, const uint8_t* data,
+                                                        size_t size, uint64_t timestamp_ns) {
+    return static_cast<audio_type*>(processor)->write_data_timestamped(data, size, timestamp_ns);
+  }
+
+  static ssize_t audio_processor_read_data(AudioProcessor* processor, uint8_t* data, size_t size) {
+    return static_cast<audio_type*>(processor)->read_data(data, size);
+  }
+
+  static int input_processor_read_event(InputProcessor* processor, AnboxInputEvent* event, int timeout) {
+    return static_cast<input_type*>(processor)->read_event(event, timeout);
+  }
+
+  static int input_processor_inject_event(InputProcessor* processor, AnboxInputEvent event) {
+    return static_cast<input_type*>(processor)->inject_event(event);
+  }
+
+  static int input_processor_read_events(InputProcessor* processor, AnboxInputEvent* events,
+                                         size_t max_events, int timeout) {
+    return static_cast<input_type*>(processor)->read_events(events, max_events, timeout);
+  }
+
+  static int input_processor_inject_events(InputProcessor* processor, const AnboxInputEvent* events,
+                                           size_t count) {
+    return static_cast<input_type*>(processor)->inject_events(events, count);
+  }
+
+  static int sensor_processor_read_data(SensorProcessor* processor, AnboxSensorData* data, int timeout) {
+    return static_cast<sensor_type*>(processor)->read_data(data, timeout);
+  }
+
+  static int gps_processor_read_data(GpsProcessor* processor, AnboxGpsData* data, int timeout) {
+    return static_cast<gps_type*>(processor)->read_data(data, timeout);
+  }
+
+  static int camera_processor_read_frame(CameraProcessor* processor, AnboxVideoFrame* frame, int timeout) {
+    return static_cast<camera_type*>(processor)->read_frame(frame, timeout);
+  }
+
+  static int camera_processor_read_frame_with_release(CameraProcessor* processor, AnboxVideoFrame* frame,
+                                                      AnboxCallback* release, int timeout) {
+    return static_cast<camera_type*>(processor)->read_frame_with_release(frame, release, timeout);
+  }
+
+  static int camera_processor_read_frame2(CameraProcessor* processor, AnboxVideoFrame2* frame, int timeout) {
+    return static_cast<camera_type*>(processor)->read_frame2(frame, timeout);
+  }
+
+  static const AnboxPlatformDispatchTable table;
+};
+
+template <typename P>
+const AnboxPlatformDispatchTable PlatformDispatch<P>::table = {
+  &PlatformDispatch<P>::audio_processor_write_data,
+  &PlatformDispatch<P>::audio_processor_write_datav,
+  &PlatformDispatch<P>::audio_processor_write_data_timestamped,
+  &PlatformDispatch<P>::audio_processor_read_data,
+  &PlatformDispatch<P>::input_processor_read_event,
+  &PlatformDispatch<P>::input_processor_inject_event,
+  &PlatformDispatch<P>::input_processor_read_events,
+  &PlatformDispatch<P>::input_processor_inject_events,
+  &PlatformDispatch<P>::sensor_processor_read_data,
+  &PlatformDispatch<P>::gps_processor_read_data,
+  &PlatformDispatch<P>::camera_processor_read_frame,
+  &PlatformDispatch<P>::camera_processor_read_frame_with_release,
+  &PlatformDispatch<P>::camera_processor_read_frame2,
+};
+} // namespace internal
+} // namespace anbox
+
 #endif
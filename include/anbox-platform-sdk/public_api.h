@@ -200,6 +200,22 @@ typedef int (*AnboxPlatformStopFunc)(const AnboxPlatform* platform);
  **/
 typedef void (*AnboxPlatformHandleEventFunc)(const AnboxPlatform* platform, AnboxEventType type);
 
+/**
+ * @brief Retrieve a snapshot of the latency statistics of the platform plugin C API.
+ *
+ * Statistics are only collected when the platform plugin is built with the
+ * ANBOX_PLATFORM_SDK_CALL_STATS option, otherwise -EIO is returned. Only
+ * functions which were called at least once are reported.
+ *
+ * If \a stats is NULL the number of available entries is stored in \a count.
+ * Otherwise up to \a count entries are written to \a stats and \a count is
+ * updated with the number of entries written.
+ *
+ **/
+typedef int (*AnboxPlatformGetStatsFunc)(const AnboxPlatform* platform,
+                                         AnboxCallStats* stats,
+                                         size_t* count);
+
 /**
  * @brief Process a chunk of audio data.
  *
@@ -222,6 +238,40 @@ typedef ssize_t (*AnboxAudioProcessorWriteDataFunc)(const AnboxAudioProcessor* a
                                                     const uint8_t* data,
                                                     size_t size);
 
+/**
+ * @brief Write multiple chunks of audio data.
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::AudioProcessor::write_datav
+ *
+ **/
+typedef ssize_t (*AnboxAudioProcessorWriteDataVFunc)(const AnboxAudioProcessor* audio_processor,
+                                                     const AnboxIoVec* iov,
+                                                     size_t count);
+
+/**
+ * @brief Write a chunk of audio data together with its presentation time.
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::AudioProcessor::write_data_timestamped
+ *
+ **/
+typedef ssize_t (*AnboxAudioProcessorWriteDataTimestampedFunc)(const AnboxAudioProcessor* audio_processor,
+                                                               const uint8_t* data,
+                                                               size_t size,
+                                                               uint64_t timestamp_ns);
+
+/**
+ * @brief Query how much audio data the platform has presented so far.
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::AudioProcessor::get_presentation_position
+ *
+ **/
+typedef int (*AnboxAudioProcessorGetPresentationPositionFunc)(const AnboxAudioProcessor* audio_processor,
+                                                              uint64_t* frames,
+                                                              uint64_t* time_ns);
+
 /**
  * @brief Read a chunk of audio data.
  *
@@ -283,6 +333,38 @@ typedef int (*AnboxInputProcessorReadEventFunc)(const AnboxInputProcessor* input
 typedef int (*AnboxInputProcessorInjectEventFunc)(const AnboxInputProcessor* input_processor,
                                                   AnboxInputEvent event);
 
+/**
+ * @brief Read a batch of available input events.
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::InputProcessor::read_events
+ *
+ **/
+typedef int (*AnboxInputProcessorReadEventsFunc)(const AnboxInputProcessor* input_processor,
+                                                 AnboxInputEvent* events,
+                                                 size_t max_events,
+                                                 int timeout);
+
+/**
+ * @brief Inject a batch of input events into AnboxPlatform
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::InputProcessor::inject_events
+ *
+ **/
+typedef int (*AnboxInputProcessorInjectEventsFunc)(const AnboxInputProcessor* input_processor,
+                                                   const AnboxInputEvent* events,
+                                                   size_t count);
+
+/**
+ * @brief Get a file descriptor which becomes readable when an input event is available
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::InputProcessor::event_fd
+ *
+ **/
+typedef int (*AnboxInputProcessorGetFdFunc)(const AnboxInputProcessor* input_processor);
+
 /**
  * @brief Initialize the graphics processor
  *
@@ -424,6 +506,15 @@ typedef int (*AnboxSensorProcessorReadDataFunc)(const AnboxSensorProcessor* sens
 typedef int (*AnboxSensorProcessorInjectDataFunc)(const AnboxSensorProcessor* sensor_processor,
                                                   AnboxSensorData data);
 
+/**
+ * @brief Get a file descriptor which becomes readable when sensor data is available
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::SensorProcessor::event_fd
+ *
+ **/
+typedef int (*AnboxSensorProcessorGetFdFunc)(const AnboxSensorProcessor* sensor_processor);
+
 /**
  * @brief Set the change screen orientation callback function
  *
@@ -542,6 +633,15 @@ typedef int (*AnboxGpsProcessorReadDataFunc)(const AnboxGpsProcessor* gps_proces
 typedef int (*AnboxGpsProcessorInjectDataFunc)(const AnboxGpsProcessor* gps_processor,
                                                AnboxGpsData data);
 
+/**
+ * @brief Get a file descriptor which becomes readable when gps data is available
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::GpsProcessor::event_fd
+ *
+ **/
+typedef int (*AnboxGpsProcessorGetFdFunc)(const AnboxGpsProcessor* gps_processor);
+
 /**
  * @brief Open a camera device.
  *
@@ -595,6 +695,81 @@ typedef int (*AnboxCameraProcessorReadFrameFunc)(const AnboxCameraProcessor* cam
 typedef int (*AnboxCameraProcessorInjectFrameFunc)(const AnboxCameraProcessor* camera_processor,
                                                    AnboxVideoFrame frame);
 
+/**
+ * @brief Read next available video frame together with the callback releasing it.
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::CameraProcessor::read_frame_with_release
+ *
+ **/
+typedef int (*AnboxCameraProcessorReadFrameWithReleaseFunc)(const AnboxCameraProcessor* camera_processor,
+                                                            AnboxVideoFrame* frame,
+                                                            AnboxCallback* release,
+                                                            int timeout);
+
+/**
+ * @brief Inject a video frame together with the callback releasing it into AnboxPlatform
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::CameraProcessor::inject_frame_with_release
+ *
+ **/
+typedef int (*AnboxCameraProcessorInjectFrameWithReleaseFunc)(const AnboxCameraProcessor* camera_processor,
+                                                              AnboxVideoFrame frame,
+                                                              AnboxCallback* release);
+
+/**
+ * @brief Read next available video frame stored in a memfd or dma-buf.
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::CameraProcessor::read_frame2
+ *
+ **/
+typedef int (*AnboxCameraProcessorReadFrame2Func)(const AnboxCameraProcessor* camera_processor,
+                                                  AnboxVideoFrame2* frame,
+                                                  int timeout);
+
+/**
+ * @brief Inject a video frame stored in a memfd or dma-buf into AnboxPlatform
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::CameraProcessor::inject_frame2
+ *
+ **/
+typedef int (*AnboxCameraProcessorInjectFrame2Func)(const AnboxCameraProcessor* camera_processor,
+                                                    const AnboxVideoFrame2* frame);
+
+/**
+ * @brief Open a camera device with a specific frame delivery.
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::CameraProcessor::open_device_with_options
+ *
+ **/
+typedef int (*AnboxCameraProcessorOpenDeviceWithOptionsFunc)(const AnboxCameraProcessor* camera_processor,
+                                                             AnboxCameraSpec spec,
+                                                             AnboxCameraOrientation orientation,
+                                                             const AnboxCameraDeliveryOptions* options);
+
+/**
+ * @brief Get the number of video frames dropped by a camera processor.
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::CameraProcessor::get_dropped_frames
+ *
+ **/
+typedef int (*AnboxCameraProcessorGetDroppedFramesFunc)(const AnboxCameraProcessor* camera_processor,
+                                                        uint64_t* count);
+
+/**
+ * @brief Get a file descriptor which becomes readable when a video frame is available
+ *
+ * The function prototype for C API function which stands for
+ * the C++ method of anbox::CameraProcessor::event_fd
+ *
+ **/
+typedef int (*AnboxCameraProcessorGetFdFunc)(const AnboxCameraProcessor* camera_processor);
+
 /*
  * @brief Release the video decoder instance
  **/
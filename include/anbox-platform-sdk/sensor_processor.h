@@ -96,6 +96,19 @@ class SensorProcessor {
       (void) on;
       return -EIO;
     }
+
+    /**
+     * @brief Provide a file descriptor which is readable while sensor data is queued.
+     *
+     * When it is available Anbox only calls read_data() after the descriptor
+     * became readable instead of blocking a thread per sensor processor. It
+     * remains owned by the processor and may occasionally wake up spuriously.
+     *
+     * @return a file descriptor or a negative error code if the processor can't be polled.
+     */
+    virtual int event_fd() const {
+      return -EIO;
+    }
 };
 } // namespace anbox
 
@@ -0,0 +1,287 @@
+/*
+ * This file is part of Anbox Platform SDK
+ *
+ * Copyright 2021 Canonical Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANBOX_SDK_SPSC_RING_H_
+#define ANBOX_SDK_SPSC_RING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace anbox {
+/**
+ * @brief Size of a cache line used to pad the indices of lock-free containers
+ * so the producer and the consumer never write to the same cache line.
+ */
+constexpr size_t cache_line_size = 64;
+
+/**
+ * @brief SpscRingPolicy defines what SpscRing::push() does when the ring is full.
+ */
+enum class SpscRingPolicy {
+  /** Reject the new element and let push() return false. */
+  Reject,
+  /** Drop the oldest queued element to make room for the new one. */
+  OverwriteOldest,
+};
+
+/**
+ * @brief SpscRing is a fixed capacity, lock-free single producer / single
+ * consumer queue.
+ *
+ * All storage is allocated as part of the object, so neither push() nor pop()
+ * ever allocates memory. Exactly one thread may call push() and exactly one
+ * thread may call pop() at any given time.
+ *
+ * With SpscRingPolicy::OverwriteOldest the producer advances the read index
+ * itself when the ring is full. The consumer detects this and retries, which
+ * requires \a T to be trivially copyable.
+ *
+ * @tparam T type of the queued elements.
+ * @tparam N capacity of the ring, must be a power of two.
+ * @tparam Policy behavior of push() when the ring is full.
+ */
+template <typename T, size_t N, SpscRingPolicy Policy = SpscRingPolicy::Reject>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+  static_assert(Policy != SpscRingPolicy::OverwriteOldest || std::is_trivially_copyable<T>::value,
+                "SpscRing overwrite policy requires a trivially copyable element type");
+
+ public:
+  SpscRing() = default;
+  ~SpscRing() = default;
+  SpscRing(const SpscRing &) = delete;
+  SpscRing& operator=(const SpscRing &) = delete;
+
+  /**
+   * @brief Queue a new element. Must only be called from the producer thread.
+   *
+   * @param item the element to queue.
+   * @return true if the element was queued, false if the ring is full and the
+   * policy is SpscRingPolicy::Reject.
+   */
+  bool push(const T& item) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ >= N) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ >= N) {
+        if (Policy == SpscRingPolicy::Reject)
+          return false;
+
+        // Drop the oldest element. If the consumer was faster the slot got
+        // freed anyway and there is nothing to drop.
+        auto head = cached_head_;
+        if (head_.compare_exchange_strong(head, head + 1, std::memory_order_acq_rel))
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+        cached_head_ = head_.load(std::memory_order_acquire);
+      }
+    }
+
+    slots_[tail & mask] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Dequeue the oldest element. Must only be called from the consumer thread.
+   *
+   * @param item receives the dequeued element.
+   * @return true if an element was dequeued, false if the ring is empty.
+   */
+  bool pop(T& item) {
+    auto head = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      if (head >= cached_tail_) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if (head >= cached_tail_)
+          return false;
+      }
+
+      if (Policy == SpscRingPolicy::Reject) {
+        item = slots_[head & mask];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+      // The producer may have overwritten the slot while we were copying it,
+      // in which case it already moved the head forward and the copy is discarded.
+      T copy = slots_[head & mask];
+      if (head_.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel,
+                                      std::memory_order_relaxed)) {
+        item = copy;
+        return true;
+      }
+    }
+  }
+
+  /**
+   * @brief Number of elements currently queued. Only accurate when called
+   * from either the producer or the consumer thread.
+   */
+  size_t size() const {
+    const auto head = head_.load(std::memory_order_acquire);
+    const auto tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+  /**
+   * @brief Check if the ring has no element queued.
+   */
+  bool empty() const { return size() == 0; }
+
+  /**
+   * @brief Number of elements dropped by the SpscRingPolicy::OverwriteOldest policy.
+   */
+  size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Maximum number of elements the ring can hold.
+   */
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  static constexpr size_t mask = N - 1;
+
+  // Written by the consumer, read by the producer.
+  alignas(cache_line_size) std::atomic<size_t> head_{0};
+  // Consumer local copy of tail_ to avoid touching the producer cache line on every pop().
+  size_t cached_tail_{0};
+
+  // Written by the producer, read by the consumer.
+  alignas(cache_line_size) std::atomic<size_t> tail_{0};
+  // Producer local copy of head_ to avoid touching the consumer cache line on every push().
+  size_t cached_head_{0};
+  std::atomic<size_t> dropped_{0};
+
+  alignas(cache_line_size) T slots_[N];
+};
+
+/**
+ * @brief SpscByteRing is a fixed capacity, lock-free single producer / single
+ * consumer byte stream.
+ *
+ * Unlike SpscRing it transfers as many bytes as fit in a single call, copying
+ * at most two contiguous segments when the data wraps around the end of the
+ * ring. This makes it suitable for streams like PCM audio which are written
+ * and consumed in chunks of different sizes.
+ *
+ * @tparam N capacity of the ring in bytes, must be a power of two.
+ */
+template <size_t N>
+class SpscByteRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscByteRing capacity must be a power of two");
+
+ public:
+  SpscByteRing() = default;
+  ~SpscByteRing() = default;
+  SpscByteRing(const SpscByteRing &) = delete;
+  SpscByteRing& operator=(const SpscByteRing &) = delete;
+
+  /**
+   * @brief Append up to \a size bytes to the ring. Must only be called from
+   * the producer thread.
+   *
+   * @param data the bytes to append.
+   * @param size the number of bytes to append.
+   * @return the number of bytes actually appended, which is less than \a size
+   * if the ring has not enough free space.
+   */
+  size_t write(const uint8_t* data, size_t size) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (N - (tail - cached_head_) < size)
+      cached_head_ = head_.load(std::memory_order_acquire);
+
+    const auto count = std::min(size, N - (tail - cached_head_));
+    if (count == 0)
+      return 0;
+
+    const auto offset = tail & mask;
+    const auto first = std::min(count, N - offset);
+    memcpy(data_ + offset, data, first);
+    memcpy(data_, data + first, count - first);
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  /**
+   * @brief Remove up to \a size bytes from the ring. Must only be called from
+   * the consumer thread.
+   *
+   * @param data receives the removed bytes.
+   * @param size the maximum number of bytes to remove.
+   * @return the number of bytes actually removed.
+   */
+  size_t read(uint8_t* data, size_t size) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < size)
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+
+    const auto count = std::min(size, cached_tail_ - head);
+    if (count == 0)
+      return 0;
+
+    const auto offset = head & mask;
+    const auto first = std::min(count, N - offset);
+    memcpy(data, data_ + offset, first);
+    memcpy(data + first, data_, count - first);
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  /**
+   * @brief Number of bytes currently stored. Only accurate when called from
+   * either the producer or the consumer thread.
+   */
+  size_t size() const {
+    const auto head = head_.load(std::memory_order_acquire);
+    const auto tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+  /**
+   * @brief Check if the ring has no bytes stored.
+   */
+  bool empty() const { return size() == 0; }
+
+  /**
+   * @brief Maximum number of bytes the ring can hold.
+   */
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  static constexpr size_t mask = N - 1;
+
+  // Written by the consumer, read by the producer.
+  alignas(cache_line_size) std::atomic<size_t> head_{0};
+  // Consumer local copy of tail_ to avoid touching the producer cache line on every read().
+  size_t cached_tail_{0};
+
+  // Written by the producer, read by the consumer.
+  alignas(cache_line_size) std::atomic<size_t> tail_{0};
+  // Producer local copy of head_ to avoid touching the consumer cache line on every write().
+  size_t cached_head_{0};
+
+  alignas(cache_line_size) uint8_t data_[N];
+};
+} // namespace anbox
+
+#endif
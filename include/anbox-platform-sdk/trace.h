@@ -0,0 +1,318 @@
+/*
+ * This file is part of Anbox Platform SDK
+ *
+ * Copyright 2021 Canonical Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANBOX_SDK_TRACE_H_
+#define ANBOX_SDK_TRACE_H_
+
+#include "anbox-platform-sdk/types.h"
+
+#include <atomic>
+#include <type_traits>
+
+#include <string.h>
+
+/**
+ * @brief Tracing support for platform plugins.
+ *
+ * Once Anbox registered its tracing implementation through
+ * anbox::Platform::setup_event_tracer, the macros below submit trace events to
+ * the Anbox runtime so they show up in its trace timeline.
+ *
+ *     void MyAudioProcessor::write_data(const uint8_t* data, size_t size) {
+ *       ANBOX_TRACE_EVENT1("my_platform", "write_data", "size", size);
+ *       ...
+ *     }
+ *
+ * Every call site caches the pointer to the enabled state of its category,
+ * so an event of a disabled category costs a single load and branch. Names
+ * of categories, events and arguments as well as string argument values must
+ * be string literals or otherwise outlive the tracing session. Use
+ * anbox::trace::copy() for string values which don't.
+ */
+
+#define ANBOX_TRACE_INTERNAL_CONCAT2(a, b) a##b
+#define ANBOX_TRACE_INTERNAL_CONCAT(a, b) ANBOX_TRACE_INTERNAL_CONCAT2(a, b)
+#define ANBOX_TRACE_INTERNAL_UID(name) ANBOX_TRACE_INTERNAL_CONCAT(anbox_trace_##name, __LINE__)
+
+#define ANBOX_TRACE_INTERNAL_CATEGORY(category) \
+  static std::atomic<const unsigned char*> ANBOX_TRACE_INTERNAL_UID(category_cache){nullptr}; \
+  const unsigned char* ANBOX_TRACE_INTERNAL_UID(category_enabled) = \
+    anbox::trace::category_enabled(ANBOX_TRACE_INTERNAL_UID(category_cache), category)
+
+#define ANBOX_TRACE_INTERNAL_SCOPED(category, name, ...) \
+  ANBOX_TRACE_INTERNAL_CATEGORY(category); \
+  anbox::trace::ScopedEvent ANBOX_TRACE_INTERNAL_UID(scoped_event); \
+  if (__builtin_expect(*ANBOX_TRACE_INTERNAL_UID(category_enabled), 0)) \
+    ANBOX_TRACE_INTERNAL_UID(scoped_event).begin(ANBOX_TRACE_INTERNAL_UID(category_enabled), \
+                                                 name, ##__VA_ARGS__)
+
+#define ANBOX_TRACE_INTERNAL_EVENT(phase, category, name, id, ...) \
+  do { \
+    ANBOX_TRACE_INTERNAL_CATEGORY(category); \
+    if (__builtin_expect(*ANBOX_TRACE_INTERNAL_UID(category_enabled), 0)) \
+      anbox::trace::add_event(phase, ANBOX_TRACE_INTERNAL_UID(category_enabled), \
+                              name, id, ##__VA_ARGS__); \
+  } while (0)
+
+/**
+ * @brief Trace the duration of the enclosing scope.
+ */
+#define ANBOX_TRACE_EVENT0(category, name) \
+  ANBOX_TRACE_INTERNAL_SCOPED(category, name)
+
+/**
+ * @brief Trace the duration of the enclosing scope with a single argument.
+ */
+#define ANBOX_TRACE_EVENT1(category, name, arg1_name, arg1_val) \
+  ANBOX_TRACE_INTERNAL_SCOPED(category, name, arg1_name, arg1_val)
+
+/**
+ * @brief Trace the duration of the enclosing scope with two arguments.
+ */
+#define ANBOX_TRACE_EVENT2(category, name, arg1_name, arg1_val, arg2_name, arg2_val) \
+  ANBOX_TRACE_INTERNAL_SCOPED(category, name, arg1_name, arg1_val, arg2_name, arg2_val)
+
+/**
+ * @brief Record the current value of a counter.
+ */
+#define ANBOX_TRACE_COUNTER(category, name, value) \
+  ANBOX_TRACE_INTERNAL_EVENT(ANBOX_TRACE_EVENT_PHASE_COUNTER, category, name, 0, "value", value)
+
+/**
+ * @brief Begin an asynchronous operation identified by \a id which may end
+ * in a different scope or thread.
+ */
+#define ANBOX_TRACE_EVENT_ASYNC_BEGIN0(category, name, id) \
+  ANBOX_TRACE_INTERNAL_EVENT(ANBOX_TRACE_EVENT_PHASE_ASYNC_BEGIN, category, name, id)
+
+/**
+ * @brief Begin an asynchronous operation identified by \a id with a single argument.
+ */
+#define ANBOX_TRACE_EVENT_ASYNC_BEGIN1(category, name, id, arg1_name, arg1_val) \
+  ANBOX_TRACE_INTERNAL_EVENT(ANBOX_TRACE_EVENT_PHASE_ASYNC_BEGIN, category, name, id, arg1_name, arg1_val)
+
+/**
+ * @brief End the asynchronous operation identified by \a id.
+ */
+#define ANBOX_TRACE_EVENT_ASYNC_END0(category, name, id) \
+  ANBOX_TRACE_INTERNAL_EVENT(ANBOX_TRACE_EVENT_PHASE_ASYNC_END, category, name, id)
+
+/**
+ * @brief End the asynchronous operation identified by \a id with a single argument.
+ */
+#define ANBOX_TRACE_EVENT_ASYNC_END1(category, name, id, arg1_name, arg1_val) \
+  ANBOX_TRACE_INTERNAL_EVENT(ANBOX_TRACE_EVENT_PHASE_ASYNC_END, category, name, id, arg1_name, arg1_val)
+
+namespace anbox {
+namespace trace {
+/**
+ * @brief Tracer holds the tracing callbacks registered by Anbox for the whole process.
+ */
+class Tracer {
+ public:
+  static Tracer& instance() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  /**
+   * @brief Register the tracing callbacks of the Anbox runtime.
+   *
+   * Both callbacks have to stay valid as long as the plugin is loaded.
+   */
+  void setup(AnboxTracerGetCategoryEnabledFunc get_category_enabled,
+             AnboxTracerAddEventFunc add_event) {
+    add_event_.store(add_event, std::memory_order_release);
+    get_category_enabled_.store(get_category_enabled, std::memory_order_release);
+  }
+
+  /**
+   * @brief Check if a tracer was registered.
+   */
+  bool enabled() const {
+    return get_category_enabled_.load(std::memory_order_acquire) != nullptr;
+  }
+
+  /**
+   * @brief Look up the pointer to the enabled state of \a category.
+   *
+   * The pointer is only stored in \a cache once a tracer is registered, so
+   * call sites executed before Anbox set up tracing pick it up later on.
+   */
+  const unsigned char* category_enabled(std::atomic<const unsigned char*>& cache, const char* category) {
+    static const unsigned char disabled = 0;
+    const auto get_category_enabled = get_category_enabled_.load(std::memory_order_acquire);
+    if (!get_category_enabled)
+      return &disabled;
+
+    auto enabled = get_category_enabled(category);
+    if (!enabled)
+      enabled = &disabled;
+    cache.store(enabled, std::memory_order_release);
+    return enabled;
+  }
+
+  /**
+   * @brief Submit a trace event to the Anbox runtime.
+   *
+   * \a category is the pointer returned by category_enabled().
+   */
+  void add_event(char phase, const unsigned char* category, const char* name, unsigned long long id,
+                 int num_args, const char** arg_names, const unsigned char* arg_types,
+                 const unsigned long long* arg_values) {
+    const auto add_event = add_event_.load(std::memory_order_acquire);
+    if (add_event)
+      add_event(phase, category, name, id, num_args, arg_names, arg_types, arg_values, 0);
+  }
+
+ private:
+  Tracer() = default;
+
+  std::atomic<AnboxTracerGetCategoryEnabledFunc> get_category_enabled_{nullptr};
+  std::atomic<AnboxTracerAddEventFunc> add_event_{nullptr};
+};
+
+/**
+ * @brief Return the enabled state of \a category, using \a cache to avoid
+ * asking the Anbox runtime more than once per call site.
+ */
+inline const unsigned char* category_enabled(std::atomic<const unsigned char*>& cache, const char* category) {
+  const auto enabled = cache.load(std::memory_order_acquire);
+  if (__builtin_expect(enabled != nullptr, 1))
+    return enabled;
+  return Tracer::instance().category_enabled(cache, category);
+}
+
+/**
+ * @brief Wraps a string argument value which has to be copied by the tracer.
+ */
+struct CopiedString {
+  const char* value;
+};
+
+/**
+ * @brief Mark a string argument value to be copied by the tracer.
+ */
+inline CopiedString copy(const char* value) { return CopiedString{value}; }
+
+/**
+ * @brief Type and value of a single trace event argument.
+ */
+struct Arg {
+  unsigned char type;
+  unsigned long long value;
+};
+
+inline Arg make_arg(bool value) {
+  return Arg{ANBOX_TRACE_EVENT_ARG_TYPE_BOOL, value ? 1ULL : 0ULL};
+}
+
+inline Arg make_arg(const char* value) {
+  return Arg{ANBOX_TRACE_EVENT_ARG_TYPE_STRING, reinterpret_cast<unsigned long long>(value)};
+}
+
+inline Arg make_arg(CopiedString value) {
+  return Arg{ANBOX_TRACE_EVENT_ARG_TYPE_COPY_STRING, reinterpret_cast<unsigned long long>(value.value)};
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, Arg>::type
+make_arg(T value) {
+  return Arg{ANBOX_TRACE_EVENT_ARG_TYPE_INT, static_cast<unsigned long long>(static_cast<long long>(value))};
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, Arg>::type
+make_arg(T value) {
+  return Arg{ANBOX_TRACE_EVENT_ARG_TYPE_UINT, static_cast<unsigned long long>(value)};
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value, Arg>::type
+make_arg(T value) {
+  return make_arg(static_cast<typename std::underlying_type<T>::type>(value));
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, Arg>::type
+make_arg(T value) {
+  const double d = value;
+  unsigned long long bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return Arg{ANBOX_TRACE_EVENT_ARG_TYPE_DOUBLE, bits};
+}
+
+template <typename T>
+inline Arg make_arg(const T* value) {
+  return Arg{ANBOX_TRACE_EVENT_ARG_TYPE_POINTER, reinterpret_cast<unsigned long long>(value)};
+}
+
+inline void add_event(char phase, const unsigned char* category, const char* name, unsigned long long id) {
+  Tracer::instance().add_event(phase, category, name, id, 0, nullptr, nullptr, nullptr);
+}
+
+template <typename T1>
+inline void add_event(char phase, const unsigned char* category, const char* name, unsigned long long id,
+                      const char* arg1_name, const T1& arg1_val) {
+  const auto arg1 = make_arg(arg1_val);
+  const char* arg_names[] = {arg1_name};
+  const unsigned char arg_types[] = {arg1.type};
+  const unsigned long long arg_values[] = {arg1.value};
+  Tracer::instance().add_event(phase, category, name, id, 1, arg_names, arg_types, arg_values);
+}
+
+template <typename T1, typename T2>
+inline void add_event(char phase, const unsigned char* category, const char* name, unsigned long long id,
+                      const char* arg1_name, const T1& arg1_val,
+                      const char* arg2_name, const T2& arg2_val) {
+  const auto arg1 = make_arg(arg1_val);
+  const auto arg2 = make_arg(arg2_val);
+  const char* arg_names[] = {arg1_name, arg2_name};
+  const unsigned char arg_types[] = {arg1.type, arg2.type};
+  const unsigned long long arg_values[] = {arg1.value, arg2.value};
+  Tracer::instance().add_event(phase, category, name, id, 2, arg_names, arg_types, arg_values);
+}
+
+/**
+ * @brief Emits the end event of a scoped trace event when going out of scope.
+ */
+class ScopedEvent {
+ public:
+  ScopedEvent() = default;
+  ~ScopedEvent() {
+    if (category_)
+      add_event(ANBOX_TRACE_EVENT_PHASE_END, category_, name_, 0);
+  }
+  ScopedEvent(const ScopedEvent &) = delete;
+  ScopedEvent& operator=(const ScopedEvent &) = delete;
+
+  template <typename... Args>
+  void begin(const unsigned char* category, const char* name, const Args&... args) {
+    category_ = category;
+    name_ = name;
+    add_event(ANBOX_TRACE_EVENT_PHASE_BEGIN, category, name, 0, args...);
+  }
+
+ private:
+  const unsigned char* category_{nullptr};
+  const char* name_{nullptr};
+};
+} // namespace trace
+} // namespace anbox
+
+#endif
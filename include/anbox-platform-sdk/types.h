@@ -181,9 +181,10 @@ typedef enum {
 /**
  * @brief The audio input/output format from anbox.
  *
- *  E.g. AnboxAudioSpec spec{44100, AUDIO_FORMAT_PCM_16_BIT, 2, 4096};
+ *  E.g. AnboxAudioSpec spec{44100, AUDIO_FORMAT_PCM_16_BIT, 2, 4096, 1024};
  *       The above spec indicates the audio data is sampled 44100 times per second,
- *       16-bit pcm audio format, two channel with 4kb buffer size in samples.
+ *       16-bit pcm audio format, two channel with 4kb buffer size in samples which
+ *       is transferred in periods of 1024 samples.
  */
 struct AnboxAudioSpec {
   /** The number of samples of audio per second. */
@@ -196,6 +197,84 @@ struct AnboxAudioSpec {
   uint16_t samples;
 };
 
+/**
+ * @brief AnboxAudioSpec2 extends AnboxAudioSpec by the size of the periods
+ * Anbox transfers audio data in.
+ */
+struct AnboxAudioSpec2 {
+  /** The number of samples of audio per second. */
+  uint32_t freq;
+  /** The audio data format. */
+  AnboxAudioFormat format;
+  /** The number of audio signal channels. */
+  uint8_t channels;
+  /** The audio buffer size in samples. */
+  uint16_t samples;
+  /** The number of samples Anbox transfers at once, 0 lets Anbox decide. */
+  uint32_t period_size;
+};
+
+/**
+ * @brief Magic number stored at the beginning of a shared audio ring.
+ */
+#define ANBOX_AUDIO_SHARED_RING_MAGIC 0x41535247u
+
+/**
+ * @brief Version of the shared audio ring layout described by AnboxAudioSharedRingHeader.
+ */
+#define ANBOX_AUDIO_SHARED_RING_VERSION 1u
+
+/**
+ * @brief Header at the beginning of the shared memory of an audio ring.
+ *
+ * The header is followed by \a capacity bytes of audio data. Both cursors
+ * only ever increase and are taken modulo \a capacity to address the data,
+ * the number of queued bytes is write_cursor - read_cursor. Each cursor is
+ * only written by one side, using atomic release stores, and sits in its own
+ * cache line.
+ */
+typedef struct {
+  /** Always ANBOX_AUDIO_SHARED_RING_MAGIC. */
+  uint32_t magic;
+  /** Always ANBOX_AUDIO_SHARED_RING_VERSION. */
+  uint32_t version;
+  /** Size of the audio data in bytes, a power of two. */
+  uint32_t capacity;
+  /** The number of bytes in one period of audio data. */
+  uint32_t period_bytes;
+  uint8_t reserved0[48];
+  /** Total number of bytes written by the producer. */
+  uint64_t write_cursor;
+  uint8_t reserved1[56];
+  /** Total number of bytes read by the consumer. */
+  uint64_t read_cursor;
+  uint8_t reserved2[56];
+} AnboxAudioSharedRingHeader;
+
+/**
+ * @brief Describes a shared memory audio ring exposed by the platform.
+ *
+ * See AUDIO_SHARED_RING for details.
+ */
+typedef struct {
+  /** memfd holding an AnboxAudioSharedRingHeader followed by the audio data. */
+  int memfd;
+  /** eventfd the producer signals when new audio data is available. */
+  int eventfd;
+  /** Size of the shared memory in bytes. */
+  size_t size;
+} AnboxAudioSharedRing;
+
+/**
+ * @brief A single chunk of a scatter/gather write.
+ */
+typedef struct {
+  /** Pointer to the chunk of data. */
+  const uint8_t* data;
+  /** The number of bytes in the chunk. */
+  size_t size;
+} AnboxIoVec;
+
 /**
  * @brief The struct of binder devices that being used in Android container.
  */
@@ -632,6 +711,45 @@ typedef enum {
    */
   ANDROID_SYSTEM_PROPERTIES = 16,
 
+  /*
+   * Shared memory ring for audio output
+   *
+   * A platform supporting this item lets Anbox write audio data for playback
+   * straight into a ring in shared memory instead of calling
+   * anbox::AudioProcessor::write_data for each chunk. Anbox maps the memfd,
+   * appends audio data by advancing the write cursor and signals the eventfd
+   * when the ring was empty before or the queued data reaches one period.
+   * Once Anbox uses the ring, it doesn't call
+   * anbox::AudioProcessor::write_data anymore. The file descriptors remain
+   * owned by the platform, Anbox duplicates them as needed.
+   *
+   * Platforms not supporting this configuration item return an error and
+   * Anbox falls back to anbox::AudioProcessor::write_data.
+   *
+   * The value of this configuration item is of type `AnboxAudioSharedRing`
+   */
+  AUDIO_SHARED_RING = 17,
+
+  /**
+   * Specification of parameters of the audio output Anbox creates.
+   *
+   * Same as AUDIO_SPEC but lets the platform choose the period size as well.
+   * Anbox falls back to AUDIO_SPEC if the platform doesn't support it.
+   *
+   * The value of this configuration item is of type `AnboxAudioSpec2`
+   */
+  AUDIO_SPEC2 = 18,
+
+  /**
+   * Specification of parameters of the audio input Anbox creates.
+   *
+   * Same as AUDIO_INPUT_SPEC but lets the platform choose the period size as
+   * well. Anbox falls back to AUDIO_INPUT_SPEC if the platform doesn't support it.
+   *
+   * The value of this configuration item is of type `AnboxAudioSpec2`
+   */
+  AUDIO_INPUT_SPEC2 = 19,
+
   /*
    * The API defines a range of platform specific configuration items which can be
    * dynamically exposed by the platform. PLATFORM_CONFIGURATION_START specifies
@@ -776,6 +894,26 @@ struct AnboxCameraSpec {
  uint32_t height;
 };
 
+/**
+ * @brief describes how the camera delivers frames which were not read yet
+ */
+typedef enum {
+  /** Every frame is delivered in order, new frames are rejected while the queue is full */
+  CAMERA_DELIVERY_MODE_QUEUE = 0,
+  /** Only the newest frames are kept, the oldest frame is dropped to make room for a new one */
+  CAMERA_DELIVERY_MODE_MAILBOX = 1,
+} AnboxCameraDeliveryMode;
+
+/**
+ * @brief AnboxCameraDeliveryOptions configures the frame delivery of an opened camera
+ */
+struct AnboxCameraDeliveryOptions {
+ /** How frames which were not read yet are kept */
+ AnboxCameraDeliveryMode mode;
+ /** Maximum number of frames kept in CAMERA_DELIVERY_MODE_MAILBOX, at least 1 */
+ uint32_t max_frames;
+};
+
 /**
 * @brief AnboxVideoFrame represents a single complete video frame
 */
@@ -786,6 +924,41 @@ struct AnboxVideoFrame {
  size_t size;
 };
 
+/** Maximum number of planes a video frame can have **/
+#define ANBOX_VIDEO_FRAME_MAX_PLANES 3
+
+/**
+* @brief AnboxVideoFrame2 represents a single complete video frame stored in a
+* memfd or dma-buf, so it can be handed over by file descriptor without a copy
+*/
+struct AnboxVideoFrame2 {
+ /** File descriptor of the memfd or dma-buf holding the frame data */
+ int fd;
+ /** Size of the memory behind the file descriptor in bytes */
+ size_t size;
+ /** Color space format of the frame data */
+ AnboxVideoColorSpaceFormat format;
+ /** The width of the frame */
+ uint32_t width;
+ /** The height of the frame */
+ uint32_t height;
+ /** Number of planes the frame has, 3 for VIDEO_FRAME_FORMAT_YUV420 and 1 for VIDEO_FRAME_FORMAT_RGBA */
+ uint8_t num_planes;
+ /** Offset of a plane inside the memory behind the file descriptor in bytes */
+ uint32_t offset[ANBOX_VIDEO_FRAME_MAX_PLANES];
+ /** Stride of a plane in bytes */
+ uint32_t stride[ANBOX_VIDEO_FRAME_MAX_PLANES];
+ /** Time the frame was captured at in nanoseconds of CLOCK_MONOTONIC or 0 if unknown */
+ uint64_t timestamp_ns;
+ /** Sequence number of the frame. It counts up by one with every frame the camera
+  *  produced, so a gap between two read frames tells how many were dropped. */
+ uint64_t sequence;
+ /** Callback to call once the frame is not used anymore. The file descriptor
+  *  remains owned by the side which provided the frame and must not be closed
+  *  by the receiver, which has to dup() it to keep it beyond the release. */
+ AnboxCallback release;
+};
+
 #define GNSS_MAX_MEASUREMENT 64
 
 /** Milliseconds since January 1, 1970 */
@@ -1697,6 +1870,8 @@ typedef enum {
   ANBOX_TRACE_EVENT_PHASE_END = 'E',
   ANBOX_TRACE_EVENT_PHASE_INSTANT = 'I',
   ANBOX_TRACE_EVENT_PHASE_COUNTER = 'C',
+  ANBOX_TRACE_EVENT_PHASE_ASYNC_BEGIN = 'S',
+  ANBOX_TRACE_EVENT_PHASE_ASYNC_END = 'F',
 } AnboxTraceEventPhase;
 
 
@@ -1738,4 +1913,27 @@ typedef void (*AnboxTracerAddEventFunc)(
   const unsigned long long* arg_values,
   unsigned char flags);
 
+/**
+ * @brief AnboxCallStats describes the latency of the calls Anbox made into a
+ * single function of the platform plugin C API.
+ */
+typedef struct {
+  /* Name of the exported function */
+  const char* name;
+  /* Number of calls made into the function */
+  uint64_t calls;
+  /* Accumulated time spent in the function in nanoseconds */
+  uint64_t total_ns;
+  /* Duration of the longest call in nanoseconds */
+  uint64_t max_ns;
+  /* Median call duration in nanoseconds */
+  uint64_t p50_ns;
+  /* 90th percentile of the call duration in nanoseconds */
+  uint64_t p90_ns;
+  /* 99th percentile of the call duration in nanoseconds */
+  uint64_t p99_ns;
+  /* 99.9th percentile of the call duration in nanoseconds */
+  uint64_t p999_ns;
+} AnboxCallStats;
+
 #endif
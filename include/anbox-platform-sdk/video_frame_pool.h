@@ -0,0 +1,393 @@
+/*
+ * This file is part of Anbox Platform SDK
+ *
+ * Copyright 2021 Canonical Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANBOX_SDK_VIDEO_FRAME_POOL_H_
+#define ANBOX_SDK_VIDEO_FRAME_POOL_H_
+
+#include "anbox-platform-sdk/types.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace anbox {
+/**
+ * @brief Memory backing the frames of a VideoFramePool.
+ */
+enum class VideoFrameMemory {
+  /** Frames live on the heap and can only be handed out as AnboxVideoFrame. */
+  Heap,
+  /** Every frame is a mapped memfd and can be handed out as AnboxVideoFrame2 as well. */
+  Memfd,
+};
+
+/**
+ * @brief VideoFramePool recycles the buffers of video frames.
+ *
+ * Every camera spec, i.e. combination of format, width and height, gets its
+ * own class of fixed size slabs. A slab is allocated the first time no idle
+ * one of its class is left and is put back into the pool by the release
+ * callback handed out with the frame, so a steady stream of frames doesn't
+ * allocate any memory.
+ *
+ * The pool and its slabs are reference counted. Frames still in use when
+ * the pool is destroyed stay valid and their memory is freed once the last
+ * of them got released. The release callback may be called from any thread.
+ *
+ * With VideoFrameMemory::Memfd each slab is a sealed memfd, so the frames can
+ * be passed to another process by file descriptor without copying them.
+ */
+class VideoFramePool {
+ public:
+  /**
+   * @brief The default number of frames of one camera spec in use at the same time.
+   */
+  static constexpr size_t default_max_frames = 8;
+
+  /**
+   * @brief Size of one frame of \a spec in bytes or 0 if the format is not supported.
+   */
+  static size_t frame_size(const AnboxCameraSpec& spec) {
+    const size_t pixels = static_cast<size_t>(spec.width) * spec.height;
+    switch (spec.format) {
+    case VIDEO_FRAME_FORMAT_YUV420:
+      return pixels + 2 * static_cast<size_t>(chroma_width(spec)) * plane_rows(spec, 1);
+    case VIDEO_FRAME_FORMAT_RGBA:
+      return pixels * 4;
+    default:
+      return 0;
+    }
+  }
+
+  /**
+   * @brief Number of rows of plane \a plane of a frame of \a spec.
+   *
+   * The chroma planes of YUV420 frames are rounded up for odd heights, just
+   * like their width is, so the last row and column of pixels keep their chroma.
+   */
+  static uint32_t plane_rows(const AnboxCameraSpec& spec, size_t plane) {
+    return plane == 0 ? spec.height : (spec.height + 1) / 2;
+  }
+
+  /**
+   * @brief Describe the planes of a tightly packed frame of \a spec.
+   *
+   * Sets the format, size and plane layout of \a frame, all other fields are
+   * left untouched.
+   *
+   * @return true on success or false if the format of \a spec is not supported.
+   */
+  static bool describe(const AnboxCameraSpec& spec, AnboxVideoFrame2* frame) {
+    const auto size = frame_size(spec);
+    if (size == 0)
+      return false;
+
+    frame->size = size;
+    frame->format = spec.format;
+    frame->width = spec.width;
+    frame->height = spec.height;
+    for (size_t n = 0; n < ANBOX_VIDEO_FRAME_MAX_PLANES; n++) {
+      frame->offset[n] = 0;
+      frame->stride[n] = 0;
+    }
+    if (spec.format == VIDEO_FRAME_FORMAT_RGBA) {
+      frame->num_planes = 1;
+      frame->stride[0] = spec.width * 4;
+      return true;
+    }
+
+    const auto luma = spec.width * spec.height;
+    frame->num_planes = 3;
+    frame->stride[0] = spec.width;
+    frame->stride[1] = frame->stride[2] = chroma_width(spec);
+    frame->offset[1] = luma;
+    frame->offset[2] = luma + chroma_width(spec) * plane_rows(spec, 1);
+    return true;
+  }
+
+  /**
+   * @brief Create a new pool.
+   *
+   * @param max_frames the maximum number of frames of one camera spec in use at the same time.
+   * @param memory the memory backing the frames.
+   */
+  explicit VideoFramePool(size_t max_frames = default_max_frames,
+                          VideoFrameMemory memory = VideoFrameMemory::Heap) :
+    state_{new State(max_frames, memory)} {}
+
+  ~VideoFramePool() { state_->unref(); }
+  VideoFramePool(const VideoFramePool &) = delete;
+  VideoFramePool& operator=(const VideoFramePool &) = delete;
+
+  /**
+   * @brief Take a frame for \a spec from the pool.
+   *
+   * @param spec the camera spec the frame is used for.
+   * @param frame receives the frame, its content is undefined.
+   * @param release receives the callback which puts the frame back into the pool.
+   * @return 0 on success, -EINVAL if the format of \a spec is not supported or
+   * -ENOMEM if all frames of \a spec are in use or no memory is left.
+   */
+  int acquire(const AnboxCameraSpec& spec, AnboxVideoFrame* frame, AnboxCallback* release) {
+    if (!frame || !release)
+      return -EINVAL;
+
+    const auto size = frame_size(spec);
+    if (size == 0)
+      return -EINVAL;
+
+    auto slab = state_->take(spec, size);
+    if (!slab)
+      return -ENOMEM;
+
+    frame->data = slab->data;
+    frame->size = size;
+    release->callback = &VideoFramePool::release_slab;
+    release->user_data = slab;
+    return 0;
+  }
+
+  /**
+   * @brief Take a frame for \a spec from a VideoFrameMemory::Memfd pool.
+   *
+   * The frame is tightly packed as set up by describe() and its release
+   * callback puts it back into the pool. The timestamp and sequence number
+   * are set to 0.
+   *
+   * @param spec the camera spec the frame is used for.
+   * @param frame receives the frame, its content is undefined.
+   * @param data receives the mapping of the frame data if not null.
+   * @return 0 on success, -EINVAL if the pool isn't backed by memfds or the format
+   * of \a spec is not supported or -ENOMEM if all frames of \a spec are in use or
+   * no memory is left.
+   */
+  int acquire(const AnboxCameraSpec& spec, AnboxVideoFrame2* frame, uint8_t** data = nullptr) {
+    if (!frame || state_->memory != VideoFrameMemory::Memfd)
+      return -EINVAL;
+
+    AnboxVideoFrame2 described;
+    if (!describe(spec, &described))
+      return -EINVAL;
+
+    auto slab = state_->take(spec, described.size);
+    if (!slab)
+      return -ENOMEM;
+
+    *frame = described;
+    frame->fd = slab->fd;
+    frame->timestamp_ns = 0;
+    frame->sequence = 0;
+    frame->release = AnboxCallback{&VideoFramePool::release_slab, slab};
+    if (data)
+      *data = slab->data;
+    return 0;
+  }
+
+  /**
+   * @brief Free the memory of all frames which are not in use, e.g. once the
+   * camera switched to another spec.
+   */
+  void trim() { state_->trim(); }
+
+  /**
+   * @brief Number of frames allocated by the pool, including the ones in use.
+   */
+  size_t allocated_frames() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->allocated;
+  }
+
+  /**
+   * @brief Number of frames currently in use.
+   */
+  size_t frames_in_use() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->in_use;
+  }
+
+ private:
+  static uint32_t chroma_width(const AnboxCameraSpec& spec) { return (spec.width + 1) / 2; }
+
+  // Slabs are cache line aligned, which suits SIMD processing of the frames
+  static constexpr size_t slab_alignment = 64;
+
+  struct State;
+  struct SlabClass;
+
+  struct Slab {
+    State* state;
+    SlabClass* slab_class;
+    uint8_t* data;
+    int fd;
+  };
+
+  struct SlabClass {
+    AnboxVideoColorSpaceFormat format;
+    uint32_t width;
+    uint32_t height;
+    size_t size;
+    std::vector<std::unique_ptr<Slab>> slabs;
+    // Reserved for all slabs, so putting one back never allocates
+    std::vector<Slab*> idle;
+  };
+
+  struct State {
+    State(size_t max_frames, VideoFrameMemory memory) : max_frames{max_frames}, memory{memory} {}
+
+    ~State() {
+      for (auto& slab_class : classes) {
+        for (auto& slab : slab_class->slabs)
+          free_slab(slab.get());
+      }
+    }
+
+    bool allocate_slab(Slab* slab) {
+      const auto size = slab->slab_class->size;
+      if (memory == VideoFrameMemory::Heap) {
+        void* data = nullptr;
+        if (posix_memalign(&data, slab_alignment, size) != 0)
+          return false;
+        slab->data = static_cast<uint8_t*>(data);
+        return true;
+      }
+
+      const int fd = ::memfd_create("anbox-video-frame", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+      if (fd < 0)
+        return false;
+      if (::ftruncate(fd, size) < 0) {
+        ::close(fd);
+        return false;
+      }
+      // The receiver relies on the size, so it must never change
+      ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+      void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        return false;
+      }
+      slab->data = static_cast<uint8_t*>(data);
+      slab->fd = fd;
+      return true;
+    }
+
+    void free_slab(Slab* slab) {
+      if (slab->fd < 0) {
+        free(slab->data);
+        return;
+      }
+      ::munmap(slab->data, slab->slab_class->size);
+      ::close(slab->fd);
+    }
+
+    Slab* take(const AnboxCameraSpec& spec, size_t size) {
+      std::lock_guard<std::mutex> lock(mutex);
+      SlabClass* slab_class = nullptr;
+      for (auto& c : classes) {
+        if (c->format == spec.format && c->width == spec.width && c->height == spec.height) {
+          slab_class = c.get();
+          break;
+        }
+      }
+      if (!slab_class) {
+        classes.emplace_back(new SlabClass{spec.format, spec.width, spec.height, size, {}, {}});
+        slab_class = classes.back().get();
+        slab_class->slabs.reserve(max_frames);
+        slab_class->idle.reserve(max_frames);
+      }
+
+      Slab* slab = nullptr;
+      if (!slab_class->idle.empty()) {
+        slab = slab_class->idle.back();
+        slab_class->idle.pop_back();
+      } else if (slab_class->slabs.size() < max_frames) {
+        std::unique_ptr<Slab> new_slab{new Slab{this, slab_class, nullptr, -1}};
+        if (!allocate_slab(new_slab.get()))
+          return nullptr;
+        slab_class->slabs.push_back(std::move(new_slab));
+        slab = slab_class->slabs.back().get();
+        allocated++;
+      } else {
+        return nullptr;
+      }
+
+      in_use++;
+      refs.fetch_add(1, std::memory_order_relaxed);
+      return slab;
+    }
+
+    void put(Slab* slab) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        slab->slab_class->idle.push_back(slab);
+        in_use--;
+      }
+      unref();
+    }
+
+    void trim() {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto& slab_class : classes) {
+        for (auto slab : slab_class->idle) {
+          free_slab(slab);
+          auto& slabs = slab_class->slabs;
+          for (auto it = slabs.begin(); it != slabs.end(); ++it) {
+            if (it->get() == slab) {
+              slabs.erase(it);
+              break;
+            }
+          }
+          allocated--;
+        }
+        slab_class->idle.clear();
+      }
+    }
+
+    void unref() {
+      if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
+    }
+
+    mutable std::mutex mutex;
+    const size_t max_frames;
+    const VideoFrameMemory memory;
+    std::vector<std::unique_ptr<SlabClass>> classes;
+    size_t allocated{0};
+    size_t in_use{0};
+    // One reference for the pool itself and one for every frame in use
+    std::atomic<size_t> refs{1};
+  };
+
+  static void release_slab(void* user_data) {
+    auto slab = static_cast<Slab*>(user_data);
+    slab->state->put(slab);
+  }
+
+  State* const state_;
+};
+} // namespace anbox
+
+#endif
@@ -0,0 +1,1067 @@
+/*
+ * This file is part of Anbox Platform SDK
+ *
+ * Copyright 2021 Canonical Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANBOX_SDK_VIDEO_IMAGE_H_
+#define ANBOX_SDK_VIDEO_IMAGE_H_
+
+#include <algorithm>
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ANBOX_IMAGE_HAVE_X86 1
+#define ANBOX_IMAGE_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON) && defined(ANBOX_PLATFORM_SDK_NEON)
+// The NEON kernels are opt-in until they are verified against the scalar ones
+// on AArch64 hardware.
+#include <arm_neon.h>
+#define ANBOX_IMAGE_HAVE_NEON 1
+#endif
+
+namespace anbox {
+namespace image {
+/**
+ * @brief Instruction set a set of image kernels is implemented with.
+ */
+enum class SimdLevel {
+  /** Portable C++ implementation, available everywhere. */
+  Scalar,
+  /** x86-64 AVX2, selected when the CPU supports it. */
+  AVX2,
+  /** AArch64 Advanced SIMD, only built with ANBOX_PLATFORM_SDK_NEON defined. */
+  NEON,
+};
+
+/**
+ * @brief Clockwise rotation of an image.
+ */
+enum class Rotation {
+  Rotate0,
+  Rotate90,
+  Rotate180,
+  Rotate270,
+};
+
+/**
+ * @brief The low level image kernels of one instruction set.
+ *
+ * Colors are converted with BT.601 limited range coefficients. All kernels
+ * produce the same results for every SimdLevel. Strides are given in bytes,
+ * widths in pixels and RGBA pixels are stored as R, G, B, A bytes.
+ */
+struct Kernels {
+  SimdLevel level;
+  const char* name;
+  /** Converts a row of I420 pixels, pixel n takes its chroma from u[n / 2] and v[n / 2]. */
+  void (*i420_to_rgba_row)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, size_t width);
+  void (*rgba_to_y_row)(const uint8_t* rgba, uint8_t* y, size_t width);
+  /** Computes the chroma of two rows by averaging blocks of 2x2 pixels. */
+  void (*rgba_to_uv_row)(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* u, uint8_t* v, size_t width);
+  /** Splits \a count interleaved UV samples into separate planes. */
+  void (*split_uv_row)(const uint8_t* uv, uint8_t* u, uint8_t* v, size_t count);
+  /** Interleaves \a count samples of separate planes into UV samples. */
+  void (*merge_uv_row)(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t count);
+  /** Computes dst[n] = src[count - 1 - n] for 8 bit samples. */
+  void (*mirror_row8)(const uint8_t* src, uint8_t* dst, size_t count);
+  /** Computes dst[n] = src[count - 1 - n] for 32 bit pixels. */
+  void (*mirror_row32)(const uint8_t* src, uint8_t* dst, size_t count);
+  /** Computes dst[x][y] = src[y][x] for 8 bit samples, strides may be negative. */
+  void (*transpose8)(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride,
+                     size_t width, size_t height);
+  /** Computes dst[x][y] = src[y][x] for 32 bit pixels, strides may be negative. */
+  void (*transpose32)(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride,
+                      size_t width, size_t height);
+  /**
+   * Computes \a dst_width bilinear interpolated 8 bit samples between \a row0
+   * and \a row1, weighted by \a fy / 256. Sample n is taken at the 16.16
+   * fixed point position x + n * dx of the rows.
+   */
+  void (*scale_row8)(const uint8_t* row0, const uint8_t* row1, uint32_t fy, uint8_t* dst, size_t dst_width,
+                     uint32_t x, uint32_t dx, size_t src_width);
+  /** Same as scale_row8 for 32 bit pixels, each byte is interpolated on its own. */
+  void (*scale_row32)(const uint8_t* row0, const uint8_t* row1, uint32_t fy, uint8_t* dst, size_t dst_width,
+                      uint32_t x, uint32_t dx, size_t src_width);
+};
+
+namespace internal {
+// Scaling works with 16.16 fixed point positions
+constexpr uint32_t max_scale_size = 32768;
+
+inline uint8_t clamp_u8(int value) {
+  return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+}
+
+inline uint32_t lerp(uint32_t a, uint32_t b, uint32_t f) {
+  return (a * (256 - f) + b * f + 128) >> 8;
+}
+
+namespace scalar {
+// The coefficients are scaled by 64 rather than 256, so the SIMD kernels can
+// compute with 16 bit lanes. Luma is scaled by 74.5 to map 235 onto 255.
+inline void yuv_to_rgba(int y, int u, int v, uint8_t* rgba) {
+  const int c = 74 * (y - 16) + ((y - 16) >> 1) + 32;
+  const int d = u - 128;
+  const int e = v - 128;
+  rgba[0] = clamp_u8((c + 102 * e) >> 6);
+  rgba[1] = clamp_u8((c - 25 * d - 52 * e) >> 6);
+  rgba[2] = clamp_u8((c + 129 * d) >> 6);
+  rgba[3] = 255;
+}
+
+inline void i420_to_rgba_row(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, size_t width) {
+  for (size_t n = 0; n < width; n++)
+    yuv_to_rgba(y[n], u[n / 2], v[n / 2], rgba + 4 * n);
+}
+
+inline void rgba_to_y_row(const uint8_t* rgba, uint8_t* y, size_t width) {
+  for (size_t n = 0; n < width; n++) {
+    const auto p = rgba + 4 * n;
+    y[n] = static_cast<uint8_t>(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+  }
+}
+
+inline void rgba_to_uv_row(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* u, uint8_t* v, size_t width) {
+  for (size_t n = 0; n < (width + 1) / 2; n++) {
+    // The last column of an odd width is averaged with itself
+    const auto x0 = 8 * n;
+    const auto x1 = 2 * n + 1 < width ? x0 + 4 : x0;
+    int rgb[3];
+    for (int c = 0; c < 3; c++)
+      rgb[c] = (rgba0[x0 + c] + rgba0[x1 + c] + rgba1[x0 + c] + rgba1[x1 + c] + 2) >> 2;
+    u[n] = static_cast<uint8_t>(((-38 * rgb[0] - 74 * rgb[1] + 112 * rgb[2] + 128) >> 8) + 128);
+    v[n] = static_cast<uint8_t>(((112 * rgb[0] - 94 * rgb[1] - 18 * rgb[2] + 128) >> 8) + 128);
+  }
+}
+
+inline void split_uv_row(const uint8_t* uv, uint8_t* u, uint8_t* v, size_t count) {
+  for (size_t n = 0; n < count; n++) {
+    u[n] = uv[2 * n];
+    v[n] = uv[2 * n + 1];
+  }
+}
+
+inline void merge_uv_row(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t count) {
+  for (size_t n = 0; n < count; n++) {
+    uv[2 * n] = u[n];
+    uv[2 * n + 1] = v[n];
+  }
+}
+
+inline void mirror_row8(const uint8_t* src, uint8_t* dst, size_t count) {
+  for (size_t n = 0; n < count; n++)
+    dst[n] = src[count - 1 - n];
+}
+
+inline void mirror_row32(const uint8_t* src, uint8_t* dst, size_t count) {
+  for (size_t n = 0; n < count; n++)
+    memcpy(dst + 4 * n, src + 4 * (count - 1 - n), 4);
+}
+
+inline void transpose8(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride,
+                       size_t width, size_t height) {
+  for (size_t y = 0; y < height; y++) {
+    const auto row = src + static_cast<ptrdiff_t>(y) * src_stride;
+    for (size_t x = 0; x < width; x++)
+      dst[static_cast<ptrdiff_t>(x) * dst_stride + static_cast<ptrdiff_t>(y)] = row[x];
+  }
+}
+
+inline void transpose32(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride,
+                        size_t width, size_t height) {
+  for (size_t y = 0; y < height; y++) {
+    const auto row = src + static_cast<ptrdiff_t>(y) * src_stride;
+    for (size_t x = 0; x < width; x++)
+      memcpy(dst + static_cast<ptrdiff_t>(x) * dst_stride + static_cast<ptrdiff_t>(4 * y), row + 4 * x, 4);
+  }
+}
+
+inline void scale_row8(const uint8_t* row0, const uint8_t* row1, uint32_t fy, uint8_t* dst, size_t dst_width,
+                       uint32_t x, uint32_t dx, size_t src_width) {
+  for (size_t n = 0; n < dst_width; n++, x += dx) {
+    const size_t x0 = x >> 16;
+    const auto x1 = std::min(x0 + 1, src_width - 1);
+    const auto fx = (x >> 8) & 0xff;
+    dst[n] = static_cast<uint8_t>(lerp(lerp(row0[x0], row0[x1], fx), lerp(row1[x0], row1[x1], fx), fy));
+  }
+}
+
+inline void scale_row32(const uint8_t* row0, const uint8_t* row1, uint32_t fy, uint8_t* dst, size_t dst_width,
+                        uint32_t x, uint32_t dx, size_t src_width) {
+  for (size_t n = 0; n < dst_width; n++, x += dx) {
+    const size_t x0 = x >> 16;
+    const auto x1 = 4 * std::min(x0 + 1, src_width - 1);
+    const auto fx = (x >> 8) & 0xff;
+    for (size_t c = 0; c < 4; c++) {
+      const auto top = lerp(row0[4 * x0 + c], row0[x1 + c], fx);
+      const auto bottom = lerp(row1[4 * x0 + c], row1[x1 + c], fx);
+      dst[4 * n + c] = static_cast<uint8_t>(lerp(top, bottom, fy));
+    }
+  }
+}
+} // namespace scalar
+
+#if defined(ANBOX_IMAGE_HAVE_X86)
+namespace avx2 {
+// Extracts one byte of every 32 bit pixel of 16 pixels as 16 bit samples in order
+ANBOX_IMAGE_TARGET_AVX2 inline __m256i channel16(__m256i lo, __m256i hi, int shift) {
+  const auto mask = _mm256_set1_epi32(0xff);
+  const auto count = _mm_cvtsi32_si128(shift);
+  const auto a = _mm256_and_si256(_mm256_srl_epi32(lo, count), mask);
+  const auto b = _mm256_and_si256(_mm256_srl_epi32(hi, count), mask);
+  // Packing works per 128 bit lane, so the 64 bit halves need reordering
+  return _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void i420_to_rgba_row(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                                                     uint8_t* rgba, size_t width) {
+  const auto y_offset = _mm256_set1_epi16(16);
+  const auto uv_offset = _mm256_set1_epi16(128);
+  const auto rounding = _mm256_set1_epi16(32);
+  const auto alpha = _mm256_set1_epi16(255);
+  size_t n = 0;
+  for (; n + 16 <= width; n += 16) {
+    const auto luma = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + n)));
+    const auto u8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + n / 2));
+    const auto v8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + n / 2));
+    const auto d = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u8, u8)), uv_offset);
+    const auto e = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v8, v8)), uv_offset);
+    const auto l = _mm256_sub_epi16(luma, y_offset);
+    const auto c = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(l, _mm256_set1_epi16(74)),
+                                                     _mm256_srai_epi16(l, 1)), rounding);
+
+    // Only blue can exceed 16 bit, saturating gives the same clamped result
+    const auto r = _mm256_srai_epi16(_mm256_adds_epi16(c, _mm256_mullo_epi16(e, _mm256_set1_epi16(102))), 6);
+    const auto g = _mm256_srai_epi16(
+        _mm256_adds_epi16(_mm256_adds_epi16(c, _mm256_mullo_epi16(d, _mm256_set1_epi16(-25))),
+                          _mm256_mullo_epi16(e, _mm256_set1_epi16(-52))), 6);
+    const auto b = _mm256_srai_epi16(_mm256_adds_epi16(c, _mm256_mullo_epi16(d, _mm256_set1_epi16(129))), 6);
+
+    const auto rg = _mm256_packus_epi16(r, g);
+    const auto ba = _mm256_packus_epi16(b, alpha);
+    const auto rg_pairs = _mm256_unpacklo_epi8(rg, _mm256_srli_si256(rg, 8));
+    const auto ba_pairs = _mm256_unpacklo_epi8(ba, _mm256_srli_si256(ba, 8));
+    const auto lo = _mm256_unpacklo_epi16(rg_pairs, ba_pairs);
+    const auto hi = _mm256_unpackhi_epi16(rg_pairs, ba_pairs);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + 4 * n), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + 4 * n + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  scalar::i420_to_rgba_row(y + n, u + n / 2, v + n / 2, rgba + 4 * n, width - n);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void rgba_to_y_row(const uint8_t* rgba, uint8_t* y, size_t width) {
+  size_t n = 0;
+  for (; n + 16 <= width; n += 16) {
+    const auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + 4 * n));
+    const auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + 4 * n + 32));
+    // The sum stays below 2^16, so unsigned 16 bit lanes are sufficient
+    auto luma = _mm256_add_epi16(_mm256_mullo_epi16(channel16(lo, hi, 0), _mm256_set1_epi16(66)),
+                                 _mm256_mullo_epi16(channel16(lo, hi, 8), _mm256_set1_epi16(129)));
+    luma = _mm256_add_epi16(luma, _mm256_mullo_epi16(channel16(lo, hi, 16), _mm256_set1_epi16(25)));
+    luma = _mm256_add_epi16(_mm256_srli_epi16(_mm256_add_epi16(luma, _mm256_set1_epi16(128)), 8),
+                            _mm256_set1_epi16(16));
+    const auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(luma, luma), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + n), _mm256_castsi256_si128(packed));
+  }
+  scalar::rgba_to_y_row(rgba + 4 * n, y + n, width - n);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline __m256i average2x2(__m256i lo0, __m256i hi0, __m256i lo1, __m256i hi1, int shift) {
+  const auto sum = _mm256_add_epi16(channel16(lo0, hi0, shift), channel16(lo1, hi1, shift));
+  const auto pairs = _mm256_madd_epi16(sum, _mm256_set1_epi16(1));
+  return _mm256_srli_epi32(_mm256_add_epi32(pairs, _mm256_set1_epi32(2)), 2);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline __m256i rgb_to_chroma(__m256i r, __m256i g, __m256i b, int cr, int cg, int cb) {
+  auto sum = _mm256_add_epi32(_mm256_mullo_epi32(r, _mm256_set1_epi32(cr)),
+                              _mm256_mullo_epi32(g, _mm256_set1_epi32(cg)));
+  sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(b, _mm256_set1_epi32(cb)));
+  sum = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+  return _mm256_add_epi32(sum, _mm256_set1_epi32(128));
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void rgba_to_uv_row(const uint8_t* rgba0, const uint8_t* rgba1,
+                                                   uint8_t* u, uint8_t* v, size_t width) {
+  size_t n = 0;
+  for (; n + 16 <= width; n += 16) {
+    const auto lo0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba0 + 4 * n));
+    const auto hi0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba0 + 4 * n + 32));
+    const auto lo1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba1 + 4 * n));
+    const auto hi1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba1 + 4 * n + 32));
+    const auto r = average2x2(lo0, hi0, lo1, hi1, 0);
+    const auto g = average2x2(lo0, hi0, lo1, hi1, 8);
+    const auto b = average2x2(lo0, hi0, lo1, hi1, 16);
+    const auto cu = rgb_to_chroma(r, g, b, -38, -74, 112);
+    const auto cv = rgb_to_chroma(r, g, b, 112, -94, -18);
+
+    // Collect the 4 bytes of u and v each 128 bit lane ends up with
+    auto packed = _mm256_packus_epi16(_mm256_packs_epi32(cu, cv), _mm256_setzero_si256());
+    packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 3, 6, 7));
+    const auto uv = _mm256_castsi256_si128(packed);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(u + n / 2), uv);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(v + n / 2), _mm_srli_si128(uv, 8));
+  }
+  scalar::rgba_to_uv_row(rgba0 + 4 * n, rgba1 + 4 * n, u + n / 2, v + n / 2, width - n);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void split_uv_row(const uint8_t* uv, uint8_t* u, uint8_t* v, size_t count) {
+  const auto deinterleave = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+                                             0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  size_t n = 0;
+  for (; n + 16 <= count; n += 16) {
+    auto samples = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv + 2 * n));
+    samples = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(samples, deinterleave), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(u + n), _mm256_castsi256_si128(samples));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(v + n), _mm256_extracti128_si256(samples, 1));
+  }
+  scalar::split_uv_row(uv + 2 * n, u + n, v + n, count - n);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void merge_uv_row(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t count) {
+  size_t n = 0;
+  for (; n + 32 <= count; n += 32) {
+    const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u + n));
+    const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + n));
+    const auto lo = _mm256_unpacklo_epi8(a, b);
+    const auto hi = _mm256_unpackhi_epi8(a, b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + 2 * n), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + 2 * n + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  scalar::merge_uv_row(u + n, v + n, uv + 2 * n, count - n);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void mirror_row8(const uint8_t* src, uint8_t* dst, size_t count) {
+  const auto reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  size_t n = 0;
+  for (; n + 32 <= count; n += 32) {
+    auto samples = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + count - n - 32));
+    samples = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(samples, reverse), _MM_SHUFFLE(1, 0, 3, 2));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n), samples);
+  }
+  scalar::mirror_row8(src, dst + n, count - n);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void mirror_row32(const uint8_t* src, uint8_t* dst, size_t count) {
+  const auto reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  size_t n = 0;
+  for (; n + 8 <= count; n += 8) {
+    const auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 4 * (count - n - 8)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * n), _mm256_permutevar8x32_epi32(pixels, reverse));
+  }
+  scalar::mirror_row32(src, dst + 4 * n, count - n);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void transpose8x8(const uint8_t* src, ptrdiff_t src_stride,
+                                                 uint8_t* dst, ptrdiff_t dst_stride) {
+  __m128i r[8];
+  for (int n = 0; n < 8; n++)
+    r[n] = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + n * src_stride));
+  const auto a0 = _mm_unpacklo_epi8(r[0], r[1]);
+  const auto a1 = _mm_unpacklo_epi8(r[2], r[3]);
+  const auto a2 = _mm_unpacklo_epi8(r[4], r[5]);
+  const auto a3 = _mm_unpacklo_epi8(r[6], r[7]);
+  const auto b0 = _mm_unpacklo_epi16(a0, a1);
+  const auto b1 = _mm_unpackhi_epi16(a0, a1);
+  const auto b2 = _mm_unpacklo_epi16(a2, a3);
+  const auto b3 = _mm_unpackhi_epi16(a2, a3);
+  // Every register holds two columns of 8 bytes now
+  const __m128i columns[4] = {_mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2),
+                              _mm_unpacklo_epi32(b1, b3), _mm_unpackhi_epi32(b1, b3)};
+  for (int n = 0; n < 4; n++) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 2 * n * dst_stride), columns[n]);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + (2 * n + 1) * dst_stride), _mm_srli_si128(columns[n], 8));
+  }
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void transpose8(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst,
+                                               ptrdiff_t dst_stride, size_t width, size_t height) {
+  const auto width8 = width & ~size_t{7};
+  const auto height8 = height & ~size_t{7};
+  for (size_t y = 0; y < height8; y += 8) {
+    for (size_t x = 0; x < width8; x += 8)
+      transpose8x8(src + static_cast<ptrdiff_t>(y) * src_stride + x, src_stride,
+                   dst + static_cast<ptrdiff_t>(x) * dst_stride + y, dst_stride);
+  }
+  scalar::transpose8(src + width8, src_stride, dst + static_cast<ptrdiff_t>(width8) * dst_stride,
+                     dst_stride, width - width8, height);
+  scalar::transpose8(src + static_cast<ptrdiff_t>(height8) * src_stride, src_stride, dst + height8,
+                     dst_stride, width8, height - height8);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void transpose8x8_32(const uint8_t* src, ptrdiff_t src_stride,
+                                                    uint8_t* dst, ptrdiff_t dst_stride) {
+  __m256 r[8];
+  for (int n = 0; n < 8; n++)
+    r[n] = _mm256_loadu_ps(reinterpret_cast<const float*>(src + n * src_stride));
+  __m256 t[8], s[8];
+  for (int n = 0; n < 4; n++) {
+    t[2 * n] = _mm256_unpacklo_ps(r[2 * n], r[2 * n + 1]);
+    t[2 * n + 1] = _mm256_unpackhi_ps(r[2 * n], r[2 * n + 1]);
+  }
+  for (int n = 0; n < 2; n++) {
+    s[4 * n] = _mm256_shuffle_ps(t[4 * n], t[4 * n + 2], _MM_SHUFFLE(1, 0, 1, 0));
+    s[4 * n + 1] = _mm256_shuffle_ps(t[4 * n], t[4 * n + 2], _MM_SHUFFLE(3, 2, 3, 2));
+    s[4 * n + 2] = _mm256_shuffle_ps(t[4 * n + 1], t[4 * n + 3], _MM_SHUFFLE(1, 0, 1, 0));
+    s[4 * n + 3] = _mm256_shuffle_ps(t[4 * n + 1], t[4 * n + 3], _MM_SHUFFLE(3, 2, 3, 2));
+  }
+  for (int n = 0; n < 4; n++) {
+    _mm256_storeu_ps(reinterpret_cast<float*>(dst + n * dst_stride), _mm256_permute2f128_ps(s[n], s[n + 4], 0x20));
+    _mm256_storeu_ps(reinterpret_cast<float*>(dst + (n + 4) * dst_stride),
+                     _mm256_permute2f128_ps(s[n], s[n + 4], 0x31));
+  }
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void transpose32(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst,
+                                                ptrdiff_t dst_stride, size_t width, size_t height) {
+  const auto width8 = width & ~size_t{7};
+  const auto height8 = height & ~size_t{7};
+  for (size_t y = 0; y < height8; y += 8) {
+    for (size_t x = 0; x < width8; x += 8)
+      transpose8x8_32(src + static_cast<ptrdiff_t>(y) * src_stride + 4 * x, src_stride,
+                      dst + static_cast<ptrdiff_t>(x) * dst_stride + 4 * y, dst_stride);
+  }
+  scalar::transpose32(src + 4 * width8, src_stride, dst + static_cast<ptrdiff_t>(width8) * dst_stride,
+                      dst_stride, width - width8, height);
+  scalar::transpose32(src + static_cast<ptrdiff_t>(height8) * src_stride, src_stride, dst + 4 * height8,
+                      dst_stride, width8, height - height8);
+}
+
+// Interpolates 8 pairs of 16 bit samples (a, b), stored in 32 bit lanes, with weights (256 - f, f)
+ANBOX_IMAGE_TARGET_AVX2 inline __m256i lerp8(__m256i pairs, __m256i weights) {
+  const auto sum = _mm256_madd_epi16(pairs, weights);
+  return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline __m256i weights8(__m256i f) {
+  return _mm256_or_si256(_mm256_sub_epi32(_mm256_set1_epi32(256), f), _mm256_slli_epi32(f, 16));
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void scale_row8(const uint8_t* row0, const uint8_t* row1, uint32_t fy,
+                                               uint8_t* dst, size_t dst_width, uint32_t x, uint32_t dx,
+                                               size_t src_width) {
+  // Every gather loads 4 bytes starting at the left sample of a pair
+  const auto pair = _mm256_setr_epi8(0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1,
+                                     0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1);
+  const auto offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(dx));
+  const auto wy = _mm256_set1_epi32(static_cast<int>((256 - fy) | fy << 16));
+  const auto fraction = _mm256_set1_epi32(0xff);
+  size_t n = 0;
+  for (; n + 8 <= dst_width && ((x + 7 * dx) >> 16) + 3 < src_width; n += 8, x += 8 * dx) {
+    const auto xs = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(x)), offsets);
+    const auto index = _mm256_srli_epi32(xs, 16);
+    const auto wx = weights8(_mm256_and_si256(_mm256_srli_epi32(xs, 8), fraction));
+    const auto top = _mm256_i32gather_epi32(reinterpret_cast<const int*>(row0), index, 1);
+    const auto bottom = _mm256_i32gather_epi32(reinterpret_cast<const int*>(row1), index, 1);
+    const auto h0 = lerp8(_mm256_shuffle_epi8(top, pair), wx);
+    const auto h1 = lerp8(_mm256_shuffle_epi8(bottom, pair), wx);
+    const auto value = lerp8(_mm256_or_si256(h0, _mm256_slli_epi32(h1, 16)), wy);
+    auto packed = _mm256_packus_epi16(_mm256_packus_epi32(value, value), _mm256_setzero_si256());
+    packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 2, 3, 5, 6, 7));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + n), _mm256_castsi256_si128(packed));
+  }
+  scalar::scale_row8(row0, row1, fy, dst + n, dst_width - n, x, dx, src_width);
+}
+
+ANBOX_IMAGE_TARGET_AVX2 inline void scale_row32(const uint8_t* row0, const uint8_t* row1, uint32_t fy,
+                                                uint8_t* dst, size_t dst_width, uint32_t x, uint32_t dx,
+                                                size_t src_width) {
+  const auto offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(dx));
+  const auto wy = _mm256_set1_epi32(static_cast<int>((256 - fy) | fy << 16));
+  const auto mask = _mm256_set1_epi32(0xff);
+  const auto one = _mm256_set1_epi32(1);
+  auto rows = [](const uint8_t* row) { return reinterpret_cast<const int*>(row); };
+  size_t n = 0;
+  for (; n + 8 <= dst_width && ((x + 7 * dx) >> 16) + 1 < src_width; n += 8, x += 8 * dx) {
+    const auto xs = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(x)), offsets);
+    const auto index = _mm256_srli_epi32(xs, 16);
+    const auto wx = weights8(_mm256_and_si256(_mm256_srli_epi32(xs, 8), mask));
+    const auto a0 = _mm256_i32gather_epi32(rows(row0), index, 4);
+    const auto b0 = _mm256_i32gather_epi32(rows(row0), _mm256_add_epi32(index, one), 4);
+    const auto a1 = _mm256_i32gather_epi32(rows(row1), index, 4);
+    const auto b1 = _mm256_i32gather_epi32(rows(row1), _mm256_add_epi32(index, one), 4);
+    auto pixels = _mm256_setzero_si256();
+    for (int c = 0; c < 4; c++) {
+      const auto shift = _mm256_set1_epi32(8 * c);
+      const auto top = _mm256_or_si256(_mm256_and_si256(_mm256_srlv_epi32(a0, shift), mask),
+                                       _mm256_slli_epi32(_mm256_and_si256(_mm256_srlv_epi32(b0, shift), mask), 16));
+      const auto bottom = _mm256_or_si256(_mm256_and_si256(_mm256_srlv_epi32(a1, shift), mask),
+                                          _mm256_slli_epi32(_mm256_and_si256(_mm256_srlv_epi32(b1, shift), mask), 16));
+      const auto pair = _mm256_or_si256(lerp8(top, wx), _mm256_slli_epi32(lerp8(bottom, wx), 16));
+      pixels = _mm256_or_si256(pixels, _mm256_sllv_epi32(lerp8(pair, wy), shift));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * n), pixels);
+  }
+  scalar::scale_row32(row0, row1, fy, dst + 4 * n, dst_width - n, x, dx, src_width);
+}
+} // namespace avx2
+#endif
+
+#if defined(ANBOX_IMAGE_HAVE_NEON)
+namespace neon {
+inline uint8x8_t yuv_to_channel(int16x8_t c, int16x8_t d, int16x8_t e, int16_t cd, int16_t ce) {
+  auto sum = vqaddq_s16(c, vmulq_n_s16(d, cd));
+  sum = vqaddq_s16(sum, vmulq_n_s16(e, ce));
+  return vqmovun_s16(vshrq_n_s16(sum, 6));
+}
+
+inline void i420_to_rgba_row(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, size_t width) {
+  size_t n = 0;
+  for (; n + 16 <= width; n += 16) {
+    const auto luma = vld1q_u8(y + n);
+    const auto u8 = vld1_u8(u + n / 2);
+    const auto v8 = vld1_u8(v + n / 2);
+    const uint8x8_t us[2] = {vzip_u8(u8, u8).val[0], vzip_u8(u8, u8).val[1]};
+    const uint8x8_t vs[2] = {vzip_u8(v8, v8).val[0], vzip_u8(v8, v8).val[1]};
+    const uint8x8_t ys[2] = {vget_low_u8(luma), vget_high_u8(luma)};
+    uint8x8_t r[2], g[2], b[2];
+    for (int h = 0; h < 2; h++) {
+      const auto l = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(ys[h])), vdupq_n_s16(16));
+      const auto c = vaddq_s16(vaddq_s16(vmulq_n_s16(l, 74), vshrq_n_s16(l, 1)), vdupq_n_s16(32));
+      const auto d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(us[h])), vdupq_n_s16(128));
+      const auto e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vs[h])), vdupq_n_s16(128));
+      r[h] = yuv_to_channel(c, d, e, 0, 102);
+      g[h] = yuv_to_channel(c, d, e, -25, -52);
+      b[h] = yuv_to_channel(c, d, e, 129, 0);
+    }
+    uint8x16x4_t pixels;
+    pixels.val[0] = vcombine_u8(r[0], r[1]);
+    pixels.val[1] = vcombine_u8(g[0], g[1]);
+    pixels.val[2] = vcombine_u8(b[0], b[1]);
+    pixels.val[3] = vdupq_n_u8(255);
+    vst4q_u8(rgba + 4 * n, pixels);
+  }
+  scalar::i420_to_rgba_row(y + n, u + n / 2, v + n / 2, rgba + 4 * n, width - n);
+}
+
+inline uint8x8_t rgb_to_luma(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+  auto sum = vmull_u8(r, vdup_n_u8(66));
+  sum = vmlal_u8(sum, g, vdup_n_u8(129));
+  sum = vmlal_u8(sum, b, vdup_n_u8(25));
+  return vadd_u8(vshrn_n_u16(vaddq_u16(sum, vdupq_n_u16(128)), 8), vdup_n_u8(16));
+}
+
+inline void rgba_to_y_row(const uint8_t* rgba, uint8_t* y, size_t width) {
+  size_t n = 0;
+  for (; n + 16 <= width; n += 16) {
+    const auto pixels = vld4q_u8(rgba + 4 * n);
+    const auto lo = rgb_to_luma(vget_low_u8(pixels.val[0]), vget_low_u8(pixels.val[1]), vget_low_u8(pixels.val[2]));
+    const auto hi = rgb_to_luma(vget_high_u8(pixels.val[0]), vget_high_u8(pixels.val[1]),
+                                vget_high_u8(pixels.val[2]));
+    vst1q_u8(y + n, vcombine_u8(lo, hi));
+  }
+  scalar::rgba_to_y_row(rgba + 4 * n, y + n, width - n);
+}
+
+inline uint8x8_t rgb_to_chroma(int16x8_t r, int16x8_t g, int16x8_t b, int16_t cr, int16_t cg, int16_t cb) {
+  auto sum = vaddq_s16(vmulq_n_s16(r, cr), vmulq_n_s16(g, cg));
+  sum = vaddq_s16(sum, vaddq_s16(vmulq_n_s16(b, cb), vdupq_n_s16(128)));
+  return vqmovun_s16(vaddq_s16(vshrq_n_s16(sum, 8), vdupq_n_s16(128)));
+}
+
+inline void rgba_to_uv_row(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* u, uint8_t* v, size_t width) {
+  size_t n = 0;
+  for (; n + 16 <= width; n += 16) {
+    const auto p0 = vld4q_u8(rgba0 + 4 * n);
+    const auto p1 = vld4q_u8(rgba1 + 4 * n);
+    int16x8_t rgb[3];
+    for (int c = 0; c < 3; c++) {
+      const auto sum = vaddq_u16(vpaddlq_u8(p0.val[c]), vpaddlq_u8(p1.val[c]));
+      rgb[c] = vreinterpretq_s16_u16(vshrq_n_u16(vaddq_u16(sum, vdupq_n_u16(2)), 2));
+    }
+    vst1_u8(u + n / 2, rgb_to_chroma(rgb[0], rgb[1], rgb[2], -38, -74, 112));
+    vst1_u8(v + n / 2, rgb_to_chroma(rgb[0], rgb[1], rgb[2], 112, -94, -18));
+  }
+  scalar::rgba_to_uv_row(rgba0 + 4 * n, rgba1 + 4 * n, u + n / 2, v + n / 2, width - n);
+}
+
+inline void split_uv_row(const uint8_t* uv, uint8_t* u, uint8_t* v, size_t count) {
+  size_t n = 0;
+  for (; n + 16 <= count; n += 16) {
+    const auto samples = vld2q_u8(uv + 2 * n);
+    vst1q_u8(u + n, samples.val[0]);
+    vst1q_u8(v + n, samples.val[1]);
+  }
+  scalar::split_uv_row(uv + 2 * n, u + n, v + n, count - n);
+}
+
+inline void merge_uv_row(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t count) {
+  size_t n = 0;
+  for (; n + 16 <= count; n += 16)
+    vst2q_u8(uv + 2 * n, (uint8x16x2_t{{vld1q_u8(u + n), vld1q_u8(v + n)}}));
+  scalar::merge_uv_row(u + n, v + n, uv + 2 * n, count - n);
+}
+
+inline void mirror_row8(const uint8_t* src, uint8_t* dst, size_t count) {
+  size_t n = 0;
+  for (; n + 16 <= count; n += 16) {
+    const auto samples = vrev64q_u8(vld1q_u8(src + count - n - 16));
+    vst1q_u8(dst + n, vcombine_u8(vget_high_u8(samples), vget_low_u8(samples)));
+  }
+  scalar::mirror_row8(src, dst + n, count - n);
+}
+
+inline void mirror_row32(const uint8_t* src, uint8_t* dst, size_t count) {
+  size_t n = 0;
+  for (; n + 4 <= count; n += 4) {
+    const auto pixels = vrev64q_u32(vld1q_u32(reinterpret_cast<const uint32_t*>(src + 4 * (count - n - 4))));
+    vst1q_u32(reinterpret_cast<uint32_t*>(dst + 4 * n), vcombine_u32(vget_high_u32(pixels), vget_low_u32(pixels)));
+  }
+  scalar::mirror_row32(src, dst + 4 * n, count - n);
+}
+
+inline void transpose8x8(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride) {
+  uint8x8x2_t a[4];
+  for (int n = 0; n < 4; n++)
+    a[n] = vtrn_u8(vld1_u8(src + 2 * n * src_stride), vld1_u8(src + (2 * n + 1) * src_stride));
+  uint16x4x2_t b[4];
+  for (int n = 0; n < 2; n++) {
+    b[2 * n] = vtrn_u16(vreinterpret_u16_u8(a[2 * n].val[0]), vreinterpret_u16_u8(a[2 * n + 1].val[0]));
+    b[2 * n + 1] = vtrn_u16(vreinterpret_u16_u8(a[2 * n].val[1]), vreinterpret_u16_u8(a[2 * n + 1].val[1]));
+  }
+  // b[0] holds columns 0/4 and 2/6 of rows 0-3, b[1] columns 1/5 and 3/7, b[2] and b[3] the same for rows 4-7
+  const uint32x2x2_t c[4] = {
+    vtrn_u32(vreinterpret_u32_u16(b[0].val[0]), vreinterpret_u32_u16(b[2].val[0])),
+    vtrn_u32(vreinterpret_u32_u16(b[1].val[0]), vreinterpret_u32_u16(b[3].val[0])),
+    vtrn_u32(vreinterpret_u32_u16(b[0].val[1]), vreinterpret_u32_u16(b[2].val[1])),
+    vtrn_u32(vreinterpret_u32_u16(b[1].val[1]), vreinterpret_u32_u16(b[3].val[1])),
+  };
+  for (int n = 0; n < 4; n++) {
+    vst1_u8(dst + n * dst_stride, vreinterpret_u8_u32(c[n].val[0]));
+    vst1_u8(dst + (n + 4) * dst_stride, vreinterpret_u8_u32(c[n].val[1]));
+  }
+}
+
+inline void transpose8(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride,
+                       size_t width, size_t height) {
+  const auto width8 = width & ~size_t{7};
+  const auto height8 = height & ~size_t{7};
+  for (size_t y = 0; y < height8; y += 8) {
+    for (size_t x = 0; x < width8; x += 8)
+      transpose8x8(src + static_cast<ptrdiff_t>(y) * src_stride + x, src_stride,
+                   dst + static_cast<ptrdiff_t>(x) * dst_stride + y, dst_stride);
+  }
+  scalar::transpose8(src + width8, src_stride, dst + static_cast<ptrdiff_t>(width8) * dst_stride,
+                     dst_stride, width - width8, height);
+  scalar::transpose8(src + static_cast<ptrdiff_t>(height8) * src_stride, src_stride, dst + height8,
+                     dst_stride, width8, height - height8);
+}
+
+inline void transpose4x4_32(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride) {
+  uint32x4_t r[4];
+  for (int n = 0; n < 4; n++)
+    r[n] = vld1q_u32(reinterpret_cast<const uint32_t*>(src + n * src_stride));
+  const auto a = vtrnq_u32(r[0], r[1]);
+  const auto b = vtrnq_u32(r[2], r[3]);
+  const uint32x4_t columns[4] = {
+    vcombine_u32(vget_low_u32(a.val[0]), vget_low_u32(b.val[0])),
+    vcombine_u32(vget_low_u32(a.val[1]), vget_low_u32(b.val[1])),
+    vcombine_u32(vget_high_u32(a.val[0]), vget_high_u32(b.val[0])),
+    vcombine_u32(vget_high_u32(a.val[1]), vget_high_u32(b.val[1])),
+  };
+  for (int n = 0; n < 4; n++)
+    vst1q_u32(reinterpret_cast<uint32_t*>(dst + n * dst_stride), columns[n]);
+}
+
+inline void transpose32(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride,
+                        size_t width, size_t height) {
+  const auto width4 = width & ~size_t{3};
+  const auto height4 = height & ~size_t{3};
+  for (size_t y = 0; y < height4; y += 4) {
+    for (size_t x = 0; x < width4; x += 4)
+      transpose4x4_32(src + static_cast<ptrdiff_t>(y) * src_stride + 4 * x, src_stride,
+                      dst + static_cast<ptrdiff_t>(x) * dst_stride + 4 * y, dst_stride);
+  }
+  scalar::transpose32(src + 4 * width4, src_stride, dst + static_cast<ptrdiff_t>(width4) * dst_stride,
+                      dst_stride, width - width4, height);
+  scalar::transpose32(src + static_cast<ptrdiff_t>(height4) * src_stride, src_stride, dst + 4 * height4,
+                      dst_stride, width4, height - height4);
+}
+
+// Computes (a * (256 - f) + b * f + 128) >> 8 as a * 256 + (b - a) * f, the
+// 16 bit lanes may wrap in between but the result is exact.
+inline uint8x8_t lerp8(uint8x8_t a, uint8x8_t b, uint8x8_t f) {
+  auto sum = vshll_n_u8(a, 8);
+  sum = vmlsl_u8(sum, a, f);
+  sum = vmlal_u8(sum, b, f);
+  return vrshrn_n_u16(sum, 8);
+}
+
+// NEON has no gather, so the samples of 8 positions are collected on the stack
+inline void scale_row8(const uint8_t* row0, const uint8_t* row1, uint32_t fy, uint8_t* dst, size_t dst_width,
+                       uint32_t x, uint32_t dx, size_t src_width) {
+  const auto wy = vdup_n_u8(static_cast<uint8_t>(fy));
+  size_t n = 0;
+  for (; n + 8 <= dst_width && ((x + 7 * dx) >> 16) + 1 < src_width; n += 8) {
+    uint8_t a0[8], b0[8], a1[8], b1[8], f[8];
+    for (int i = 0; i < 8; i++, x += dx) {
+      const auto x0 = x >> 16;
+      a0[i] = row0[x0];
+      b0[i] = row0[x0 + 1];
+      a1[i] = row1[x0];
+      b1[i] = row1[x0 + 1];
+      f[i] = static_cast<uint8_t>(x >> 8);
+    }
+    const auto wx = vld1_u8(f);
+    const auto top = lerp8(vld1_u8(a0), vld1_u8(b0), wx);
+    const auto bottom = lerp8(vld1_u8(a1), vld1_u8(b1), wx);
+    vst1_u8(dst + n, lerp8(top, bottom, wy));
+  }
+  scalar::scale_row8(row0, row1, fy, dst + n, dst_width - n, x, dx, src_width);
+}
+
+inline void scale_row32(const uint8_t* row0, const uint8_t* row1, uint32_t fy, uint8_t* dst, size_t dst_width,
+                        uint32_t x, uint32_t dx, size_t src_width) {
+  const auto wy = vdup_n_u8(static_cast<uint8_t>(fy));
+  size_t n = 0;
+  for (; n + 8 <= dst_width && ((x + 7 * dx) >> 16) + 1 < src_width; n += 8) {
+    uint32_t a0[8], b0[8], a1[8], b1[8];
+    uint8_t f[8];
+    for (int i = 0; i < 8; i++, x += dx) {
+      const auto x0 = 4 * (x >> 16);
+      memcpy(&a0[i], row0 + x0, 4);
+      memcpy(&b0[i], row0 + x0 + 4, 4);
+      memcpy(&a1[i], row1 + x0, 4);
+      memcpy(&b1[i], row1 + x0 + 4, 4);
+      f[i] = static_cast<uint8_t>(x >> 8);
+    }
+    const auto wx = vld1_u8(f);
+    const auto pa0 = vld4_u8(reinterpret_cast<const uint8_t*>(a0));
+    const auto pb0 = vld4_u8(reinterpret_cast<const uint8_t*>(b0));
+    const auto pa1 = vld4_u8(reinterpret_cast<const uint8_t*>(a1));
+    const auto pb1 = vld4_u8(reinterpret_cast<const uint8_t*>(b1));
+    uint8x8x4_t pixels;
+    for (int c = 0; c < 4; c++)
+      pixels.val[c] = lerp8(lerp8(pa0.val[c], pb0.val[c], wx), lerp8(pa1.val[c], pb1.val[c], wx), wy);
+    vst4_u8(dst + 4 * n, pixels);
+  }
+  scalar::scale_row32(row0, row1, fy, dst + 4 * n, dst_width - n, x, dx, src_width);
+}
+} // namespace neon
+#endif
+
+#define ANBOX_IMAGE_KERNELS(level, ns) \
+  Kernels{level, #ns, &internal::ns::i420_to_rgba_row, &internal::ns::rgba_to_y_row, \
+          &internal::ns::rgba_to_uv_row, &internal::ns::split_uv_row, &internal::ns::merge_uv_row, \
+          &internal::ns::mirror_row8, &internal::ns::mirror_row32, &internal::ns::transpose8, \
+          &internal::ns::transpose32, &internal::ns::scale_row8, &internal::ns::scale_row32}
+
+inline SimdLevel detect_simd_level() {
+#if defined(ANBOX_IMAGE_HAVE_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SimdLevel::AVX2;
+  return SimdLevel::Scalar;
+#elif defined(ANBOX_IMAGE_HAVE_NEON)
+  return SimdLevel::NEON;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+inline bool valid_plane(const uint8_t* data, size_t stride, size_t row_bytes) {
+  return data && stride >= row_bytes;
+}
+
+inline int rotate(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                  uint32_t width, uint32_t height, Rotation rotation, size_t pixel_size, const Kernels& k) {
+  const auto rotated = rotation == Rotation::Rotate90 || rotation == Rotation::Rotate270;
+  if (width == 0 || height == 0 || !valid_plane(src, src_stride, width * pixel_size) ||
+      !valid_plane(dst, dst_stride, (rotated ? height : width) * pixel_size))
+    return -EINVAL;
+
+  const auto transpose = pixel_size == 4 ? k.transpose32 : k.transpose8;
+  const auto mirror = pixel_size == 4 ? k.mirror_row32 : k.mirror_row8;
+  const auto ss = static_cast<ptrdiff_t>(src_stride);
+  const auto ds = static_cast<ptrdiff_t>(dst_stride);
+  switch (rotation) {
+  case Rotation::Rotate0:
+    for (uint32_t y = 0; y < height; y++)
+      memcpy(dst + y * ds, src + y * ss, width * pixel_size);
+    return 0;
+  case Rotation::Rotate90:
+    // Reading the source bottom up turns the transposition into a clockwise rotation
+    transpose(src + (height - 1) * ss, -ss, dst, ds, width, height);
+    return 0;
+  case Rotation::Rotate180:
+    for (uint32_t y = 0; y < height; y++)
+      mirror(src + (height - 1 - y) * ss, dst + y * ds, width);
+    return 0;
+  case Rotation::Rotate270:
+    transpose(src, ss, dst + (width - 1) * ds, -ds, width, height);
+    return 0;
+  default:
+    return -EINVAL;
+  }
+}
+
+inline int scale(const uint8_t* src, size_t src_stride, uint32_t src_width, uint32_t src_height,
+                 uint8_t* dst, size_t dst_stride, uint32_t dst_width, uint32_t dst_height,
+                 size_t pixel_size, const Kernels& k) {
+  if (dst_width == 0 || dst_height == 0 || dst_width > src_width || dst_height > src_height ||
+      src_width > max_scale_size || src_height > max_scale_size ||
+      !valid_plane(src, src_stride, src_width * pixel_size) || !valid_plane(dst, dst_stride, dst_width * pixel_size))
+    return -EINVAL;
+
+  // Pixel centers of the destination are mapped onto the source, which
+  // never goes below 0 when downscaling.
+  const uint32_t dx = (src_width << 16) / dst_width;
+  const uint32_t dy = (src_height << 16) / dst_height;
+  const uint32_t x = dx / 2 - 0x8000;
+  uint32_t y = dy / 2 - 0x8000;
+  const auto scale_row = pixel_size == 4 ? k.scale_row32 : k.scale_row8;
+  for (uint32_t n = 0; n < dst_height; n++, y += dy) {
+    const auto y0 = y >> 16;
+    const auto y1 = std::min(y0 + 1, src_height - 1);
+    scale_row(src + y0 * src_stride, src + y1 * src_stride, (y >> 8) & 0xff, dst + n * dst_stride,
+              dst_width, x, dx, src_width);
+  }
+  return 0;
+}
+} // namespace internal
+
+/**
+ * @brief Get the kernels implemented with a specific instruction set.
+ *
+ * This is mostly useful for tests and benchmarks, everything else should
+ * use kernels() which picks the best implementation for the running CPU.
+ *
+ * @param level the instruction set of the kernels.
+ * @return the kernels or nullptr if \a level is not supported by the build or the CPU.
+ */
+inline const Kernels* kernels_for(SimdLevel level) {
+  static const Kernels scalar_kernels = ANBOX_IMAGE_KERNELS(SimdLevel::Scalar, scalar);
+#if defined(ANBOX_IMAGE_HAVE_X86)
+  static const Kernels avx2_kernels = ANBOX_IMAGE_KERNELS(SimdLevel::AVX2, avx2);
+#elif defined(ANBOX_IMAGE_HAVE_NEON)
+  static const Kernels neon_kernels = ANBOX_IMAGE_KERNELS(SimdLevel::NEON, neon);
+#endif
+
+  switch (level) {
+  case SimdLevel::Scalar:
+    return &scalar_kernels;
+#if defined(ANBOX_IMAGE_HAVE_X86)
+  case SimdLevel::AVX2:
+    return internal::detect_simd_level() == SimdLevel::AVX2 ? &avx2_kernels : nullptr;
+#elif defined(ANBOX_IMAGE_HAVE_NEON)
+  case SimdLevel::NEON:
+    return &neon_kernels;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+/**
+ * @brief Get the best kernels for the running CPU. The CPU is only probed on the first call.
+ */
+inline const Kernels& kernels() {
+  static const Kernels* best = kernels_for(internal::detect_simd_level());
+  return *best;
+}
+
+/**
+ * @brief Convert an I420 image to RGBA.
+ *
+ * The chroma planes have a size of (\a width + 1) / 2 x (\a height + 1) / 2.
+ *
+ * @return 0 on success or -EINVAL if a plane is missing or its stride is too small.
+ */
+inline int i420_to_rgba(const uint8_t* src_y, size_t src_y_stride, const uint8_t* src_u, size_t src_u_stride,
+                        const uint8_t* src_v, size_t src_v_stride, uint8_t* dst_rgba, size_t dst_rgba_stride,
+                        uint32_t width, uint32_t height, const Kernels& k = kernels()) {
+  const size_t chroma_width = (width + 1) / 2;
+  if (width == 0 || height == 0 || !internal::valid_plane(src_y, src_y_stride, width) ||
+      !internal::valid_plane(src_u, src_u_stride, chroma_width) ||
+      !internal::valid_plane(src_v, src_v_stride, chroma_width) ||
+      !internal::valid_plane(dst_rgba, dst_rgba_stride, 4 * size_t{width}))
+    return -EINVAL;
+
+  for (uint32_t y = 0; y < height; y++)
+    k.i420_to_rgba_row(src_y + y * src_y_stride, src_u + y / 2 * src_u_stride, src_v + y / 2 * src_v_stride,
+                       dst_rgba + y * dst_rgba_stride, width);
+  return 0;
+}
+
+/**
+ * @brief Convert an RGBA image to I420, the chroma of every 2x2 block of pixels is averaged.
+ *
+ * @return 0 on success or -EINVAL if a plane is missing or its stride is too small.
+ */
+inline int rgba_to_i420(const uint8_t* src_rgba, size_t src_rgba_stride, uint8_t* dst_y, size_t dst_y_stride,
+                        uint8_t* dst_u, size_t dst_u_stride, uint8_t* dst_v, size_t dst_v_stride,
+                        uint32_t width, uint32_t height, const Kernels& k = kernels()) {
+  const size_t chroma_width = (width + 1) / 2;
+  if (width == 0 || height == 0 || !internal::valid_plane(src_rgba, src_rgba_stride, 4 * size_t{width}) ||
+      !internal::valid_plane(dst_y, dst_y_stride, width) ||
+      !internal::valid_plane(dst_u, dst_u_stride, chroma_width) ||
+      !internal::valid_plane(dst_v, dst_v_stride, chroma_width))
+    return -EINVAL;
+
+  for (uint32_t y = 0; y < height; y++)
+    k.rgba_to_y_row(src_rgba + y * src_rgba_stride, dst_y + y * dst_y_stride, width);
+  for (uint32_t y = 0; y < (height + 1) / 2; y++) {
+    const auto row0 = src_rgba + 2 * y * src_rgba_stride;
+    const auto row1 = 2 * y + 1 < height ? row0 + src_rgba_stride : row0;
+    k.rgba_to_uv_row(row0, row1, dst_u + y * dst_u_stride, dst_v + y * dst_v_stride, width);
+  }
+  return 0;
+}
+
+/**
+ * @brief Convert an NV12 image to I420.
+ *
+ * @return 0 on success or -EINVAL if a plane is missing or its stride is too small.
+ */
+inline int nv12_to_i420(const uint8_t* src_y, size_t src_y_stride, const uint8_t* src_uv, size_t src_uv_stride,
+                        uint8_t* dst_y, size_t dst_y_stride, uint8_t* dst_u, size_t dst_u_stride,
+                        uint8_t* dst_v, size_t dst_v_stride, uint32_t width, uint32_t height,
+                        const Kernels& k = kernels()) {
+  const size_t chroma_width = (width + 1) / 2;
+  if (width == 0 || height == 0 || !internal::valid_plane(src_y, src_y_stride, width) ||
+      !internal::valid_plane(src_uv, src_uv_stride, 2 * chroma_width) ||
+      !internal::valid_plane(dst_y, dst_y_stride, width) ||
+      !internal::valid_plane(dst_u, dst_u_stride, chroma_width) ||
+      !internal::valid_plane(dst_v, dst_v_stride, chroma_width))
+    return -EINVAL;
+
+  for (uint32_t y = 0; y < height; y++)
+    memcpy(dst_y + y * dst_y_stride, src_y + y * src_y_stride, width);
+  for (uint32_t y = 0; y < (height + 1) / 2; y++)
+    k.split_uv_row(src_uv + y * src_uv_stride, dst_u + y * dst_u_stride, dst_v + y * dst_v_stride, chroma_width);
+  return 0;
+}
+
+/**
+ * @brief Convert an I420 image to NV12.
+ *
+ * @return 0 on success or -EINVAL if a plane is missing or its stride is too small.
+ */
+inline int i420_to_nv12(const uint8_t* src_y, size_t src_y_stride, const uint8_t* src_u, size_t src_u_stride,
+                        const uint8_t* src_v, size_t src_v_stride, uint8_t* dst_y, size_t dst_y_stride,
+                        uint8_t* dst_uv, size_t dst_uv_stride, uint32_t width, uint32_t height,
+                        const Kernels& k = kernels()) {
+  const size_t chroma_width = (width + 1) / 2;
+  if (width == 0 || height == 0 || !internal::valid_plane(src_y, src_y_stride, width) ||
+      !internal::valid_plane(src_u, src_u_stride, chroma_width) ||
+      !internal::valid_plane(src_v, src_v_stride, chroma_width) ||
+      !internal::valid_plane(dst_y, dst_y_stride, width) ||
+      !internal::valid_plane(dst_uv, dst_uv_stride, 2 * chroma_width))
+    return -EINVAL;
+
+  for (uint32_t y = 0; y < height; y++)
+    memcpy(dst_y + y * dst_y_stride, src_y + y * src_y_stride, width);
+  for (uint32_t y = 0; y < (height + 1) / 2; y++)
+    k.merge_uv_row(src_u + y * src_u_stride, src_v + y * src_v_stride, dst_uv + y * dst_uv_stride, chroma_width);
+  return 0;
+}
+
+/**
+ * @brief Rotate a plane of 8 bit samples clockwise.
+ *
+ * The rotated plane is \a height x \a width samples large for Rotation::Rotate90
+ * and Rotation::Rotate270. Rotating in place is not supported.
+ *
+ * @return 0 on success or -EINVAL if a plane is missing or its stride is too small.
+ */
+inline int rotate_plane(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                        uint32_t width, uint32_t height, Rotation rotation, const Kernels& k = kernels()) {
+  return internal::rotate(src, src_stride, dst, dst_stride, width, height, rotation, 1, k);
+}
+
+/**
+ * @brief Rotate an RGBA image clockwise, see rotate_plane().
+ */
+inline int rotate_rgba(const uint8_t* src, size_t src_stride, uint8_t* dst, size_t dst_stride,
+                       uint32_t width, uint32_t height, Rotation rotation, const Kernels& k = kernels()) {
+  return internal::rotate(src, src_stride, dst, dst_stride, width, height, rotation, 4, k);
+}
+
+/**
+ * @brief Rotate an I420 image clockwise, see rotate_plane().
+ */
+inline int rotate_i420(const uint8_t* src_y, size_t src_y_stride, const uint8_t* src_u, size_t src_u_stride,
+                       const uint8_t* src_v, size_t src_v_stride, uint8_t* dst_y, size_t dst_y_stride,
+                       uint8_t* dst_u, size_t dst_u_stride, uint8_t* dst_v, size_t dst_v_stride,
+                       uint32_t width, uint32_t height, Rotation rotation, const Kernels& k = kernels()) {
+  const auto chroma_width = (width + 1) / 2;
+  const auto chroma_height = (height + 1) / 2;
+  auto ret = rotate_plane(src_y, src_y_stride, dst_y, dst_y_stride, width, height, rotation, k);
+  if (ret == 0)
+    ret = rotate_plane(src_u, src_u_stride, dst_u, dst_u_stride, chroma_width, chroma_height, rotation, k);
+  if (ret == 0)
+    ret = rotate_plane(src_v, src_v_stride, dst_v, dst_v_stride, chroma_width, chroma_height, rotation, k);
+  return ret;
+}
+
+/**
+ * @brief Downscale a plane of 8 bit samples with bilinear interpolation.
+ *
+ * Every destination sample interpolates the 2x2 source samples around its
+ * center, so details get lost when shrinking to less than half of the size.
+ *
+ * @return 0 on success or -EINVAL if a plane is missing or its stride is too
+ * small or the destination is larger than the source or the source is larger
+ * than 32768 samples in any direction.
+ */
+inline int scale_plane(const uint8_t* src, size_t src_stride, uint32_t src_width, uint32_t src_height,
+                       uint8_t* dst, size_t dst_stride, uint32_t dst_width, uint32_t dst_height,
+                       const Kernels& k = kernels()) {
+  return internal::scale(src, src_stride, src_width, src_height, dst, dst_stride, dst_width, dst_height, 1, k);
+}
+
+/**
+ * @brief Downscale an RGBA image with bilinear interpolation, see scale_plane().
+ */
+inline int scale_rgba(const uint8_t* src, size_t src_stride, uint32_t src_width, uint32_t src_height,
+                      uint8_t* dst, size_t dst_stride, uint32_t dst_width, uint32_t dst_height,
+                      const Kernels& k = kernels()) {
+  return internal::scale(src, src_stride, src_width, src_height, dst, dst_stride, dst_width, dst_height, 4, k);
+}
+
+/**
+ * @brief Downscale an I420 image with bilinear interpolation, see scale_plane().
+ */
+inline int scale_i420(const uint8_t* src_y, size_t src_y_stride, const uint8_t* src_u, size_t src_u_stride,
+                      const uint8_t* src_v, size_t src_v_stride, uint32_t src_width, uint32_t src_height,
+                      uint8_t* dst_y, size_t dst_y_stride, uint8_t* dst_u, size_t dst_u_stride,
+                      uint8_t* dst_v, size_t dst_v_stride, uint32_t dst_width, uint32_t dst_height,
+                      const Kernels& k = kernels()) {
+  const auto src_chroma_width = (src_width + 1) / 2;
+  const auto src_chroma_height = (src_height + 1) / 2;
+  const auto dst_chroma_width = (dst_width + 1) / 2;
+  const auto dst_chroma_height = (dst_height + 1) / 2;
+  auto ret = scale_plane(src_y, src_y_stride, src_width, src_height, dst_y, dst_y_stride,
+                         dst_width, dst_height, k);
+  if (ret == 0)
+    ret = scale_plane(src_u, src_u_stride, src_chroma_width, src_chroma_height, dst_u, dst_u_stride,
+                      dst_chroma_width, dst_chroma_height, k);
+  if (ret == 0)
+    ret = scale_plane(src_v, src_v_stride, src_chroma_width, src_chroma_height, dst_v, dst_v_stride,
+                      dst_chroma_width, dst_chroma_height, k);
+  return ret;
+}
+} // namespace image
+} // namespace anbox
+
+#undef ANBOX_IMAGE_KERNELS
+
+#endif
@@ -28,6 +28,24 @@ endif()
 get_filename_component(SELF_DIR "${CMAKE_CURRENT_LIST_FILE}" PATH)
 include(${SELF_DIR}/module/anbox-platform-sdk.cmake)
 
+option(ANBOX_PLATFORM_SDK_NO_EXCEPTIONS "Dispatch C API calls without exception guards" OFF)
+if(ANBOX_PLATFORM_SDK_NO_EXCEPTIONS)
+  set_property(TARGET anbox-platform-sdk-internal APPEND PROPERTY
+    INTERFACE_COMPILE_DEFINITIONS ANBOX_PLATFORM_SDK_NO_EXCEPTIONS)
+endif()
+
+option(ANBOX_PLATFORM_SDK_CALL_STATS "Collect latency statistics of C API calls" OFF)
+if(ANBOX_PLATFORM_SDK_CALL_STATS)
+  set_property(TARGET anbox-platform-sdk-internal APPEND PROPERTY
+    INTERFACE_COMPILE_DEFINITIONS ANBOX_PLATFORM_SDK_CALL_STATS)
+endif()
+
+option(ANBOX_PLATFORM_SDK_NEON "Build the NEON kernels of the SDK helpers on AArch64" OFF)
+if(ANBOX_PLATFORM_SDK_NEON)
+  set_property(TARGET anbox-platform-sdk-internal APPEND PROPERTY
+    INTERFACE_COMPILE_DEFINITIONS ANBOX_PLATFORM_SDK_NEON)
+endif()
+
 get_filename_component(ANBOX_SDK_LIB_PATH "${SELF_DIR}" DIRECTORY)
 get_filename_component(ANBOX_SDK_PATH "${ANBOX_SDK_LIB_PATH}" DIRECTORY)
 
@@ -37,6 +55,7 @@ include(ExternalProject)
 ExternalProject_Add(ANBOX_PLATFORM_TESTER_PROJECT
   SOURCE_DIR ${ANBOX_SDK_PATH}/tool
   CMAKE_ARGS += -DCMAKE_INSTALL_PREFIX=${CMAKE_CURRENT_BINARY_DIR} -DCMAKE_BUILD_TYPE=${CMAKE_BUILD_TYPE}
+                -DANBOX_PLATFORM_SDK_NEON=${ANBOX_PLATFORM_SDK_NEON}
 )
 
 set(ANBOX_PLATFORM_TESTER "${CMAKE_CURRENT_BINARY_DIR}/bin/anbox-platform-tester"
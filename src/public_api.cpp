@@ -17,10 +17,89 @@
  */
 
 #include "anbox-platform-sdk/plugin.h"
+#include "anbox-platform-sdk/trace.h"
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <utility>
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Plugins built with -fno-exceptions can't use try/catch at all and plugins
+// which guarantee that none of their processor methods throw don't need to
+// pay for it. In both cases the C API calls directly into the plugin.
+#if defined(ANBOX_PLATFORM_SDK_NO_EXCEPTIONS) || !(defined(__cpp_exceptions) || defined(__EXCEPTIONS))
+#define ANBOX_PLATFORM_SDK_DIRECT_DISPATCH 1
+#endif
 
 namespace {
+constexpr const int64_t log_interval_ns{1000000000};
+constexpr const uint32_t max_logs_per_interval{10};
+constexpr const size_t max_log_message_size{512};
+
+std::atomic<int64_t> log_interval_start{0};
+std::atomic<uint32_t> log_count{0};
+std::atomic<uint32_t> log_suppressed{0};
+
+// Log an error message to stderr without taking any lock or flushing any
+// stream buffer. At most max_logs_per_interval messages are written per
+// interval so a misbehaving plugin can't stall its callers with logging.
+void log_error(const char* format, ...) noexcept __attribute__((format(printf, 1, 2), unused));
+void log_error(const char* format, ...) noexcept {
+  const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+
+  char message[max_log_message_size];
+  int size = 0;
+
+  auto start = log_interval_start.load(std::memory_order_relaxed);
+  if (now - start >= log_interval_ns &&
+      log_interval_start.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+    log_count.store(0, std::memory_order_relaxed);
+    const auto suppressed = log_suppressed.exchange(0, std::memory_order_relaxed);
+    if (suppressed > 0)
+      size = snprintf(message, sizeof(message),
+                      "Anbox Platform SDK suppressed %u messages\n", suppressed);
+  }
+
+  if (log_count.fetch_add(1, std::memory_order_relaxed) >= max_logs_per_interval) {
+    log_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  va_list args;
+  va_start(args, format);
+  const auto ret = vsnprintf(message + size, sizeof(message) - size - 1, format, args);
+  va_end(args);
+  if (ret < 0)
+    return;
+
+  size += std::min<int>(ret, sizeof(message) - size - 2);
+  message[size++] = '\n';
+  while (::write(STDERR_FILENO, message, size) < 0 && errno == EINTR) {}
+}
+
+#ifdef ANBOX_PLATFORM_SDK_DIRECT_DISPATCH
+// Without exception support the helpers below forward the call directly. An
+// exception escaping a plugin built with exceptions enabled anyway ends up
+// in std::terminate as the helpers are noexcept.
+template <typename Func, typename DefaultValue>
+inline auto exception_safe_call(Func&& func, DefaultValue&& default_value) noexcept
+  -> decltype(func()) {
+  (void) default_value;
+  return func();
+}
+
+template <typename Func>
+inline void exception_safe_call_void(Func&& func) noexcept {
+  func();
+}
+#else
 // Helper function to call a function and return a default value in case of
 // exceptions
 template <typename Func, typename DefaultValue>
@@ -29,11 +108,10 @@ auto exception_safe_call(Func&& func, DefaultValue&& default_value) noexcept
   try {
     return func();
   } catch (const std::exception& e) {
-    std::cerr << "Anbox Platform SDK caught exception: " << e.what()
-              << std::endl;
+    log_error("Anbox Platform SDK caught exception: %s", e.what());
     return std::forward<DefaultValue>(default_value);
   } catch (...) {
-    std::cerr << "Anbox Platform SDK caught unknown exception." << std::endl;
+    log_error("Anbox Platform SDK caught unknown exception.");
     return std::forward<DefaultValue>(default_value);
   }
 }
@@ -44,34 +122,163 @@ void exception_safe_call_void(Func&& func) noexcept {
   try {
     func();
   } catch (const std::exception& e) {
-    std::cerr << "Anbox Platform SDK caught exception: " << e.what()
-              << std::endl;
+    log_error("Anbox Platform SDK caught exception: %s", e.what());
   } catch (...) {
-    std::cerr << "Anbox Platform SDK caught unknown exception." << std::endl;
+    log_error("Anbox Platform SDK caught unknown exception.");
   }
 }
+#endif
+
+#ifdef ANBOX_PLATFORM_SDK_CALL_STATS
+// Log-linear latency histogram in the style of HdrHistogram. Values below
+// sub_bucket_count are recorded exactly, larger values are grouped by their
+// most significant bit and split into sub_bucket_count linear sub-buckets,
+// which bounds the relative error of every reported value to 1/8.
+class LatencyHistogram {
+ public:
+  void record(uint64_t value) {
+    buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    calls_.fetch_add(1, std::memory_order_relaxed);
+    total_.fetch_add(value, std::memory_order_relaxed);
+    auto max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+  }
+
+  void snapshot(AnboxCallStats* stats) const {
+    uint64_t counts[bucket_count];
+    uint64_t total_count = 0;
+    for (size_t n = 0; n < bucket_count; n++) {
+      counts[n] = buckets_[n].load(std::memory_order_relaxed);
+      total_count += counts[n];
+    }
+
+    stats->calls = calls_.load(std::memory_order_relaxed);
+    stats->total_ns = total_.load(std::memory_order_relaxed);
+    stats->max_ns = max_.load(std::memory_order_relaxed);
+    // Buckets only provide an upper bound, the actual maximum is exact
+    stats->p50_ns = std::min(percentile(counts, total_count, 500), stats->max_ns);
+    stats->p90_ns = std::min(percentile(counts, total_count, 900), stats->max_ns);
+    stats->p99_ns = std::min(percentile(counts, total_count, 990), stats->max_ns);
+    stats->p999_ns = std::min(percentile(counts, total_count, 999), stats->max_ns);
+  }
+
+ private:
+  static constexpr int sub_bucket_bits{3};
+  static constexpr uint64_t sub_bucket_count{1 << sub_bucket_bits};
+  static constexpr size_t bucket_count{(64 - sub_bucket_bits + 1) * sub_bucket_count};
+
+  static size_t bucket_index(uint64_t value) {
+    if (value < sub_bucket_count)
+      return value;
+    const int msb = 63 - __builtin_clzll(value);
+    const int shift = msb - sub_bucket_bits;
+    return (shift + 1) * sub_bucket_count + ((value >> shift) & (sub_bucket_count - 1));
+  }
+
+  // Highest value which is recorded into the bucket at the given index
+  static uint64_t bucket_value(size_t index) {
+    if (index < sub_bucket_count)
+      return index;
+    const int shift = index / sub_bucket_count - 1;
+    const uint64_t sub_bucket = sub_bucket_count + index % sub_bucket_count;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+
+  static uint64_t percentile(const uint64_t* counts, uint64_t total_count, uint64_t per_mille) {
+    if (total_count == 0)
+      return 0;
+    const uint64_t rank = std::max<uint64_t>(1, (total_count * per_mille + 999) / 1000);
+    uint64_t seen = 0;
+    for (size_t n = 0; n < bucket_count; n++) {
+      seen += counts[n];
+      if (seen >= rank)
+        return bucket_value(n);
+    }
+    return bucket_value(bucket_count - 1);
+  }
+
+  std::atomic<uint64_t> buckets_[bucket_count]{};
+  std::atomic<uint64_t> calls_{0};
+  std::atomic<uint64_t> total_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+// Statistics of a single exported function. Instances are created on the
+// first call of the function and linked into a lock-free list so they can
+// be enumerated by anbox_platform_get_stats.
+struct CallStats {
+  explicit CallStats(const char* name) : name{name} {
+    auto head = call_stats_head.load(std::memory_order_relaxed);
+    do {
+      next = head;
+    } while (!call_stats_head.compare_exchange_weak(head, this, std::memory_order_release,
+                                                    std::memory_order_relaxed));
+  }
+
+  const char* const name;
+  CallStats* next{nullptr};
+  LatencyHistogram histogram;
+
+  static std::atomic<CallStats*> call_stats_head;
+};
+
+std::atomic<CallStats*> CallStats::call_stats_head{nullptr};
+
+class ScopedCallTimer {
+ public:
+  explicit ScopedCallTimer(CallStats& stats) :
+    stats_{stats}, start_{std::chrono::steady_clock::now()} {}
+  ~ScopedCallTimer() {
+    const auto duration = std::chrono::steady_clock::now() - start_;
+    stats_.histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  }
+  ScopedCallTimer(const ScopedCallTimer &) = delete;
+  ScopedCallTimer& operator=(const ScopedCallTimer &) = delete;
+
+ private:
+  CallStats& stats_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+#define ANBOX_PUBLIC_API_CALL_STATS() \
+  static CallStats call_stats{__func__}; \
+  const ScopedCallTimer call_timer{call_stats}
+#else
+#define ANBOX_PUBLIC_API_CALL_STATS()
+#endif
+
+// Every exported function is traced under the anbox.platform category once
+// Anbox registered its tracer, so the time spent inside the plugin shows up
+// in the trace timeline of the runtime.
+#define ANBOX_PUBLIC_API_CALL() \
+  ANBOX_TRACE_EVENT0("anbox.platform", __func__); \
+  ANBOX_PUBLIC_API_CALL_STATS()
 } // namespace
 
 extern "C" {
 ANBOX_EXPORT const AnboxAudioProcessor* anbox_platform_get_audio_processor(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   if (!platform || !platform->audio_processor.instance)
     return nullptr;
   return &platform->audio_processor;
 }
 
 ANBOX_EXPORT const AnboxInputProcessor* anbox_platform_get_input_processor(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   if (!platform || !platform->input_processor.instance)
     return nullptr;
   return &platform->input_processor;
 }
 
 ANBOX_EXPORT const AnboxGraphicsProcessor* anbox_platform_get_graphics_processor(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   if (!platform || !platform->graphics_processor.instance)
     return nullptr;
   return &platform->graphics_processor;
 }
 
 ANBOX_EXPORT bool anbox_platform_ready(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!platform || !platform->instance)
       return false;
@@ -80,6 +287,7 @@ ANBOX_EXPORT bool anbox_platform_ready(const AnboxPlatform* platform) {
 }
 
 ANBOX_EXPORT int anbox_platform_wait_until_ready(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!platform || !platform->instance)
       return -EINVAL;
@@ -90,6 +298,7 @@ ANBOX_EXPORT int anbox_platform_wait_until_ready(const AnboxPlatform* platform)
 ANBOX_EXPORT int anbox_platform_get_config_item(const AnboxPlatform* platform,
                                                 AnboxPlatformConfigurationKey key,
                                                 void* data, size_t data_size) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!platform || !platform->instance)
       return -EINVAL;
@@ -100,6 +309,7 @@ ANBOX_EXPORT int anbox_platform_get_config_item(const AnboxPlatform* platform,
 ANBOX_EXPORT int anbox_platform_set_config_item(const AnboxPlatform* platform,
                                                 AnboxPlatformConfigurationKey key,
                                                 void* data, size_t data_size) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!platform || !platform->instance)
       return -EINVAL;
@@ -110,6 +320,7 @@ ANBOX_EXPORT int anbox_platform_set_config_item(const AnboxPlatform* platform,
 ANBOX_EXPORT int anbox_platform_set_config_items(const AnboxPlatform* platform,
                                                  const AnboxPlatformConfigurationItem* items,
                                                  size_t count) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!platform || !platform->instance)
       return -EINVAL;
@@ -120,14 +331,19 @@ ANBOX_EXPORT int anbox_platform_set_config_items(const AnboxPlatform* platform,
 ANBOX_EXPORT void anbox_platform_setup_event_tracer(const AnboxPlatform* platform,
                                                     AnboxTracerGetCategoryEnabledFunc get_category_enabled_callback,
                                                     AnboxTracerAddEventFunc add_event_callback) {
+  ANBOX_PUBLIC_API_CALL();
   exception_safe_call_void([&]() {
     if (!platform || !platform->instance)
       return;
+    // Register the tracer for the SDK itself as well, the plugin may
+    // override setup_event_tracer without calling the default implementation.
+    anbox::trace::Tracer::instance().setup(get_category_enabled_callback, add_event_callback);
     platform->instance->setup_event_tracer(get_category_enabled_callback, add_event_callback);
   });
 }
 
 ANBOX_EXPORT int anbox_platform_stop(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!platform || !platform->instance)
       return -EINVAL;
@@ -137,6 +353,7 @@ ANBOX_EXPORT int anbox_platform_stop(const AnboxPlatform* platform) {
 
 ANBOX_EXPORT void anbox_platform_handle_event(const AnboxPlatform* platform,
                                               AnboxEventType type) {
+  ANBOX_PUBLIC_API_CALL();
   exception_safe_call_void([&]() {
     if (!platform || !platform->instance)
       return;
@@ -146,6 +363,7 @@ ANBOX_EXPORT void anbox_platform_handle_event(const AnboxPlatform* platform,
 
 ANBOX_EXPORT AnboxVideoDecoder* anbox_platform_create_video_decoder(const AnboxPlatform* platform,
                                                                     AnboxVideoCodecType codec_type) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() -> AnboxVideoDecoder* {
     if (!platform || !platform->instance)
       return nullptr;
@@ -159,6 +377,7 @@ ANBOX_EXPORT AnboxVideoDecoder* anbox_platform_create_video_decoder(const AnboxP
 ANBOX_EXPORT size_t anbox_audio_processor_process_data(const AnboxAudioProcessor* audio_processor,
                                                        const uint8_t* data,
                                                        size_t size) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!audio_processor || !audio_processor->instance)
       return static_cast<size_t>(0);
@@ -172,25 +391,71 @@ ANBOX_EXPORT size_t anbox_audio_processor_process_data(const AnboxAudioProcessor
 ANBOX_EXPORT ssize_t anbox_audio_processor_write_data(const AnboxAudioProcessor* audio_processor,
                                                       const uint8_t* data,
                                                       size_t size) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!audio_processor || !audio_processor->instance)
       return static_cast<ssize_t>(0);
+    if (audio_processor->dispatch)
+      return audio_processor->dispatch->audio_processor_write_data(audio_processor->instance, data, size);
     return audio_processor->instance->write_data(data, size);
   }, static_cast<ssize_t>(0));
 }
 
+ANBOX_EXPORT ssize_t anbox_audio_processor_write_datav(const AnboxAudioProcessor* audio_processor,
+                                                       const AnboxIoVec* iov,
+                                                       size_t count) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!audio_processor || !audio_processor->instance)
+      return static_cast<ssize_t>(0);
+    if (audio_processor->dispatch)
+      return audio_processor->dispatch->audio_processor_write_datav(audio_processor->instance, iov, count);
+    return audio_processor->instance->write_datav(iov, count);
+  }, static_cast<ssize_t>(0));
+}
+
+ANBOX_EXPORT ssize_t anbox_audio_processor_write_data_timestamped(const AnboxAudioProcessor* audio_processor,
+                                                                  const uint8_t* data,
+                                                                  size_t size,
+                                                                  uint64_t timestamp_ns) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!audio_processor || !audio_processor->instance)
+      return static_cast<ssize_t>(0);
+    if (audio_processor->dispatch)
+      return audio_processor->dispatch->audio_processor_write_data_timestamped(
+          audio_processor->instance, data, size, timestamp_ns);
+    return audio_processor->instance->write_data_timestamped(data, size, timestamp_ns);
+  }, static_cast<ssize_t>(0));
+}
+
+ANBOX_EXPORT int anbox_audio_processor_get_presentation_position(const AnboxAudioProcessor* audio_processor,
+                                                                 uint64_t* frames,
+                                                                 uint64_t* time_ns) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!audio_processor || !audio_processor->instance)
+      return -EINVAL;
+    return audio_processor->instance->get_presentation_position(frames, time_ns);
+  }, -EIO);
+}
+
 ANBOX_EXPORT ssize_t anbox_audio_processor_read_data(const AnboxAudioProcessor* audio_processor,
                                                      uint8_t* data,
                                                      size_t size) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!audio_processor || !audio_processor->instance)
       return static_cast<ssize_t>(0);
+    if (audio_processor->dispatch)
+      return audio_processor->dispatch->audio_processor_read_data(audio_processor->instance, data, size);
     return audio_processor->instance->read_data(data, size);
   }, static_cast<ssize_t>(0));
 }
 
 ANBOX_EXPORT int anbox_audio_processor_activate(const AnboxAudioProcessor* audio_processor,
                                                 AnboxAudioStreamType type) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!audio_processor || !audio_processor->instance)
       return -EINVAL;
@@ -200,6 +465,7 @@ ANBOX_EXPORT int anbox_audio_processor_activate(const AnboxAudioProcessor* audio
 
 ANBOX_EXPORT int anbox_audio_processor_standby(const AnboxAudioProcessor* audio_processor,
                                                AnboxAudioStreamType type) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!audio_processor || !audio_processor->instance)
       return -EINVAL;
@@ -208,6 +474,7 @@ ANBOX_EXPORT int anbox_audio_processor_standby(const AnboxAudioProcessor* audio_
 }
 
 ANBOX_EXPORT bool anbox_audio_processor_need_silence_on_standby(const AnboxAudioProcessor* audio_processor) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!audio_processor || !audio_processor->instance)
       return false;
@@ -218,24 +485,67 @@ ANBOX_EXPORT bool anbox_audio_processor_need_silence_on_standby(const AnboxAudio
 ANBOX_EXPORT int anbox_input_processor_read_event(const AnboxInputProcessor* input_processor,
                                                   AnboxInputEvent* event,
                                                   int timeout) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!input_processor || !input_processor->instance)
       return -EINVAL;
+    if (input_processor->dispatch)
+      return input_processor->dispatch->input_processor_read_event(input_processor->instance, event, timeout);
     return input_processor->instance->read_event(event, timeout);
   }, -EIO);
 }
 
 ANBOX_EXPORT int anbox_input_processor_inject_event(const AnboxInputProcessor* input_processor,
                                                     AnboxInputEvent event) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!input_processor || !input_processor->instance)
       return -EINVAL;
+    if (input_processor->dispatch)
+      return input_processor->dispatch->input_processor_inject_event(input_processor->instance, event);
     return input_processor->instance->inject_event(event);
   }, -EIO);
 }
 
+ANBOX_EXPORT int anbox_input_processor_read_events(const AnboxInputProcessor* input_processor,
+                                                   AnboxInputEvent* events,
+                                                   size_t max_events,
+                                                   int timeout) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!input_processor || !input_processor->instance || !events)
+      return -EINVAL;
+    if (input_processor->dispatch)
+      return input_processor->dispatch->input_processor_read_events(input_processor->instance, events, max_events, timeout);
+    return input_processor->instance->read_events(events, max_events, timeout);
+  }, -EIO);
+}
+
+ANBOX_EXPORT int anbox_input_processor_inject_events(const AnboxInputProcessor* input_processor,
+                                                     const AnboxInputEvent* events,
+                                                     size_t count) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!input_processor || !input_processor->instance)
+      return -EINVAL;
+    if (input_processor->dispatch)
+      return input_processor->dispatch->input_processor_inject_events(input_processor->instance, events, count);
+    return input_processor->instance->inject_events(events, count);
+  }, -EIO);
+}
+
+ANBOX_EXPORT int anbox_input_processor_get_fd(const AnboxInputProcessor* input_processor) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!input_processor || !input_processor->instance)
+      return -EINVAL;
+    return input_processor->instance->event_fd();
+  }, -EIO);
+}
+
 ANBOX_EXPORT int anbox_graphics_processor_initialize(const AnboxGraphicsProcessor* graphics_processor,
                                                      AnboxGraphicsConfiguration* configuration) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return -EINVAL;
@@ -244,6 +554,7 @@ ANBOX_EXPORT int anbox_graphics_processor_initialize(const AnboxGraphicsProcesso
 }
 
 ANBOX_EXPORT EGLDisplay anbox_graphics_processor_create_display(const AnboxGraphicsProcessor* graphics_processor) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return EGL_NO_DISPLAY;
@@ -252,6 +563,7 @@ ANBOX_EXPORT EGLDisplay anbox_graphics_processor_create_display(const AnboxGraph
 }
 
 ANBOX_EXPORT void anbox_graphics_processor_begin_frame(const AnboxGraphicsProcessor* graphics_processor) {
+  ANBOX_PUBLIC_API_CALL();
   exception_safe_call_void([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return;
@@ -260,6 +572,7 @@ ANBOX_EXPORT void anbox_graphics_processor_begin_frame(const AnboxGraphicsProces
 }
 
 ANBOX_EXPORT void anbox_graphics_processor_finish_frame(const AnboxGraphicsProcessor* graphics_processor) {
+  ANBOX_PUBLIC_API_CALL();
   exception_safe_call_void([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return;
@@ -271,6 +584,7 @@ ANBOX_EXPORT EGLSurface anbox_graphics_processor_create_offscreen_surface(const
                                                                     EGLDisplay display,
                                                                     EGLConfig config,
                                                                     const EGLint* attribs) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return EGL_NO_SURFACE;
@@ -281,6 +595,7 @@ ANBOX_EXPORT EGLSurface anbox_graphics_processor_create_offscreen_surface(const
 ANBOX_EXPORT bool anbox_graphics_processor_destroy_offscreen_surface(const AnboxGraphicsProcessor* graphics_processor,
                                                                      EGLDisplay display,
                                                                      EGLSurface surface) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return false;
@@ -291,6 +606,7 @@ ANBOX_EXPORT bool anbox_graphics_processor_destroy_offscreen_surface(const Anbox
 ANBOX_EXPORT bool anbox_graphics_processor_present(const AnboxGraphicsProcessor* graphics_processor,
                                                    AnboxGraphicsBuffer* buffer,
                                                    AnboxCallback* callback) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return false;
@@ -304,6 +620,7 @@ ANBOX_EXPORT bool anbox_graphics_processor_present(const AnboxGraphicsProcessor*
 ANBOX_EXPORT bool anbox_graphics_processor_present2(const AnboxGraphicsProcessor* graphics_processor,
                                                     AnboxGraphicsBuffer2* buffer,
                                                     AnboxCallback* callback) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return false;
@@ -314,6 +631,7 @@ ANBOX_EXPORT bool anbox_graphics_processor_present2(const AnboxGraphicsProcessor
 ANBOX_EXPORT bool anbox_graphics_processor_create_buffer(const AnboxGraphicsProcessor* graphics_processor,
                                                          uint32_t width, uint32_t height, uint32_t format,
                                                          uint32_t usage, AnboxGraphicsBuffer2** buffer) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return false;
@@ -324,6 +642,7 @@ ANBOX_EXPORT bool anbox_graphics_processor_create_buffer(const AnboxGraphicsProc
 ANBOX_EXPORT void anbox_graphics_processor_set_vsync_callback(
   const AnboxGraphicsProcessor* graphics_processor,
   const AnboxVsyncCallback& callback, void* user_data) {
+  ANBOX_PUBLIC_API_CALL();
   exception_safe_call_void([&]() {
     if (!graphics_processor || !graphics_processor->instance)
       return;
@@ -332,12 +651,14 @@ ANBOX_EXPORT void anbox_graphics_processor_set_vsync_callback(
 }
 
 ANBOX_EXPORT const AnboxSensorProcessor* anbox_platform_get_sensor_processor(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   if (!platform || !platform->sensor_processor.instance)
     return nullptr;
   return &platform->sensor_processor;
 }
 
 ANBOX_EXPORT AnboxSensorType anbox_sensor_processor_supported_sensors(const AnboxSensorProcessor* sensor_processor) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!sensor_processor || !sensor_processor->instance)
       return AnboxSensorType::NONE;
@@ -347,6 +668,7 @@ ANBOX_EXPORT AnboxSensorType anbox_sensor_processor_supported_sensors(const Anbo
 
 ANBOX_EXPORT int anbox_sensor_processor_activate_sensor(const AnboxSensorProcessor* sensor_processor,
                                                         const AnboxSensorType type, bool on) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!sensor_processor || !sensor_processor->instance)
       return static_cast<int>(AnboxSensorType::NONE);
@@ -357,15 +679,19 @@ ANBOX_EXPORT int anbox_sensor_processor_activate_sensor(const AnboxSensorProcess
 ANBOX_EXPORT int anbox_sensor_processor_read_data(const AnboxSensorProcessor* sensor_processor,
                                                   AnboxSensorData* data,
                                                   int timeout) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!sensor_processor || !sensor_processor->instance)
       return -EINVAL;
+    if (sensor_processor->dispatch)
+      return sensor_processor->dispatch->sensor_processor_read_data(sensor_processor->instance, data, timeout);
     return sensor_processor->instance->read_data(data, timeout);
   }, -EIO);
 }
 
 ANBOX_EXPORT int anbox_sensor_processor_inject_data(const AnboxSensorProcessor* sensor_processor,
                                                     AnboxSensorData data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!sensor_processor || !sensor_processor->instance)
       return -EINVAL;
@@ -373,7 +699,17 @@ ANBOX_EXPORT int anbox_sensor_processor_inject_data(const AnboxSensorProcessor*
   }, -EIO);
 }
 
+ANBOX_EXPORT int anbox_sensor_processor_get_fd(const AnboxSensorProcessor* sensor_processor) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!sensor_processor || !sensor_processor->instance)
+      return -EINVAL;
+    return sensor_processor->instance->event_fd();
+  }, -EIO);
+}
+
 ANBOX_EXPORT const AnboxGpsProcessor* anbox_platform_get_gps_processor(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   if (!platform || !platform->gps_processor.instance)
     return nullptr;
   return &platform->gps_processor;
@@ -382,15 +718,19 @@ ANBOX_EXPORT const AnboxGpsProcessor* anbox_platform_get_gps_processor(const Anb
 ANBOX_EXPORT int anbox_gps_processor_read_data(const AnboxGpsProcessor* gps_processor,
                                                AnboxGpsData* data,
                                                int timeout) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!gps_processor || !gps_processor->instance)
       return -EINVAL;
+    if (gps_processor->dispatch)
+      return gps_processor->dispatch->gps_processor_read_data(gps_processor->instance, data, timeout);
     return gps_processor->instance->read_data(data, timeout);
   }, -EIO);
 }
 
 ANBOX_EXPORT int anbox_gps_processor_inject_data(const AnboxGpsProcessor* gps_processor,
                                                  AnboxGpsData data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!gps_processor || !gps_processor->instance)
       return -EINVAL;
@@ -398,7 +738,17 @@ ANBOX_EXPORT int anbox_gps_processor_inject_data(const AnboxGpsProcessor* gps_pr
   }, -EIO);
 }
 
+ANBOX_EXPORT int anbox_gps_processor_get_fd(const AnboxGpsProcessor* gps_processor) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!gps_processor || !gps_processor->instance)
+      return -EINVAL;
+    return gps_processor->instance->event_fd();
+  }, -EIO);
+}
+
 ANBOX_EXPORT const AnboxCameraProcessor* anbox_platform_get_camera_processor(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   if (!platform || !platform->camera_processor.instance)
     return nullptr;
   return &platform->camera_processor;
@@ -407,6 +757,7 @@ ANBOX_EXPORT const AnboxCameraProcessor* anbox_platform_get_camera_processor(con
 ANBOX_EXPORT int anbox_camera_processor_get_device_specs(const AnboxCameraProcessor* camera_processor,
                                                          AnboxCameraSpec** specs,
                                                          size_t *length) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!camera_processor || !camera_processor->instance)
       return -EINVAL;
@@ -417,6 +768,7 @@ ANBOX_EXPORT int anbox_camera_processor_get_device_specs(const AnboxCameraProces
 ANBOX_EXPORT int anbox_camera_processor_open_device(const AnboxCameraProcessor* camera_processor,
                                                     AnboxCameraSpec spec,
                                                     AnboxCameraOrientation orientation) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!camera_processor || !camera_processor->instance)
       return -EINVAL;
@@ -425,6 +777,7 @@ ANBOX_EXPORT int anbox_camera_processor_open_device(const AnboxCameraProcessor*
 }
 
 ANBOX_EXPORT int anbox_camera_processor_close_device(const AnboxCameraProcessor* camera_processor) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!camera_processor || !camera_processor->instance)
       return -EINVAL;
@@ -435,15 +788,19 @@ ANBOX_EXPORT int anbox_camera_processor_close_device(const AnboxCameraProcessor*
 ANBOX_EXPORT int anbox_camera_processor_read_frame(const AnboxCameraProcessor* camera_processor,
                                                    AnboxVideoFrame* frame,
                                                    int timeout) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!camera_processor || !camera_processor->instance)
       return -EINVAL;
+    if (camera_processor->dispatch)
+      return camera_processor->dispatch->camera_processor_read_frame(camera_processor->instance, frame, timeout);
     return camera_processor->instance->read_frame(frame, timeout);
   }, -EIO);
 }
 
 ANBOX_EXPORT int anbox_camera_processor_inject_frame(const AnboxCameraProcessor* camera_processor,
                                                      AnboxVideoFrame frame) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!camera_processor || !camera_processor->instance)
       return -EINVAL;
@@ -451,7 +808,88 @@ ANBOX_EXPORT int anbox_camera_processor_inject_frame(const AnboxCameraProcessor*
   }, -EIO);
 }
 
+ANBOX_EXPORT int anbox_camera_processor_read_frame_with_release(const AnboxCameraProcessor* camera_processor,
+                                                                AnboxVideoFrame* frame,
+                                                                AnboxCallback* release,
+                                                                int timeout) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!camera_processor || !camera_processor->instance)
+      return -EINVAL;
+    if (camera_processor->dispatch)
+      return camera_processor->dispatch->camera_processor_read_frame_with_release(
+          camera_processor->instance, frame, release, timeout);
+    return camera_processor->instance->read_frame_with_release(frame, release, timeout);
+  }, -EIO);
+}
+
+ANBOX_EXPORT int anbox_camera_processor_inject_frame_with_release(const AnboxCameraProcessor* camera_processor,
+                                                                  AnboxVideoFrame frame,
+                                                                  AnboxCallback* release) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!camera_processor || !camera_processor->instance)
+      return -EINVAL;
+    return camera_processor->instance->inject_frame_with_release(frame, release);
+  }, -EIO);
+}
+
+ANBOX_EXPORT int anbox_camera_processor_read_frame2(const AnboxCameraProcessor* camera_processor,
+                                                    AnboxVideoFrame2* frame,
+                                                    int timeout) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!camera_processor || !camera_processor->instance)
+      return -EINVAL;
+    if (camera_processor->dispatch)
+      return camera_processor->dispatch->camera_processor_read_frame2(camera_processor->instance, frame, timeout);
+    return camera_processor->instance->read_frame2(frame, timeout);
+  }, -EIO);
+}
+
+ANBOX_EXPORT int anbox_camera_processor_inject_frame2(const AnboxCameraProcessor* camera_processor,
+                                                      const AnboxVideoFrame2* frame) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!camera_processor || !camera_processor->instance)
+      return -EINVAL;
+    return camera_processor->instance->inject_frame2(frame);
+  }, -EIO);
+}
+
+ANBOX_EXPORT int anbox_camera_processor_open_device_with_options(const AnboxCameraProcessor* camera_processor,
+                                                                 AnboxCameraSpec spec,
+                                                                 AnboxCameraOrientation orientation,
+                                                                 const AnboxCameraDeliveryOptions* options) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!camera_processor || !camera_processor->instance)
+      return -EINVAL;
+    return camera_processor->instance->open_device_with_options(spec, orientation, options);
+  }, -EIO);
+}
+
+ANBOX_EXPORT int anbox_camera_processor_get_dropped_frames(const AnboxCameraProcessor* camera_processor,
+                                                           uint64_t* count) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!camera_processor || !camera_processor->instance || !count)
+      return -EINVAL;
+    return camera_processor->instance->get_dropped_frames(count);
+  }, -EIO);
+}
+
+ANBOX_EXPORT int anbox_camera_processor_get_fd(const AnboxCameraProcessor* camera_processor) {
+  ANBOX_PUBLIC_API_CALL();
+  return exception_safe_call([&]() {
+    if (!camera_processor || !camera_processor->instance)
+      return -EINVAL;
+    return camera_processor->instance->event_fd();
+  }, -EIO);
+}
+
 ANBOX_EXPORT const AnboxProxy* anbox_platform_get_anbox_proxy(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   if (!platform || !platform->anbox_proxy.instance)
     return nullptr;
   return &platform->anbox_proxy;
@@ -460,6 +898,7 @@ ANBOX_EXPORT const AnboxProxy* anbox_platform_get_anbox_proxy(const AnboxPlatfor
 ANBOX_EXPORT int anbox_proxy_set_change_screen_orientation_callback(const AnboxProxy* anbox_proxy,
                                                                     const AnboxChangeScreenOrientationCallback& callback,
                                                                     void* user_data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!anbox_proxy || !anbox_proxy->instance)
       return -EINVAL;
@@ -471,6 +910,7 @@ ANBOX_EXPORT int anbox_proxy_set_change_screen_orientation_callback(const AnboxP
 ANBOX_EXPORT int anbox_proxy_set_change_display_density_callback(const AnboxProxy* anbox_proxy,
                                                                  const AnboxChangeDisplayDensityCallback& callback,
                                                                  void* user_data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!anbox_proxy || !anbox_proxy->instance)
       return -EINVAL;
@@ -482,6 +922,7 @@ ANBOX_EXPORT int anbox_proxy_set_change_display_density_callback(const AnboxProx
 ANBOX_EXPORT int anbox_proxy_set_change_display_size_callback(const AnboxProxy* anbox_proxy,
                                                               const AnboxChangeDisplaySizeCallback& callback,
                                                               void* user_data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!anbox_proxy || !anbox_proxy->instance)
       return -EINVAL;
@@ -495,6 +936,7 @@ ANBOX_EXPORT int anbox_proxy_send_message(const AnboxProxy* anbox_proxy,
                                           size_t type_size,
                                           const char* data,
                                           size_t data_size) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!anbox_proxy || !anbox_proxy->instance)
       return -EINVAL;
@@ -505,6 +947,7 @@ ANBOX_EXPORT int anbox_proxy_send_message(const AnboxProxy* anbox_proxy,
 ANBOX_EXPORT int anbox_proxy_set_trigger_action_callback(const AnboxProxy* anbox_proxy,
                                                          const AnboxTriggerActionCallback& callback,
                                                          void* user_data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!anbox_proxy || !anbox_proxy->instance)
       return -EINVAL;
@@ -516,6 +959,7 @@ ANBOX_EXPORT int anbox_proxy_set_trigger_action_callback(const AnboxProxy* anbox
 ANBOX_EXPORT int anbox_proxy_set_create_adb_connection_callback(const AnboxProxy* anbox_proxy,
                                                                 const AnboxCreateADBConnectionCallback& callback,
                                                                 void* user_data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!anbox_proxy || !anbox_proxy->instance)
       return -EINVAL;
@@ -527,6 +971,7 @@ ANBOX_EXPORT int anbox_proxy_set_create_adb_connection_callback(const AnboxProxy
 ANBOX_EXPORT int anbox_proxy_set_disconnect_adb_connection_callback(const AnboxProxy* anbox_proxy,
                                                                     const AnboxDisconnectADBConnectionCallback& callback,
                                                                     void* user_data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!anbox_proxy || !anbox_proxy->instance)
       return -EINVAL;
@@ -536,6 +981,7 @@ ANBOX_EXPORT int anbox_proxy_set_disconnect_adb_connection_callback(const AnboxP
 }
 
 ANBOX_EXPORT int anbox_video_decoder_release(AnboxVideoDecoder* decoder) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!decoder || !decoder->instance)
       return -EINVAL;
@@ -546,6 +992,7 @@ ANBOX_EXPORT int anbox_video_decoder_release(AnboxVideoDecoder* decoder) {
 }
 
 ANBOX_EXPORT int anbox_video_decoder_configure(const AnboxVideoDecoder* decoder, AnboxVideoDecoderConfig config) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!decoder || !decoder->instance)
       return -EINVAL;
@@ -554,6 +1001,7 @@ ANBOX_EXPORT int anbox_video_decoder_configure(const AnboxVideoDecoder* decoder,
 }
 
 ANBOX_EXPORT int anbox_video_decoder_flush(const AnboxVideoDecoder* decoder) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!decoder || !decoder->instance)
       return -EINVAL;
@@ -562,6 +1010,7 @@ ANBOX_EXPORT int anbox_video_decoder_flush(const AnboxVideoDecoder* decoder) {
 }
 
 ANBOX_EXPORT uint64_t anbox_video_decoder_decode_frame(const AnboxVideoDecoder* decoder, const AnboxVideoFrame* frame, uint64_t pts) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!decoder || !decoder->instance)
       return static_cast<uint64_t>(0);
@@ -570,6 +1019,7 @@ ANBOX_EXPORT uint64_t anbox_video_decoder_decode_frame(const AnboxVideoDecoder*
 }
 
 ANBOX_EXPORT int anbox_video_decoder_retrieve_image(const AnboxVideoDecoder* decoder, AnboxVideoImage* img) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!decoder || !decoder->instance)
       return -EINVAL;
@@ -578,6 +1028,7 @@ ANBOX_EXPORT int anbox_video_decoder_retrieve_image(const AnboxVideoDecoder* dec
 }
 
 ANBOX_EXPORT const AnboxVhalConnector* anbox_platform_get_vhal_connector(const AnboxPlatform* platform) {
+  ANBOX_PUBLIC_API_CALL();
   if (!platform || !platform->vhal_connector.instance)
     return nullptr;
   return &platform->vhal_connector;
@@ -586,6 +1037,7 @@ ANBOX_EXPORT const AnboxVhalConnector* anbox_platform_get_vhal_connector(const A
 ANBOX_EXPORT int anbox_vhal_connector_set_callbacks(const AnboxVhalConnector* connector,
                                                     const AnboxVhalConnectorCallbacks& callbacks,
                                                     void* user_data) {
+  ANBOX_PUBLIC_API_CALL();
   return exception_safe_call([&]() {
     if (!connector || !connector->instance)
       return -EINVAL;
@@ -593,4 +1045,30 @@ ANBOX_EXPORT int anbox_vhal_connector_set_callbacks(const AnboxVhalConnector* co
     return 0;
   }, -EIO);
 }
+
+ANBOX_EXPORT int anbox_platform_get_stats(const AnboxPlatform* platform,
+                                          AnboxCallStats* stats,
+                                          size_t* count) {
+  if (!platform || !count)
+    return -EINVAL;
+
+#ifdef ANBOX_PLATFORM_SDK_CALL_STATS
+  size_t n = 0;
+  for (auto entry = CallStats::call_stats_head.load(std::memory_order_acquire);
+       entry; entry = entry->next) {
+    if (stats) {
+      if (n >= *count)
+        break;
+      stats[n].name = entry->name;
+      entry->histogram.snapshot(&stats[n]);
+    }
+    n++;
+  }
+  *count = n;
+  return 0;
+#else
+  (void) stats;
+  return -EIO;
+#endif
+}
 } // extern "C"
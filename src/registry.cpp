@@ -19,6 +19,11 @@
 #include "anbox-platform-sdk/plugin.h"
 
 AnboxPlatform* anbox_platform_plugin_register(std::unique_ptr<anbox::Platform>&& platform) {
+  return anbox_platform_plugin_register(std::move(platform), nullptr);
+}
+
+AnboxPlatform* anbox_platform_plugin_register(std::unique_ptr<anbox::Platform>&& platform,
+                                              const AnboxPlatformDispatchTable* dispatch) {
   auto anbox_platform = new AnboxPlatform;
   anbox_platform->audio_processor.instance = platform->audio_processor();
   anbox_platform->input_processor.instance = platform->input_processor();
@@ -28,6 +33,11 @@ AnboxPlatform* anbox_platform_plugin_register(std::unique_ptr<anbox::Platform>&&
   anbox_platform->gps_processor.instance = platform->gps_processor();
   anbox_platform->camera_processor.instance = platform->camera_processor();
   anbox_platform->vhal_connector.instance = platform->vhal_connector();
+  anbox_platform->audio_processor.dispatch = dispatch;
+  anbox_platform->input_processor.dispatch = dispatch;
+  anbox_platform->sensor_processor.dispatch = dispatch;
+  anbox_platform->gps_processor.dispatch = dispatch;
+  anbox_platform->camera_processor.dispatch = dispatch;
   anbox_platform->instance = std::move(platform);
   return anbox_platform;
 }
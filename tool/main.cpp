@@ -19,22 +19,34 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include "anbox-platform-sdk/audio_pcm.h"
+#include "anbox-platform-sdk/audio_resampler.h"
+#include "anbox-platform-sdk/audio_shared_ring.h"
 #include "anbox-platform-sdk/plugin.h"
 #include "anbox-platform-sdk/public_api.h"
+#include "anbox-platform-sdk/video_frame_pool.h"
+#include "anbox-platform-sdk/video_image.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <fstream>
 #include <future>
 #include <iostream>
 #include <mutex>
 #include <queue>
+#include <set>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <stdint.h>
 #include <dlfcn.h>
 #include <gelf.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include <linux/input.h>
 
 namespace chrono = std::chrono;
@@ -52,15 +64,25 @@ constexpr const char* anbox_platform_get_camera_processor_name{"anbox_platform_g
 constexpr const char* anbox_platform_ready_name{"anbox_platform_ready"};
 constexpr const char* anbox_platform_wait_until_ready_name{"anbox_platform_wait_until_ready"};
 constexpr const char* anbox_platform_get_config_item_name{"anbox_platform_get_config_item"};
+constexpr const char* anbox_platform_set_config_item_name{"anbox_platform_set_config_item"};
 constexpr const char* anbox_platform_stop_name{"anbox_platform_stop"};
 constexpr const char* anbox_platform_handle_event_name{"anbox_platform_handle_event"};
+constexpr const char* anbox_platform_get_stats_name{"anbox_platform_get_stats"};
+constexpr const char* anbox_platform_setup_event_tracer_name{"anbox_platform_setup_event_tracer"};
 constexpr const char* anbox_audio_processor_process_data_name{"anbox_audio_processor_process_data"};
 constexpr const char* anbox_audio_processor_write_data_name{"anbox_audio_processor_write_data"};
+constexpr const char* anbox_audio_processor_write_datav_name{"anbox_audio_processor_write_datav"};
+constexpr const char* anbox_audio_processor_write_data_timestamped_name{"anbox_audio_processor_write_data_timestamped"};
+constexpr const char* anbox_audio_processor_get_presentation_position_name{"anbox_audio_processor_get_presentation_position"};
 constexpr const char* anbox_audio_processor_read_data_name{"anbox_audio_processor_read_data"};
 constexpr const char* anbox_audio_processor_standby_name{"anbox_audio_processor_standby"};
+constexpr const char* anbox_audio_processor_activate_name{"anbox_audio_processor_activate"};
 constexpr const char* anbox_audio_processor_need_silence_on_standby_name{"anbox_audio_processor_need_silence_on_standby"};
 constexpr const char* anbox_input_processor_read_event_name{"anbox_input_processor_read_event"};
 constexpr const char* anbox_input_processor_inject_event_name{"anbox_input_processor_inject_event"};
+constexpr const char* anbox_input_processor_read_events_name{"anbox_input_processor_read_events"};
+constexpr const char* anbox_input_processor_inject_events_name{"anbox_input_processor_inject_events"};
+constexpr const char* anbox_input_processor_get_fd_name{"anbox_input_processor_get_fd"};
 constexpr const char* anbox_graphics_processor_initialize_name{"anbox_graphics_processor_initialize"};
 constexpr const char* anbox_graphics_processor_begin_frame_name{"anbox_graphics_processor_begin_frame"};
 constexpr const char* anbox_graphics_processor_finish_frame_name{"anbox_graphics_processor_finish_frame"};
@@ -68,6 +90,7 @@ constexpr const char* anbox_graphics_processor_create_display_name{"anbox_graphi
 constexpr const char* anbox_sensor_processor_supported_sensors_name{"anbox_sensor_processor_supported_sensors"};
 constexpr const char* anbox_sensor_processor_read_data_name{"anbox_sensor_processor_read_data"};
 constexpr const char* anbox_sensor_processor_inject_data_name{"anbox_sensor_processor_inject_data"};
+constexpr const char* anbox_sensor_processor_get_fd_name{"anbox_sensor_processor_get_fd"};
 constexpr const char* anbox_proxy_set_change_screen_orientation_callback_name{"anbox_proxy_set_change_screen_orientation_callback"};
 constexpr const char* anbox_proxy_set_change_display_density_callback_name{"anbox_proxy_set_change_display_density_callback"};
 constexpr const char* anbox_proxy_set_change_display_size_callback_name{"anbox_proxy_set_change_display_size_callback"};
@@ -75,15 +98,24 @@ constexpr const char* anbox_proxy_set_trigger_action_callback_name{"anbox_proxy_
 constexpr const char* anbox_proxy_send_message_name{"anbox_proxy_send_message"};
 constexpr const char* anbox_gps_processor_read_data_name{"anbox_gps_processor_read_data"};
 constexpr const char* anbox_gps_processor_inject_data_name{"anbox_gps_processor_inject_data"};
+constexpr const char* anbox_gps_processor_get_fd_name{"anbox_gps_processor_get_fd"};
 constexpr const char* anbox_camera_processor_get_device_specs_name{"anbox_camera_processor_get_device_specs"};
 constexpr const char* anbox_camera_processor_open_device_name{"anbox_camera_processor_open_device"};
 constexpr const char* anbox_camera_processor_close_device_name{"anbox_camera_processor_close_device"};
 constexpr const char* anbox_camera_processor_read_frame_name{"anbox_camera_processor_read_frame"};
 constexpr const char* anbox_camera_processor_inject_frame_name{"anbox_camera_processor_inject_frame"};
+constexpr const char* anbox_camera_processor_read_frame_with_release_name{"anbox_camera_processor_read_frame_with_release"};
+constexpr const char* anbox_camera_processor_inject_frame_with_release_name{"anbox_camera_processor_inject_frame_with_release"};
+constexpr const char* anbox_camera_processor_read_frame2_name{"anbox_camera_processor_read_frame2"};
+constexpr const char* anbox_camera_processor_inject_frame2_name{"anbox_camera_processor_inject_frame2"};
+constexpr const char* anbox_camera_processor_open_device_with_options_name{"anbox_camera_processor_open_device_with_options"};
+constexpr const char* anbox_camera_processor_get_dropped_frames_name{"anbox_camera_processor_get_dropped_frames"};
+constexpr const char* anbox_camera_processor_get_fd_name{"anbox_camera_processor_get_fd"};
 
 constexpr const int timeout_in_secs{5};
 constexpr const int event_numbers{1000};
 constexpr const int event_value_numbers{100};
+constexpr const int event_batch_size{64};
 constexpr const int big_chunk_size{4096};
 constexpr const int small_chunk_size{4096};
 constexpr const int sensor_data_numbers{1000};
@@ -96,9 +128,20 @@ constexpr const int supported_gps_data_count{3};
 constexpr const int audio_buffer_length{1024};
 constexpr const int video_frame_count{100};
 constexpr const uint32_t android_minimum_density{72};
+constexpr const int benchmark_iterations{10000};
+constexpr const int benchmark_audio_iterations{1000};
+constexpr const int benchmark_camera_iterations{300};
+constexpr const int benchmark_max_duration_in_secs{5};
+constexpr const size_t benchmark_audio_chunk_sizes[] = {256, 1024, 4096, 16384};
+constexpr const int benchmark_pcm_iterations{2000};
+constexpr const size_t benchmark_pcm_samples{4096};
+constexpr const int benchmark_image_iterations{100};
+// Odd sizes around the SIMD block widths exercise the tails of the SDK kernels
+constexpr const size_t kernel_test_sizes[] = {1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 130, 257};
 
 static void print_usage() {
   std::cerr << "Usage: anbox-platform-tester [GTEST options] <path to platform .so>" << std::endl;
+  std::cerr << "       anbox-platform-tester --benchmark <path to platform .so>" << std::endl;
 }
 
 static const char* platform_path{nullptr};
@@ -152,6 +195,23 @@ long current_datetime_in_ns() {
   return now_ns.count();
 }
 
+uint64_t monotonic_time_in_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t process_cpu_time_in_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+bool is_readable(int fd, int timeout_ms) {
+  struct pollfd pfd{fd, POLLIN, 0};
+  return poll(&pfd, 1, timeout_ms) == 1 && (pfd.revents & POLLIN);
+}
+
 bool is_multiple_axis_sensor(AnboxSensorType sensor_type) {
   switch (sensor_type) {
     case AnboxSensorType::ACCELERATION:
@@ -351,47 +411,78 @@ class BasePlatformTest : public ::testing::Test {
 
 class VideoFrameGenerator {
  public:
-   VideoFrameGenerator() = default;
+   explicit VideoFrameGenerator(size_t max_frames = anbox::VideoFramePool::default_max_frames) :
+     pool_{max_frames}, memfd_pool_{max_frames, anbox::VideoFrameMemory::Memfd} {}
    ~VideoFrameGenerator() = default;
 
+   // Generates a frame whose buffer is allocated with malloc and owned by
+   // whoever the frame is handed to.
    int generate(AnboxVideoFrame& frame, uint32_t width, uint32_t height,
        const AnboxVideoColorSpaceFormat& format) {
      memset(&frame, 0, sizeof(AnboxVideoFrame));
-     switch(format) {
-     case VIDEO_FRAME_FORMAT_YUV420: {
-       uint32_t num_of_pixels = width * height;
-       uint32_t num_of_yuv = num_of_pixels / 4;
-       frame.size = num_of_pixels * 3 / 2;
-       frame.data = reinterpret_cast<uint8_t*>(malloc(frame.size));
-
-       // Fill the frame with a white color
-       const uint8_t rgb[3] = {0xff, 0xff, 0xff};
-       uint8_t yuv[3];
-       rgb_to_yuv(rgb, yuv);
-
-       uint8_t* y = frame.data;
-       uint8_t* u = y + num_of_pixels;
-       uint8_t* v = u + num_of_yuv;
-       ::memset(y, yuv[0], num_of_pixels);
-       ::memset(u, yuv[1], num_of_yuv);
-       ::memset(v, yuv[2], num_of_yuv);
-     }
-     break;
-     case VIDEO_FRAME_FORMAT_RGBA: {
-       frame.size = width * height * 4;
-       frame.data = reinterpret_cast<uint8_t*>(malloc(frame.size));
+     const AnboxCameraSpec spec{format, CAMERA_FACING_MODE_REAR, 0, width, height};
+     frame.size = anbox::VideoFramePool::frame_size(spec);
+     if (frame.size == 0)
+       return -1;
 
-       // Fill the frame with a white color
-       ::memset(frame.data, 0xff, frame.size);
-     }
-     break;
-     default:
-     return -1;
-     }
+     frame.data = reinterpret_cast<uint8_t*>(malloc(frame.size));
+     fill(frame, width, height, format);
+     return 0;
+   }
 
+   // Generates a frame from the pool of the generator which goes back into
+   // the pool once \a release is called.
+   int generate(AnboxVideoFrame& frame, AnboxCallback& release, uint32_t width, uint32_t height,
+       const AnboxVideoColorSpaceFormat& format) {
+     memset(&frame, 0, sizeof(AnboxVideoFrame));
+     const AnboxCameraSpec spec{format, CAMERA_FACING_MODE_REAR, 0, width, height};
+     if (pool_.acquire(spec, &frame, &release) != 0)
+       return -1;
+
+     fill(frame, width, height, format);
+     return 0;
+   }
+
+   // Generates a frame stored in a memfd of the generator which goes back
+   // into the pool once the release callback of the frame is called.
+   int generate(AnboxVideoFrame2& frame, uint32_t width, uint32_t height,
+       const AnboxVideoColorSpaceFormat& format) {
+     const AnboxCameraSpec spec{format, CAMERA_FACING_MODE_REAR, 0, width, height};
+     uint8_t* data = nullptr;
+     if (memfd_pool_.acquire(spec, &frame, &data) != 0)
+       return -1;
+
+     AnboxVideoFrame mapped{data, frame.size};
+     fill(mapped, width, height, format);
      return 0;
    }
+
+   const anbox::VideoFramePool& pool() const { return pool_; }
+   const anbox::VideoFramePool& memfd_pool() const { return memfd_pool_; }
+
  private:
+  void fill(AnboxVideoFrame& frame, uint32_t width, uint32_t height,
+            const AnboxVideoColorSpaceFormat& format) {
+     // Fill the frame with a white color
+     if (format == VIDEO_FRAME_FORMAT_RGBA) {
+       ::memset(frame.data, 0xff, frame.size);
+       return;
+     }
+
+     uint32_t num_of_pixels = width * height;
+     uint32_t num_of_yuv = ((width + 1) / 2) * ((height + 1) / 2);
+     const uint8_t rgb[3] = {0xff, 0xff, 0xff};
+     uint8_t yuv[3];
+     rgb_to_yuv(rgb, yuv);
+
+     uint8_t* y = frame.data;
+     uint8_t* u = y + num_of_pixels;
+     uint8_t* v = u + num_of_yuv;
+     ::memset(y, yuv[0], num_of_pixels);
+     ::memset(u, yuv[1], num_of_yuv);
+     ::memset(v, yuv[2], num_of_yuv);
+  }
+
   void rgb_to_yuv(const uint8_t* rgb, uint8_t* yuv) {
     const auto r = rgb[0];
     const auto g = rgb[1];
@@ -400,6 +491,9 @@ class VideoFrameGenerator {
     yuv[1] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
     yuv[2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
   }
+
+  anbox::VideoFramePool pool_;
+  anbox::VideoFramePool memfd_pool_;
 };
 
 class PlatformBehaviorTest : public BasePlatformTest {
@@ -437,6 +531,12 @@ class PlatformBehaviorTest : public BasePlatformTest {
     handle_event = export_symbol<AnboxPlatformHandleEventFunc>(
                 anbox_platform_handle_event_name);
     ASSERT_NE(nullptr, handle_event);
+    get_stats = export_symbol<AnboxPlatformGetStatsFunc>(
+                anbox_platform_get_stats_name);
+    ASSERT_NE(nullptr, get_stats);
+    setup_event_tracer = export_symbol<AnboxPlatformSetupEventTracerFunc>(
+                anbox_platform_setup_event_tracer_name);
+    ASSERT_NE(nullptr, setup_event_tracer);
 
     load_descriptor(&descriptor);
     ASSERT_NE(nullptr, descriptor);
@@ -457,6 +557,8 @@ class PlatformBehaviorTest : public BasePlatformTest {
   AnboxPlatformGetAnboxProxyFunc get_proxy{nullptr};
   AnboxPlatformStopFunc stop{nullptr};
   AnboxPlatformHandleEventFunc handle_event{nullptr};
+  AnboxPlatformGetStatsFunc get_stats{nullptr};
+  AnboxPlatformSetupEventTracerFunc setup_event_tracer{nullptr};
 
   AnboxPlatformDescriptor* descriptor{nullptr};
 };
@@ -477,6 +579,15 @@ class PlatformInputProcessorTest : public PlatformBehaviorTest {
     input_processor_inject_event = export_symbol<AnboxInputProcessorInjectEventFunc>(
                 anbox_input_processor_inject_event_name);
     ASSERT_NE(nullptr, input_processor_inject_event);
+    input_processor_read_events = export_symbol<AnboxInputProcessorReadEventsFunc>(
+                anbox_input_processor_read_events_name);
+    ASSERT_NE(nullptr, input_processor_read_events);
+    input_processor_inject_events = export_symbol<AnboxInputProcessorInjectEventsFunc>(
+                anbox_input_processor_inject_events_name);
+    ASSERT_NE(nullptr, input_processor_inject_events);
+    input_processor_get_fd = export_symbol<AnboxInputProcessorGetFdFunc>(
+                anbox_input_processor_get_fd_name);
+    ASSERT_NE(nullptr, input_processor_get_fd);
   }
 
   void TearDown() override {
@@ -489,6 +600,9 @@ class PlatformInputProcessorTest : public PlatformBehaviorTest {
   AnboxPlatform* platform{nullptr};
   AnboxInputProcessorReadEventFunc input_processor_read_event{nullptr};
   AnboxInputProcessorInjectEventFunc input_processor_inject_event{nullptr};
+  AnboxInputProcessorReadEventsFunc input_processor_read_events{nullptr};
+  AnboxInputProcessorInjectEventsFunc input_processor_inject_events{nullptr};
+  AnboxInputProcessorGetFdFunc input_processor_get_fd{nullptr};
 };
 
 class PlatformAudioProcessorTest : public PlatformBehaviorTest {
@@ -509,6 +623,18 @@ public:
                anbox_audio_processor_write_data_name);
    ASSERT_NE(nullptr, audio_processor_write_data);
 
+   audio_processor_write_datav = export_symbol<AnboxAudioProcessorWriteDataVFunc>(
+               anbox_audio_processor_write_datav_name);
+   ASSERT_NE(nullptr, audio_processor_write_datav);
+
+   audio_processor_write_data_timestamped = export_symbol<AnboxAudioProcessorWriteDataTimestampedFunc>(
+               anbox_audio_processor_write_data_timestamped_name);
+   ASSERT_NE(nullptr, audio_processor_write_data_timestamped);
+
+   audio_processor_get_presentation_position = export_symbol<AnboxAudioProcessorGetPresentationPositionFunc>(
+               anbox_audio_processor_get_presentation_position_name);
+   ASSERT_NE(nullptr, audio_processor_get_presentation_position);
+
    audio_processor_read_data = export_symbol<AnboxAudioProcessorReadDataFunc>(
                anbox_audio_processor_read_data_name);
    ASSERT_NE(nullptr, audio_processor_read_data);
@@ -517,6 +643,10 @@ public:
                anbox_audio_processor_standby_name);
    ASSERT_NE(nullptr, audio_processor_standby);
 
+   audio_processor_activate = export_symbol<AnboxAudioProcessorActivateFunc>(
+               anbox_audio_processor_activate_name);
+   ASSERT_NE(nullptr, audio_processor_activate);
+
    audio_processor_need_silence_on_standby = export_symbol<AnboxAudioProcessorNeedSilenceOnStandbyFunc>(
                anbox_audio_processor_need_silence_on_standby_name);
    ASSERT_NE(nullptr, audio_processor_need_silence_on_standby);
@@ -531,8 +661,12 @@ public:
   AnboxPlatform* platform{nullptr};
   AnboxAudioProcessorProcessDataFunc audio_processor_process_data{nullptr};
   AnboxAudioProcessorWriteDataFunc audio_processor_write_data{nullptr};
+  AnboxAudioProcessorWriteDataVFunc audio_processor_write_datav{nullptr};
+  AnboxAudioProcessorWriteDataTimestampedFunc audio_processor_write_data_timestamped{nullptr};
+  AnboxAudioProcessorGetPresentationPositionFunc audio_processor_get_presentation_position{nullptr};
   AnboxAudioProcessorReadDataFunc audio_processor_read_data{nullptr};
   AnboxAudioProcessorStandbyFunc audio_processor_standby{nullptr};
+  AnboxAudioProcessorActivateFunc audio_processor_activate{nullptr};
   AnboxAudioProcessorNeedSilenceOnStandbyFunc audio_processor_need_silence_on_standby{nullptr};
 };
 
@@ -603,6 +737,9 @@ class PlatformSensorProcessorTest : public PlatformBehaviorTest {
     sensor_processor_inject_data = export_symbol<AnboxSensorProcessorInjectDataFunc>(
                    anbox_sensor_processor_inject_data_name);
     ASSERT_NE(nullptr, sensor_processor_inject_data);
+    sensor_processor_get_fd = export_symbol<AnboxSensorProcessorGetFdFunc>(
+                   anbox_sensor_processor_get_fd_name);
+    ASSERT_NE(nullptr, sensor_processor_get_fd);
   }
 
   void TearDown() override {
@@ -662,6 +799,7 @@ class PlatformSensorProcessorTest : public PlatformBehaviorTest {
   AnboxSensorProcessorSupportedSensorsFunc sensor_processor_supported_sensors{nullptr};
   AnboxSensorProcessorReadDataFunc sensor_processor_read_data{nullptr};
   AnboxSensorProcessorInjectDataFunc sensor_processor_inject_data{nullptr};
+  AnboxSensorProcessorGetFdFunc sensor_processor_get_fd{nullptr};
 };
 
 class PlatformProxyTest : public PlatformBehaviorTest {
@@ -730,6 +868,9 @@ class PlatformGpsProcessorTest : public PlatformBehaviorTest {
     gps_processor_inject_data = export_symbol<AnboxGpsProcessorInjectDataFunc>(
                    anbox_gps_processor_inject_data_name);
     ASSERT_NE(nullptr, gps_processor_inject_data);
+    gps_processor_get_fd = export_symbol<AnboxGpsProcessorGetFdFunc>(
+                   anbox_gps_processor_get_fd_name);
+    ASSERT_NE(nullptr, gps_processor_get_fd);
   }
 
   void TearDown() override {
@@ -742,6 +883,7 @@ protected:
  AnboxPlatform* platform{nullptr};
  AnboxGpsProcessorReadDataFunc gps_processor_read_data{nullptr};
  AnboxGpsProcessorInjectDataFunc gps_processor_inject_data{nullptr};
+ AnboxGpsProcessorGetFdFunc gps_processor_get_fd{nullptr};
 };
 
 class PlatformCameraProcessorTest : public PlatformBehaviorTest {
@@ -768,6 +910,24 @@ class PlatformCameraProcessorTest : public PlatformBehaviorTest {
     camera_processor_inject_frame = export_symbol<AnboxCameraProcessorInjectFrameFunc>(
                    anbox_camera_processor_inject_frame_name);
     ASSERT_NE(nullptr, camera_processor_inject_frame);
+    camera_processor_read_frame_with_release = export_symbol<AnboxCameraProcessorReadFrameWithReleaseFunc>(
+                   anbox_camera_processor_read_frame_with_release_name);
+    ASSERT_NE(nullptr, camera_processor_read_frame_with_release);
+    camera_processor_inject_frame_with_release = export_symbol<AnboxCameraProcessorInjectFrameWithReleaseFunc>(
+                   anbox_camera_processor_inject_frame_with_release_name);
+    ASSERT_NE(nullptr, camera_processor_inject_frame_with_release);
+    camera_processor_read_frame2 = export_symbol<AnboxCameraProcessorReadFrame2Func>(
+                   anbox_camera_processor_read_frame2_name);
+    ASSERT_NE(nullptr, camera_processor_read_frame2);
+    camera_processor_inject_frame2 = export_symbol<AnboxCameraProcessorInjectFrame2Func>(
+                   anbox_camera_processor_inject_frame2_name);
+    ASSERT_NE(nullptr, camera_processor_inject_frame2);
+    camera_processor_open_device_with_options = export_symbol<AnboxCameraProcessorOpenDeviceWithOptionsFunc>(
+                   anbox_camera_processor_open_device_with_options_name);
+    ASSERT_NE(nullptr, camera_processor_open_device_with_options);
+    camera_processor_get_dropped_frames = export_symbol<AnboxCameraProcessorGetDroppedFramesFunc>(
+                   anbox_camera_processor_get_dropped_frames_name);
+    ASSERT_NE(nullptr, camera_processor_get_dropped_frames);
 
     camera_processor_open_device = export_symbol<AnboxCameraProcessorOpenDeviceFunc>(
                    anbox_camera_processor_open_device_name);
@@ -775,6 +935,9 @@ class PlatformCameraProcessorTest : public PlatformBehaviorTest {
     camera_processor_close_device = export_symbol<AnboxCameraProcessorCloseDeviceFunc>(
                    anbox_camera_processor_close_device_name);
     ASSERT_NE(nullptr, camera_processor_close_device);
+    camera_processor_get_fd = export_symbol<AnboxCameraProcessorGetFdFunc>(
+                   anbox_camera_processor_get_fd_name);
+    ASSERT_NE(nullptr, camera_processor_get_fd);
   }
 
   void TearDown() override {
@@ -785,14 +948,16 @@ class PlatformCameraProcessorTest : public PlatformBehaviorTest {
 
   void RenderFrame(const AnboxCameraProcessor* processor) {
     AnboxVideoFrame frame;
-    int ret = camera_processor_read_frame(processor, &frame, -1);
+    AnboxCallback release{nullptr, nullptr};
+    int ret = camera_processor_read_frame_with_release(processor, &frame, &release, -1);
     EXPECT_EQ(ret, 0);
     EXPECT_GT(frame.size, 0);
     EXPECT_NE(frame.data, nullptr);
+    ASSERT_NE(release.callback, nullptr);
 
     std::this_thread::sleep_for(std::chrono::milliseconds{1000 / 30});
     EXPECT_NE(frame.data, nullptr);
-    free(frame.data);
+    release.callback(release.user_data);
   }
 
   void OpenCamera(const AnboxCameraProcessor* processor) {
@@ -814,8 +979,15 @@ protected:
  AnboxCameraProcessorGetDeviceSpecsFunc camera_processor_get_device_specs{nullptr};
  AnboxCameraProcessorReadFrameFunc camera_processor_read_frame{nullptr};
  AnboxCameraProcessorInjectFrameFunc camera_processor_inject_frame{nullptr};
+ AnboxCameraProcessorReadFrameWithReleaseFunc camera_processor_read_frame_with_release{nullptr};
+ AnboxCameraProcessorInjectFrameWithReleaseFunc camera_processor_inject_frame_with_release{nullptr};
+ AnboxCameraProcessorReadFrame2Func camera_processor_read_frame2{nullptr};
+ AnboxCameraProcessorInjectFrame2Func camera_processor_inject_frame2{nullptr};
+ AnboxCameraProcessorOpenDeviceWithOptionsFunc camera_processor_open_device_with_options{nullptr};
+ AnboxCameraProcessorGetDroppedFramesFunc camera_processor_get_dropped_frames{nullptr};
  AnboxCameraProcessorOpenDeviceFunc camera_processor_open_device{nullptr};
  AnboxCameraProcessorCloseDeviceFunc camera_processor_close_device{nullptr};
+ AnboxCameraProcessorGetFdFunc camera_processor_get_fd{nullptr};
 };
 } // namespace
 
@@ -991,6 +1163,166 @@ TEST_F(PlatformBehaviorTest, ProvidesDisplaySpec) {
   release_platform(platform);
 }
 
+TEST_F(PlatformBehaviorTest, ExposesValidPlatformConfigurationItems) {
+  auto platform = create_platform(nullptr);
+  ASSERT_NE(nullptr, platform);
+  if (ready(platform) == false)
+    ASSERT_EQ(0, wait_until_ready(platform));
+
+  AnboxPlatformConfigurationInfo info{0, nullptr};
+  if (get_config_item(platform, PLATFORM_CONFIGURATION_INFO, &info, sizeof(info)) < 0 || info.num_items == 0) {
+    release_platform(platform);
+    GTEST_SKIP() << "Platform does not provide platform specific configuration items";
+  }
+  ASSERT_NE(nullptr, info.items);
+
+  auto set_config_item = export_symbol<AnboxPlatformSetConfigItemFunc>(
+              anbox_platform_set_config_item_name);
+  ASSERT_NE(nullptr, set_config_item);
+
+  std::set<int> ids;
+  for (uint16_t n = 0; n < info.num_items; n++) {
+    const auto item = info.items[n];
+    ASSERT_NE(nullptr, item);
+    EXPECT_GE(item->id, PLATFORM_CONFIGURATION_ID_START);
+    EXPECT_LE(item->id, PLATFORM_CONFIGURATION_ID_END);
+    EXPECT_TRUE(ids.insert(item->id).second) << "Duplicate configuration item " << item->id;
+    const auto name_length = strnlen(item->name, MAX_NAME_LENGTH);
+    EXPECT_GT(name_length, 0u);
+    EXPECT_LT(name_length, static_cast<size_t>(MAX_NAME_LENGTH));
+
+    // Writing back the current value must always be accepted
+    const auto key = static_cast<AnboxPlatformConfigurationKey>(item->id);
+    switch (item->type) {
+    case BOOLEAN: {
+      uint8_t value = 0;
+      ASSERT_EQ(0, get_config_item(platform, key, &value, sizeof(value))) << item->name;
+      EXPECT_EQ(0, set_config_item(platform, key, &value, sizeof(value))) << item->name;
+      break;
+    }
+    case UINT32: {
+      uint32_t value = 0;
+      ASSERT_EQ(0, get_config_item(platform, key, &value, sizeof(value))) << item->name;
+      EXPECT_EQ(0, set_config_item(platform, key, &value, sizeof(value))) << item->name;
+      break;
+    }
+    case STRING: {
+      char value[MAX_STRING_LENGTH] = {'\0'};
+      ASSERT_EQ(0, get_config_item(platform, key, value, sizeof(value) - 1)) << item->name;
+      EXPECT_EQ(0, set_config_item(platform, key, value, strlen(value) + 1)) << item->name;
+      break;
+    }
+    default:
+      ADD_FAILURE() << "Unknown type of configuration item " << item->name;
+    }
+  }
+
+  release_platform(platform);
+}
+
+TEST_F(PlatformBehaviorTest, ProvidesCallStats) {
+  auto platform = create_platform(nullptr);
+  ASSERT_NE(nullptr, platform);
+  for (int n = 0; n < 10; n++)
+    ready(platform);
+
+  size_t count = 0;
+  auto ret = get_stats(platform, nullptr, &count);
+  if (ret == -EIO) {
+    release_platform(platform);
+    GTEST_SKIP() << "Platform is built without call statistics";
+  }
+  ASSERT_EQ(ret, 0);
+  ASSERT_GT(count, 0);
+
+  std::vector<AnboxCallStats> stats(count);
+  ret = get_stats(platform, stats.data(), &count);
+  ASSERT_EQ(ret, 0);
+  ASSERT_LE(count, stats.size());
+
+  bool found = false;
+  for (size_t n = 0; n < count; n++) {
+    const auto& entry = stats[n];
+    ASSERT_NE(entry.name, nullptr);
+    EXPECT_LE(entry.p50_ns, entry.p90_ns);
+    EXPECT_LE(entry.p90_ns, entry.p99_ns);
+    EXPECT_LE(entry.p99_ns, entry.p999_ns);
+    EXPECT_GE(entry.total_ns, entry.max_ns);
+    if (strcmp(entry.name, anbox_platform_ready_name) == 0) {
+      EXPECT_GE(entry.calls, 10);
+      found = true;
+    }
+  }
+  EXPECT_TRUE(found);
+
+  release_platform(platform);
+}
+
+namespace {
+struct RecordedTraceEvent {
+  char phase;
+  std::string name;
+};
+
+// The tracer stays registered within the plugin until it is unloaded, so
+// the category is disabled again once the test finished.
+unsigned char trace_category_enabled{0};
+std::mutex trace_events_lock;
+std::vector<RecordedTraceEvent> trace_events;
+
+const unsigned char* get_trace_category_enabled(const char* category) {
+  static const unsigned char disabled = 0;
+  if (strcmp(category, "anbox.platform") != 0)
+    return &disabled;
+  return &trace_category_enabled;
+}
+
+void add_trace_event(char phase, const unsigned char* category, const char* name,
+                     unsigned long long id, int num_args, const char** arg_names,
+                     const unsigned char* arg_types, const unsigned long long* arg_values,
+                     unsigned char flags) {
+  (void) category;
+  (void) id;
+  (void) num_args;
+  (void) arg_names;
+  (void) arg_types;
+  (void) arg_values;
+  (void) flags;
+  std::lock_guard<std::mutex> lock(trace_events_lock);
+  trace_events.push_back({phase, name});
+}
+} // namespace
+
+TEST_F(PlatformBehaviorTest, EmitsTraceEventsForCalls) {
+  auto platform = create_platform(nullptr);
+  ASSERT_NE(nullptr, platform);
+
+  trace_category_enabled = 1;
+  setup_event_tracer(platform, get_trace_category_enabled, add_trace_event);
+  ready(platform);
+  trace_category_enabled = 0;
+
+  std::vector<RecordedTraceEvent> events;
+  {
+    std::lock_guard<std::mutex> lock(trace_events_lock);
+    events.swap(trace_events);
+  }
+
+  bool began = false, ended = false;
+  for (const auto& event : events) {
+    if (event.name != anbox_platform_ready_name)
+      continue;
+    if (event.phase == ANBOX_TRACE_EVENT_PHASE_BEGIN)
+      began = true;
+    else if (event.phase == ANBOX_TRACE_EVENT_PHASE_END)
+      ended = began;
+  }
+  EXPECT_TRUE(began);
+  EXPECT_TRUE(ended);
+
+  release_platform(platform);
+}
+
 TEST_F(PlatformInputProcessorTest, CanReadEventInBlockMode) {
   const auto input_processor = get_input_processor(platform);
   EXPECT_NE(nullptr, input_processor);
@@ -1112,6 +1444,91 @@ TEST_F(PlatformInputProcessorTest, ReadEventDoesNotForwardInvalidEvents) {
   ASSERT_EQ(ret, -EIO);
 }
 
+TEST_F(PlatformInputProcessorTest, CanReadMultipleEventsInBatch) {
+  const auto input_processor = get_input_processor(platform);
+  ASSERT_NE(nullptr, input_processor);
+
+  std::vector<AnboxInputEvent> injected;
+  for (size_t n = 0; n < event_numbers; n++) {
+    auto code_index = n % (KEY_UNKNOWN - KEY_RESERVED);
+    auto value_index = n % event_value_numbers;
+    injected.push_back(AnboxInputEvent{TOUCHPANEL, 0, EV_ABS,
+                                       (uint16_t)(KEY_RESERVED + code_index),
+                                       (int32_t)value_index});
+  }
+  int ret = input_processor_inject_events(input_processor, injected.data(), injected.size());
+  EXPECT_EQ(ret, 0);
+
+  size_t read = 0;
+  AnboxInputEvent events[event_batch_size];
+  while (read < injected.size()) {
+    ret = input_processor_read_events(input_processor, events, event_batch_size, 1000);
+    ASSERT_GT(ret, 0);
+    ASSERT_LE(ret, event_batch_size);
+    for (int n = 0; n < ret; n++, read++) {
+      EXPECT_EQ(events[n].device_type, injected[read].device_type);
+      EXPECT_EQ(events[n].type, injected[read].type);
+      EXPECT_EQ(events[n].code, injected[read].code);
+      EXPECT_EQ(events[n].value, injected[read].value);
+    }
+  }
+  EXPECT_EQ(read, injected.size());
+
+  // The event queue is empty now, so any call to read_events must error out after 1s timeout.
+  ret = input_processor_read_events(input_processor, events, event_batch_size, 1000);
+  EXPECT_EQ(ret, -EIO);
+}
+
+TEST_F(PlatformInputProcessorTest, ReadEventsReturnsOnlyAvailableEvents) {
+  const auto input_processor = get_input_processor(platform);
+  ASSERT_NE(nullptr, input_processor);
+
+  AnboxInputEvent events[event_batch_size];
+  int ret = input_processor_read_events(input_processor, events, event_batch_size, 0);
+  EXPECT_EQ(ret, -EIO); // return immediately as no event in the queue at this moment.
+
+  // A single multi-touch frame terminated by a SYN_REPORT
+  const AnboxInputEvent frame[] = {
+    {TOUCHPANEL, 0, EV_ABS, ABS_MT_SLOT, 0},
+    {TOUCHPANEL, 0, EV_ABS, ABS_MT_POSITION_X, 100},
+    {TOUCHPANEL, 0, EV_ABS, ABS_MT_POSITION_Y, 200},
+    {TOUCHPANEL, 0, EV_SYN, SYN_REPORT, 0},
+  };
+  const size_t frame_size = sizeof(frame) / sizeof(frame[0]);
+  ret = input_processor_inject_events(input_processor, frame, frame_size);
+  EXPECT_EQ(ret, 0);
+
+  ret = input_processor_read_events(input_processor, events, event_batch_size, 0);
+  ASSERT_EQ(ret, static_cast<int>(frame_size));
+  EXPECT_EQ(events[frame_size - 1].type, EV_SYN);
+  EXPECT_EQ(events[frame_size - 1].code, SYN_REPORT);
+
+  ret = input_processor_read_events(input_processor, nullptr, event_batch_size, 0);
+  EXPECT_EQ(ret, -EINVAL);
+}
+
+TEST_F(PlatformInputProcessorTest, EventFdSignalsAvailableEvents) {
+  const auto input_processor = get_input_processor(platform);
+  ASSERT_NE(nullptr, input_processor);
+
+  const int fd = input_processor_get_fd(input_processor);
+  if (fd < 0)
+    GTEST_SKIP() << "Input processor does not provide an event fd";
+
+  AnboxInputEvent input_ev;
+  EXPECT_EQ(input_processor_read_event(input_processor, &input_ev, 0), -EIO);
+  EXPECT_FALSE(is_readable(fd, 0));
+
+  int ret = input_processor_inject_event(input_processor, AnboxInputEvent{KEYBOARD, 0, EV_KEY, KEY_ENTER, 0});
+  EXPECT_EQ(ret, 0);
+  EXPECT_TRUE(is_readable(fd, timeout_in_secs * 1000));
+  EXPECT_EQ(input_processor_read_event(input_processor, &input_ev, 0), 0);
+
+  // Once the queue is drained the fd must not stay readable
+  EXPECT_EQ(input_processor_read_event(input_processor, &input_ev, 0), -EIO);
+  EXPECT_FALSE(is_readable(fd, 0));
+}
+
 TEST_F(PlatformAudioProcessorTest, CanWriteAudioData) {
   const auto audio_processor = get_audio_processor(platform);
   ASSERT_NE(nullptr, audio_processor);
@@ -1169,6 +1586,198 @@ TEST_F(PlatformAudioProcessorTest, WriteAudioDataWithFlakyData) {
   EXPECT_EQ(written_size, -EIO);
 }
 
+TEST_F(PlatformAudioProcessorTest, CanWriteMultipleChunksOfAudioData) {
+  const auto audio_processor = get_audio_processor(platform);
+  ASSERT_NE(nullptr, audio_processor);
+
+  RandomDataGenerator pcm_generator;
+  uint8_t buf[big_chunk_size];
+  auto read_size = pcm_generator.generate(buf, sizeof(buf));
+  ASSERT_EQ(sizeof(buf), read_size);
+
+  // Split the buffer into chunks of different sizes, including an empty one
+  const AnboxIoVec iov[] = {
+    {buf, 1000},
+    {buf + 1000, 0},
+    {buf + 1000, 3000},
+    {buf + 4000, sizeof(buf) - 4000},
+  };
+  auto written_size = audio_processor_write_datav(audio_processor, iov, sizeof(iov) / sizeof(iov[0]));
+  EXPECT_EQ(static_cast<ssize_t>(sizeof(buf)), written_size);
+}
+
+TEST_F(PlatformAudioProcessorTest, KeepsAcceptingAudioDataAfterUnsupportedConfiguration) {
+  const auto audio_processor = get_audio_processor(platform);
+  ASSERT_NE(nullptr, audio_processor);
+
+  AnboxPlatformConfigurationInfo info{0, nullptr};
+  if (get_config_item(platform, PLATFORM_CONFIGURATION_INFO, &info, sizeof(info)) < 0 || info.num_items == 0)
+    GTEST_SKIP() << "Platform does not provide platform specific configuration items";
+  ASSERT_NE(nullptr, info.items);
+
+  auto set_config_item = export_symbol<AnboxPlatformSetConfigItemFunc>(
+              anbox_platform_set_config_item_name);
+  ASSERT_NE(nullptr, set_config_item);
+
+  RandomDataGenerator pcm_generator;
+  uint8_t buf[big_chunk_size];
+  for (uint16_t n = 0; n < info.num_items; n++) {
+    const auto item = info.items[n];
+    ASSERT_NE(nullptr, item);
+
+    // Whether the platform rejects the value or fails to apply it, the audio
+    // written afterwards must still be taken.
+    const auto key = static_cast<AnboxPlatformConfigurationKey>(item->id);
+    uint32_t uint32_value = 0, unsupported_uint32 = UINT32_MAX;
+    char string_value[MAX_STRING_LENGTH] = {'\0'};
+    char unsupported_string[] = "anbox-platform-tester-unsupported";
+    switch (item->type) {
+    case UINT32:
+      ASSERT_EQ(0, get_config_item(platform, key, &uint32_value, sizeof(uint32_value))) << item->name;
+      set_config_item(platform, key, &unsupported_uint32, sizeof(unsupported_uint32));
+      break;
+    case STRING:
+      ASSERT_EQ(0, get_config_item(platform, key, string_value, sizeof(string_value) - 1)) << item->name;
+      set_config_item(platform, key, unsupported_string, sizeof(unsupported_string));
+      break;
+    default:
+      continue;
+    }
+
+    auto read_size = pcm_generator.generate(buf, sizeof(buf));
+    ASSERT_EQ(sizeof(buf), read_size);
+    EXPECT_EQ(static_cast<ssize_t>(read_size), audio_processor_write_data(audio_processor, buf, read_size))
+      << item->name;
+
+    if (item->type == UINT32)
+      EXPECT_EQ(0, set_config_item(platform, key, &uint32_value, sizeof(uint32_value))) << item->name;
+    else
+      EXPECT_EQ(0, set_config_item(platform, key, string_value, strlen(string_value) + 1)) << item->name;
+  }
+}
+
+TEST_F(PlatformAudioProcessorTest, WriteMultipleChunksOfAudioDataWithFlakyData) {
+  const auto audio_processor = get_audio_processor(platform);
+  ASSERT_NE(nullptr, audio_processor);
+
+  EXPECT_EQ(audio_processor_write_datav(audio_processor, nullptr, 1), -EIO);
+
+  const AnboxIoVec iov{nullptr, 0};
+  EXPECT_EQ(audio_processor_write_datav(audio_processor, &iov, 0), -EIO);
+}
+
+TEST_F(PlatformAudioProcessorTest, CanWriteTimestampedAudioData) {
+  const auto audio_processor = get_audio_processor(platform);
+  ASSERT_NE(nullptr, audio_processor);
+
+  AnboxAudioSpec spec;
+  ASSERT_EQ(0, get_config_item(platform, AUDIO_SPEC, &spec, sizeof(spec)));
+  const uint64_t bytes_per_sec = spec.freq * spec.channels * 2;
+
+  // Timestamps follow the amount of audio data written like a real stream would
+  RandomDataGenerator pcm_generator;
+  uint8_t buf[big_chunk_size];
+  uint64_t timestamp_ns = monotonic_time_in_ns();
+  for (int n = 0; n < 10; n++) {
+    auto read_size = pcm_generator.generate(buf, sizeof(buf));
+    ASSERT_LT(0, read_size);
+    auto written_size = audio_processor_write_data_timestamped(audio_processor, buf, read_size, timestamp_ns);
+    EXPECT_EQ(static_cast<ssize_t>(read_size), written_size);
+    timestamp_ns += read_size * 1000000000ULL / bytes_per_sec;
+  }
+}
+
+TEST_F(PlatformAudioProcessorTest, CanQueryPresentationPosition) {
+  const auto audio_processor = get_audio_processor(platform);
+  ASSERT_NE(nullptr, audio_processor);
+
+  uint64_t frames = 0, time_ns = 0;
+  EXPECT_EQ(-EINVAL, audio_processor_get_presentation_position(nullptr, &frames, &time_ns));
+  if (audio_processor_get_presentation_position(audio_processor, &frames, &time_ns) == -EIO)
+    GTEST_SKIP() << "Platform does not report the presentation position";
+
+  RandomDataGenerator pcm_generator;
+  uint8_t buf[big_chunk_size];
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_in_secs);
+  int ret = -EAGAIN;
+  while (std::chrono::steady_clock::now() < deadline) {
+    auto read_size = pcm_generator.generate(buf, sizeof(buf));
+    ASSERT_LT(0, read_size);
+    audio_processor_write_data_timestamped(audio_processor, buf, read_size, monotonic_time_in_ns());
+    ret = audio_processor_get_presentation_position(audio_processor, &frames, &time_ns);
+    if (ret == 0 && frames > 0)
+      break;
+  }
+  ASSERT_EQ(0, ret);
+  EXPECT_GT(frames, 0u);
+  EXPECT_LE(time_ns, monotonic_time_in_ns());
+
+  // The position must never go backwards
+  uint64_t later_frames = 0, later_time_ns = 0;
+  ASSERT_EQ(0, audio_processor_get_presentation_position(audio_processor, &later_frames, &later_time_ns));
+  EXPECT_GE(later_frames, frames);
+  EXPECT_GE(later_time_ns, time_ns);
+}
+
+TEST_F(PlatformAudioProcessorTest, CanWriteAudioDataThroughSharedRing) {
+  AnboxAudioSharedRing desc;
+  if (get_config_item(platform, AUDIO_SHARED_RING, &desc, sizeof(desc)) < 0)
+    GTEST_SKIP() << "Platform does not provide a shared audio ring";
+
+  auto ring = anbox::AudioSharedRing::attach(desc);
+  ASSERT_NE(nullptr, ring);
+  ASSERT_GT(ring->period_bytes(), 0u);
+
+  // Anbox acts as producer and the platform has to keep draining the ring.
+  RandomDataGenerator pcm_generator;
+  uint8_t buf[big_chunk_size];
+  size_t total = 0;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_in_secs);
+  while (total < 4 * ring->capacity() && std::chrono::steady_clock::now() < deadline) {
+    auto read_size = pcm_generator.generate(buf, sizeof(buf));
+    ASSERT_LT(0, read_size);
+    size_t offset = 0;
+    while (offset < read_size && std::chrono::steady_clock::now() < deadline) {
+      const auto written = ring->write(buf + offset, read_size - offset);
+      if (written == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      offset += written;
+    }
+    total += offset;
+  }
+  EXPECT_GE(total, 4 * ring->capacity());
+
+  // Everything but an incomplete period must be consumed eventually.
+  while (ring->size() >= ring->period_bytes() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_LT(ring->size(), ring->period_bytes());
+}
+
+TEST_F(PlatformAudioProcessorTest, RejectsCorruptedSharedRing) {
+  AnboxAudioSharedRing desc;
+  if (get_config_item(platform, AUDIO_SHARED_RING, &desc, sizeof(desc)) < 0)
+    GTEST_SKIP() << "Platform does not provide a shared audio ring";
+
+  // Act as a misbehaving peer which moves its cursor past the capacity
+  auto header = static_cast<AnboxAudioSharedRingHeader*>(
+      mmap(nullptr, desc.size, PROT_READ | PROT_WRITE, MAP_SHARED, desc.memfd, 0));
+  ASSERT_NE(MAP_FAILED, static_cast<void*>(header));
+  const auto read_cursor = __atomic_load_n(&header->read_cursor, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&header->write_cursor, read_cursor + 2 * uint64_t{header->capacity}, __ATOMIC_RELEASE);
+
+  auto ring = anbox::AudioSharedRing::attach(desc);
+  ASSERT_NE(nullptr, ring);
+  EXPECT_TRUE(ring->corrupted());
+  EXPECT_EQ(0u, ring->size());
+  uint8_t buf[small_chunk_size] = {0};
+  EXPECT_EQ(0u, ring->write(buf, sizeof(buf)));
+  EXPECT_EQ(0u, ring->read(buf, sizeof(buf)));
+
+  // The platform must neither crash nor overwrite memory outside of the ring
+  EXPECT_EQ(-EIO, audio_processor_write_data(get_audio_processor(platform), buf, sizeof(buf)));
+  munmap(header, desc.size);
+}
+
 TEST_F(PlatformAudioProcessorTest, CanReadAudioData) {
   const auto audio_processor = get_audio_processor(platform);
   ASSERT_NE(nullptr, audio_processor);
@@ -1178,6 +1787,32 @@ TEST_F(PlatformAudioProcessorTest, CanReadAudioData) {
   EXPECT_LT(0, read_size);
 }
 
+TEST_F(PlatformAudioProcessorTest, ReadsAudioDataWithinOnePeriod) {
+  const auto audio_processor = get_audio_processor(platform);
+  ASSERT_NE(nullptr, audio_processor);
+
+  AnboxAudioSpec spec;
+  ASSERT_EQ(0, get_config_item(platform, AUDIO_INPUT_SPEC, &spec, sizeof(spec)));
+  const auto frame_size = spec.channels * anbox::pcm::bytes_per_sample(spec.format);
+  ASSERT_GT(frame_size, 0u);
+  ASSERT_GT(spec.freq, 0u);
+  const auto period = std::chrono::microseconds(1000000ULL * spec.samples / spec.freq);
+
+  // Read in quarter periods for two periods. Without any audio source the
+  // platform has to fill in silence instead of blocking the caller.
+  const size_t chunk_size = std::max<size_t>(spec.samples / 4, 1) * frame_size;
+  std::vector<uint8_t> data(chunk_size);
+  for (int n = 0; n < 8; n++) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto read_size = audio_processor_read_data(audio_processor, data.data(), data.size());
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (read_size == -EIO && n == 0)
+      GTEST_SKIP() << "Platform does not capture audio";
+    EXPECT_EQ(static_cast<ssize_t>(chunk_size), read_size);
+    EXPECT_LT(elapsed, period);
+  }
+}
+
 TEST_F(PlatformAudioProcessorTest, CanDoAudioStandby) {
   const auto audio_processor = get_audio_processor(platform);
   ASSERT_NE(nullptr, audio_processor);
@@ -1189,6 +1824,38 @@ TEST_F(PlatformAudioProcessorTest, CanDoAudioStandby) {
   EXPECT_EQ(0, ret);
 }
 
+TEST_F(PlatformAudioProcessorTest, IdlesInStandby) {
+  const auto audio_processor = get_audio_processor(platform);
+  ASSERT_NE(nullptr, audio_processor);
+
+  // Get the audio pipeline going before it goes into standby
+  std::vector<uint8_t> data(big_chunk_size);
+  RandomDataGenerator pcm_generator;
+  for (int n = 0; n < 16; n++) {
+    const auto size = pcm_generator.generate(data.data(), data.size());
+    audio_processor_write_data(audio_processor, data.data(), size);
+  }
+
+  ASSERT_EQ(0, audio_processor_standby(audio_processor, AUDIO_OUTPUT_STREAM));
+  ASSERT_EQ(0, audio_processor_standby(audio_processor, AUDIO_INPUT_STREAM));
+  // Give the plugin a moment to flush what is still queued
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  // Hundreds of idle containers share a host, so the plugin must not wake
+  // up periodically while both streams are in standby.
+  const auto start_cpu = process_cpu_time_in_ns();
+  const auto start = monotonic_time_in_ns();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  const auto cpu_time = process_cpu_time_in_ns() - start_cpu;
+  const auto elapsed = monotonic_time_in_ns() - start;
+  EXPECT_LT(cpu_time, elapsed / 100) << "CPU time spent in standby: " << cpu_time / 1000 << "us";
+
+  ASSERT_EQ(0, audio_processor_activate(audio_processor, AUDIO_OUTPUT_STREAM));
+  ASSERT_EQ(0, audio_processor_activate(audio_processor, AUDIO_INPUT_STREAM));
+  const auto size = pcm_generator.generate(data.data(), data.size());
+  EXPECT_EQ(size, audio_processor_write_data(audio_processor, data.data(), size));
+}
+
 TEST_F(PlatformAudioProcessorTest, ReadAudioDataWithFlakyData) {
   const auto audio_processor = get_audio_processor(platform);
   ASSERT_NE(nullptr, audio_processor);
@@ -1347,6 +2014,33 @@ TEST_F(PlatformSensorProcessorTest, CanReadDataInNonblockMode) {
   EXPECT_TRUE(valid_sensor_data(data, -1.0, 1.0));
 }
 
+TEST_F(PlatformSensorProcessorTest, EventFdSignalsAvailableData) {
+  const auto sensor_processor = get_sensor_processor(platform);
+  ASSERT_NE(nullptr, sensor_processor);
+
+  const int fd = sensor_processor_get_fd(sensor_processor);
+  if (fd < 0)
+    GTEST_SKIP() << "Sensor processor does not provide an event fd";
+
+  AnboxSensorData sensor_data;
+  EXPECT_EQ(sensor_processor_read_data(sensor_processor, &sensor_data, 0), -EIO);
+  EXPECT_FALSE(is_readable(fd, 0));
+
+  SensorDataGenerator sensor_data_generator;
+  AnboxSensorData data;
+  int ret = sensor_data_generator.generate(&data);
+  ASSERT_EQ(ret, 0);
+
+  ret = sensor_processor_inject_data(sensor_processor, data);
+  EXPECT_EQ(ret, 0);
+  EXPECT_TRUE(is_readable(fd, timeout_in_secs * 1000));
+  EXPECT_EQ(sensor_processor_read_data(sensor_processor, &sensor_data, 0), 0);
+
+  // Once the queue is drained the fd must not stay readable
+  EXPECT_EQ(sensor_processor_read_data(sensor_processor, &sensor_data, 0), -EIO);
+  EXPECT_FALSE(is_readable(fd, 0));
+}
+
 TEST_F(PlatformProxyTest, CanInvokeCallbackFunctionsWhenSet) {
   const auto anbox_proxy = get_proxy(platform);
   ASSERT_NE(nullptr, anbox_proxy);
@@ -1600,6 +2294,33 @@ TEST_F(PlatformGpsProcessorTest, CanReadDataInNonblockMode) {
   EXPECT_EQ(ret, 0);
 }
 
+TEST_F(PlatformGpsProcessorTest, EventFdSignalsAvailableData) {
+  const auto gps_processor = get_gps_processor(platform);
+  ASSERT_NE(nullptr, gps_processor);
+
+  const int fd = gps_processor_get_fd(gps_processor);
+  if (fd < 0)
+    GTEST_SKIP() << "GPS processor does not provide an event fd";
+
+  AnboxGpsData gps_data;
+  EXPECT_EQ(gps_processor_read_data(gps_processor, &gps_data, 0), -EIO);
+  EXPECT_FALSE(is_readable(fd, 0));
+
+  GpsDataGenerator gps_data_generator;
+  AnboxGpsData data;
+  int ret = gps_data_generator.generate(&data);
+  ASSERT_EQ(ret, 0);
+
+  ret = gps_processor_inject_data(gps_processor, data);
+  EXPECT_EQ(ret, 0);
+  EXPECT_TRUE(is_readable(fd, timeout_in_secs * 1000));
+  EXPECT_EQ(gps_processor_read_data(gps_processor, &gps_data, 0), 0);
+
+  // Once the queue is drained the fd must not stay readable
+  EXPECT_EQ(gps_processor_read_data(gps_processor, &gps_data, 0), -EIO);
+  EXPECT_FALSE(is_readable(fd, 0));
+}
+
 TEST_F(PlatformCameraProcessorTest, CannotReadFramesWhenCameraIsNotOpen) {
   auto camera_processor = get_camera_processor(platform);
   ASSERT_NE(nullptr, camera_processor);
@@ -1641,18 +2362,50 @@ TEST_F(PlatformCameraProcessorTest, CanReadMultipleVideoFrames) {
 
   OpenCamera(camera_processor);
 
-  VideoFrameGenerator video_frame_generator;
+  // Every frame stays in use until it was rendered
+  VideoFrameGenerator video_frame_generator(video_frame_count);
   for (size_t n = 0; n < video_frame_count; n++) {
-    VideoFrameGenerator video_frame_generator;
     AnboxVideoFrame frame;
-    int ret = video_frame_generator.generate(frame, 1280, 720, VIDEO_FRAME_FORMAT_YUV420);
+    AnboxCallback release;
+    int ret = video_frame_generator.generate(frame, release, 1280, 720, VIDEO_FRAME_FORMAT_YUV420);
     EXPECT_EQ(ret, 0);
-    ret = camera_processor_inject_frame(camera_processor, frame);
+    ret = camera_processor_inject_frame_with_release(camera_processor, frame, &release);
     EXPECT_EQ(ret, 0);
   }
 
-  for (size_t n = 0; n < video_frame_count; n++)
-    RenderFrame(camera_processor);
+  // Frames read by file descriptor tell when and in which order they were
+  // captured, which has to match the order they were injected in.
+  std::vector<uint64_t> latencies;
+  AnboxVideoFrame2 previous{};
+  for (size_t n = 0; n < video_frame_count; n++) {
+    AnboxVideoFrame2 frame;
+    int ret = camera_processor_read_frame2(camera_processor, &frame, -1);
+    if (ret == -EIO && n == 0) {
+      for (; n < video_frame_count; n++)
+        RenderFrame(camera_processor);
+      break;
+    }
+    ASSERT_EQ(ret, 0);
+    const auto now = monotonic_time_in_ns();
+    EXPECT_GT(frame.timestamp_ns, 0u);
+    EXPECT_LE(frame.timestamp_ns, now);
+    if (n > 0) {
+      EXPECT_EQ(frame.sequence, previous.sequence + 1);
+      EXPECT_GE(frame.timestamp_ns, previous.timestamp_ns);
+    }
+    latencies.push_back(now - frame.timestamp_ns);
+    previous = frame;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{1000 / 30});
+    ASSERT_NE(frame.release.callback, nullptr);
+    frame.release.callback(frame.release.user_data);
+  }
+
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    RecordProperty("capture_latency_p50_us", std::to_string(latencies[latencies.size() / 2] / 1000));
+    RecordProperty("capture_latency_max_us", std::to_string(latencies.back() / 1000));
+  }
 
   // The frame queue is empty now, so any call to read_frame must error out after 1s timeout.
   AnboxVideoFrame frame_1;
@@ -1755,10 +2508,11 @@ TEST_F(PlatformCameraProcessorTest, CanReadFrameInBlockMode) {
 
   VideoFrameGenerator video_frame_generator;
   AnboxVideoFrame frame;
-  int ret = video_frame_generator.generate(frame, 1280, 720, VIDEO_FRAME_FORMAT_YUV420);
+  AnboxCallback release;
+  int ret = video_frame_generator.generate(frame, release, 1280, 720, VIDEO_FRAME_FORMAT_YUV420);
   EXPECT_EQ(ret, 0);
 
-  ret = camera_processor_inject_frame(camera_processor, frame);
+  ret = camera_processor_inject_frame_with_release(camera_processor, frame, &release);
   EXPECT_EQ(ret, 0);
 
   RenderFrame(camera_processor);
@@ -1776,18 +2530,1010 @@ TEST_F(PlatformCameraProcessorTest, CanReadFrameInNonblockMode) {
 
   VideoFrameGenerator video_frame_generator;
   AnboxVideoFrame frame;
-  ret = video_frame_generator.generate(frame, 1280, 720, VIDEO_FRAME_FORMAT_YUV420);
+  AnboxCallback release;
+  ret = video_frame_generator.generate(frame, release, 1280, 720, VIDEO_FRAME_FORMAT_YUV420);
   EXPECT_EQ(ret, 0);
 
-  ret = camera_processor_inject_frame(camera_processor, frame);
+  ret = camera_processor_inject_frame_with_release(camera_processor, frame, &release);
   EXPECT_EQ(ret, 0);
 
   RenderFrame(camera_processor);
 }
 
+TEST_F(PlatformCameraProcessorTest, RecyclesVideoFrameBuffers) {
+  const auto camera_processor = get_camera_processor(platform);
+  ASSERT_NE(nullptr, camera_processor);
+
+  OpenCamera(camera_processor);
+
+  // A steady stream of frames keeps reusing the same few buffers, as long
+  // as the processor releases every frame once it was read.
+  VideoFrameGenerator video_frame_generator;
+  for (size_t n = 0; n < video_frame_count; n++) {
+    AnboxVideoFrame frame;
+    AnboxCallback release;
+    ASSERT_EQ(0, video_frame_generator.generate(frame, release, 1280, 720, VIDEO_FRAME_FORMAT_YUV420));
+    ASSERT_EQ(0, camera_processor_inject_frame_with_release(camera_processor, frame, &release));
+
+    AnboxVideoFrame received;
+    AnboxCallback received_release{nullptr, nullptr};
+    ASSERT_EQ(0, camera_processor_read_frame_with_release(camera_processor, &received,
+                                                         &received_release, timeout_in_secs * 1000));
+    EXPECT_EQ(received.size, frame.size);
+    ASSERT_NE(received_release.callback, nullptr);
+    received_release.callback(received_release.user_data);
+  }
+  EXPECT_EQ(0u, video_frame_generator.pool().frames_in_use());
+  EXPECT_LE(video_frame_generator.pool().allocated_frames(), 2u);
+
+  // Frames the processor rejects are released as well
+  AnboxVideoFrame frame;
+  AnboxCallback release;
+  ASSERT_EQ(0, video_frame_generator.generate(frame, release, 640, 480, VIDEO_FRAME_FORMAT_YUV420));
+  ASSERT_EQ(0, camera_processor_inject_frame_with_release(camera_processor, frame, &release));
+  AnboxVideoFrame received;
+  AnboxCallback received_release{nullptr, nullptr};
+  EXPECT_EQ(-EIO, camera_processor_read_frame_with_release(camera_processor, &received,
+                                                          &received_release, timeout_in_secs * 1000));
+  EXPECT_EQ(0u, video_frame_generator.pool().frames_in_use());
+}
+
+TEST_F(PlatformCameraProcessorTest, CanExchangeVideoFramesByFd) {
+  const auto camera_processor = get_camera_processor(platform);
+  ASSERT_NE(nullptr, camera_processor);
+
+  OpenCamera(camera_processor);
+
+  const uint32_t width = 1280, height = 720;
+  const AnboxCameraSpec spec{VIDEO_FRAME_FORMAT_YUV420, CAMERA_FACING_MODE_REAR, 0, width, height};
+  VideoFrameGenerator video_frame_generator;
+  AnboxVideoFrame2 frame;
+  ASSERT_EQ(0, video_frame_generator.generate(frame, width, height, VIDEO_FRAME_FORMAT_YUV420));
+  auto ret = camera_processor_inject_frame2(camera_processor, &frame);
+  if (ret == -EIO) {
+    frame.release.callback(frame.release.user_data);
+    GTEST_SKIP() << "Camera processor does not support video frames by file descriptor";
+  }
+  ASSERT_EQ(0, ret);
+
+  // The frame has to arrive with its layout and content intact
+  AnboxVideoFrame expected;
+  AnboxCallback expected_release;
+  ASSERT_EQ(0, video_frame_generator.generate(expected, expected_release, width, height, VIDEO_FRAME_FORMAT_YUV420));
+
+  AnboxVideoFrame2 received;
+  ASSERT_EQ(0, camera_processor_read_frame2(camera_processor, &received, timeout_in_secs * 1000));
+  ASSERT_GE(received.fd, 0);
+  EXPECT_EQ(received.format, VIDEO_FRAME_FORMAT_YUV420);
+  EXPECT_EQ(received.width, width);
+  EXPECT_EQ(received.height, height);
+  ASSERT_EQ(received.num_planes, 3);
+  auto data = static_cast<uint8_t*>(::mmap(nullptr, received.size, PROT_READ, MAP_SHARED, received.fd, 0));
+  ASSERT_NE(MAP_FAILED, data);
+  for (uint8_t n = 0; n < received.num_planes; n++) {
+    AnboxVideoFrame2 layout;
+    ASSERT_TRUE(anbox::VideoFramePool::describe(spec, &layout));
+    EXPECT_EQ(0, memcmp(data + received.offset[n], expected.data + layout.offset[n], layout.stride[n]));
+  }
+  ::munmap(data, received.size);
+  ASSERT_NE(received.release.callback, nullptr);
+  received.release.callback(received.release.user_data);
+  EXPECT_EQ(0u, video_frame_generator.memfd_pool().frames_in_use());
+
+  // Frames injected by file descriptor can be read by pointer and vice versa
+  ASSERT_EQ(0, video_frame_generator.generate(frame, width, height, VIDEO_FRAME_FORMAT_YUV420));
+  ASSERT_EQ(0, camera_processor_inject_frame2(camera_processor, &frame));
+  AnboxVideoFrame received_frame;
+  AnboxCallback received_release{nullptr, nullptr};
+  ASSERT_EQ(0, camera_processor_read_frame_with_release(camera_processor, &received_frame,
+                                                       &received_release, timeout_in_secs * 1000));
+  ASSERT_EQ(received_frame.size, expected.size);
+  EXPECT_EQ(0, memcmp(received_frame.data, expected.data, expected.size));
+  received_release.callback(received_release.user_data);
+  EXPECT_EQ(0u, video_frame_generator.memfd_pool().frames_in_use());
+
+  ASSERT_EQ(0, camera_processor_inject_frame_with_release(camera_processor, expected, &expected_release));
+  ASSERT_EQ(0, camera_processor_read_frame2(camera_processor, &received, timeout_in_secs * 1000));
+  ASSERT_GE(received.fd, 0);
+  ASSERT_EQ(received.size, expected.size);
+  data = static_cast<uint8_t*>(::mmap(nullptr, received.size, PROT_READ, MAP_SHARED, received.fd, 0));
+  ASSERT_NE(MAP_FAILED, data);
+  EXPECT_EQ(0, video_frame_generator.generate(expected, expected_release, width, height, VIDEO_FRAME_FORMAT_YUV420));
+  EXPECT_EQ(0, memcmp(data, expected.data, expected.size));
+  expected_release.callback(expected_release.user_data);
+  ::munmap(data, received.size);
+  received.release.callback(received.release.user_data);
+  EXPECT_EQ(0u, video_frame_generator.pool().frames_in_use());
+
+  // Frames whose planes don't fit into their memory are rejected and released
+  ASSERT_EQ(0, video_frame_generator.generate(frame, width, height, VIDEO_FRAME_FORMAT_YUV420));
+  frame.stride[0] = width * 2;
+  ASSERT_EQ(0, camera_processor_inject_frame2(camera_processor, &frame));
+  EXPECT_EQ(-EIO, camera_processor_read_frame2(camera_processor, &received, timeout_in_secs * 1000));
+  EXPECT_EQ(0u, video_frame_generator.memfd_pool().frames_in_use());
+}
+
+TEST_F(PlatformCameraProcessorTest, KeepsNewestFramesInMailboxMode) {
+  const auto camera_processor = get_camera_processor(platform);
+  ASSERT_NE(nullptr, camera_processor);
+
+  AnboxCameraSpec* camera_specs{nullptr};
+  size_t camera_specs_len{0};
+  ASSERT_EQ(0, camera_processor_get_device_specs(camera_processor, &camera_specs, &camera_specs_len));
+  ASSERT_GT(camera_specs_len, 0);
+  const auto spec = camera_specs[0];
+
+  const uint32_t mailbox_frames = 2;
+  const AnboxCameraDeliveryOptions options{CAMERA_DELIVERY_MODE_MAILBOX, mailbox_frames};
+  auto ret = camera_processor_open_device_with_options(camera_processor, spec, CAMERA_ORIENTATION_LANDSCAPE,
+                                                       &options);
+  if (ret == -EINVAL)
+    GTEST_SKIP() << "Camera processor does not support the mailbox delivery mode";
+  ASSERT_EQ(0, ret);
+
+  uint64_t dropped_before = 0;
+  ASSERT_EQ(0, camera_processor_get_dropped_frames(camera_processor, &dropped_before));
+
+  // A consumer falling behind only ever gets the newest frames and the
+  // dropped ones are released right away.
+  const size_t injected_frames = 10;
+  VideoFrameGenerator video_frame_generator(injected_frames);
+  for (size_t n = 0; n < injected_frames; n++) {
+    AnboxVideoFrame frame;
+    AnboxCallback release;
+    ASSERT_EQ(0, video_frame_generator.generate(frame, release, spec.width, spec.height, spec.format));
+    ASSERT_EQ(0, camera_processor_inject_frame_with_release(camera_processor, frame, &release));
+  }
+  EXPECT_EQ(mailbox_frames, video_frame_generator.pool().frames_in_use());
+
+  uint64_t dropped = 0;
+  ASSERT_EQ(0, camera_processor_get_dropped_frames(camera_processor, &dropped));
+  EXPECT_EQ(injected_frames - mailbox_frames, dropped - dropped_before);
+
+  uint64_t last_sequence = 0;
+  for (size_t n = 0; n < mailbox_frames; n++) {
+    AnboxVideoFrame2 frame;
+    ret = camera_processor_read_frame2(camera_processor, &frame, 0);
+    if (ret == -EIO) {
+      AnboxVideoFrame legacy_frame;
+      AnboxCallback release{nullptr, nullptr};
+      ASSERT_EQ(0, camera_processor_read_frame_with_release(camera_processor, &legacy_frame, &release, 0));
+      release.callback(release.user_data);
+      continue;
+    }
+    ASSERT_EQ(0, ret);
+    if (n > 0)
+      EXPECT_EQ(last_sequence + 1, frame.sequence);
+    last_sequence = frame.sequence;
+    frame.release.callback(frame.release.user_data);
+  }
+  EXPECT_EQ(0u, video_frame_generator.pool().frames_in_use());
+
+  AnboxVideoFrame frame;
+  AnboxCallback release{nullptr, nullptr};
+  EXPECT_EQ(-EIO, camera_processor_read_frame_with_release(camera_processor, &frame, &release, 0));
+
+  // Reading blocks until a new frame arrives, as in queue mode
+  auto future = std::async(std::launch::async, [&]() {
+    AnboxVideoFrame received;
+    AnboxCallback received_release{nullptr, nullptr};
+    const auto ret = camera_processor_read_frame_with_release(camera_processor, &received, &received_release,
+                                                              timeout_in_secs * 1000);
+    if (ret == 0)
+      received_release.callback(received_release.user_data);
+    return ret;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_EQ(0, video_frame_generator.generate(frame, release, spec.width, spec.height, spec.format));
+  ASSERT_EQ(0, camera_processor_inject_frame_with_release(camera_processor, frame, &release));
+  EXPECT_EQ(0, future.get());
+  EXPECT_EQ(0u, video_frame_generator.pool().frames_in_use());
+
+  EXPECT_EQ(0, camera_processor_close_device(camera_processor));
+}
+
+TEST_F(PlatformCameraProcessorTest, EventFdSignalsAvailableFrames) {
+  const auto camera_processor = get_camera_processor(platform);
+  ASSERT_NE(nullptr, camera_processor);
+
+  const int fd = camera_processor_get_fd(camera_processor);
+  if (fd < 0)
+    GTEST_SKIP() << "Camera processor does not provide an event fd";
+
+  OpenCamera(camera_processor);
+
+  AnboxVideoFrame video_frame;
+  EXPECT_EQ(camera_processor_read_frame(camera_processor, &video_frame, 0), -EIO);
+  EXPECT_FALSE(is_readable(fd, 0));
+
+  VideoFrameGenerator video_frame_generator;
+  AnboxVideoFrame frame;
+  int ret = video_frame_generator.generate(frame, 1280, 720, VIDEO_FRAME_FORMAT_YUV420);
+  EXPECT_EQ(ret, 0);
+
+  ret = camera_processor_inject_frame(camera_processor, frame);
+  EXPECT_EQ(ret, 0);
+  EXPECT_TRUE(is_readable(fd, timeout_in_secs * 1000));
+  ret = camera_processor_read_frame(camera_processor, &video_frame, 0);
+  EXPECT_EQ(ret, 0);
+  if (ret == 0)
+    free(video_frame.data);
+
+  // Once the queue is drained the fd must not stay readable
+  EXPECT_EQ(camera_processor_read_frame(camera_processor, &video_frame, 0), -EIO);
+  EXPECT_FALSE(is_readable(fd, 0));
+}
+
+// The SIMD kernels of the SDK don't depend on the plugin, but are checked on
+// the machine it runs on as they promise the same output as the portable ones.
+TEST(SdkImageKernelsTest, MatchPortableKernels) {
+  using anbox::image::Kernels;
+  using anbox::image::Rotation;
+  using anbox::image::SimdLevel;
+  const auto& scalar = *anbox::image::kernels_for(SimdLevel::Scalar);
+  RandomDataGenerator generator;
+  auto random_bytes = [&](size_t size) {
+    std::vector<uint8_t> data(size);
+    generator.generate(data.data(), size);
+    return data;
+  };
+  // Runs \a op with the portable and the SIMD kernels, each writing \a size bytes
+  auto matches = [&](const Kernels& k, size_t size, auto op) {
+    std::vector<uint8_t> expected(size), actual(size);
+    op(scalar, expected.data());
+    op(k, actual.data());
+    return expected == actual;
+  };
+
+  for (const auto level : {SimdLevel::AVX2, SimdLevel::NEON}) {
+    const auto k = anbox::image::kernels_for(level);
+    if (!k)
+      continue;
+
+    for (const size_t width : kernel_test_sizes) {
+      SCOPED_TRACE(std::string(k->name) + " width " + std::to_string(width));
+      const size_t chroma_width = (width + 1) / 2;
+      const auto y = random_bytes(width), u = random_bytes(chroma_width), v = random_bytes(chroma_width);
+      const auto rgba0 = random_bytes(4 * width), rgba1 = random_bytes(4 * width);
+      const auto uv = random_bytes(2 * width);
+
+      EXPECT_TRUE(matches(*k, 4 * width, [&](const Kernels& kernels, uint8_t* out) {
+        kernels.i420_to_rgba_row(y.data(), u.data(), v.data(), out, width);
+      })) << "i420_to_rgba_row";
+      EXPECT_TRUE(matches(*k, width, [&](const Kernels& kernels, uint8_t* out) {
+        kernels.rgba_to_y_row(rgba0.data(), out, width);
+      })) << "rgba_to_y_row";
+      EXPECT_TRUE(matches(*k, 2 * chroma_width, [&](const Kernels& kernels, uint8_t* out) {
+        kernels.rgba_to_uv_row(rgba0.data(), rgba1.data(), out, out + chroma_width, width);
+      })) << "rgba_to_uv_row";
+      EXPECT_TRUE(matches(*k, 2 * width, [&](const Kernels& kernels, uint8_t* out) {
+        kernels.split_uv_row(uv.data(), out, out + width, width);
+      })) << "split_uv_row";
+      EXPECT_TRUE(matches(*k, 2 * chroma_width, [&](const Kernels& kernels, uint8_t* out) {
+        kernels.merge_uv_row(u.data(), v.data(), out, chroma_width);
+      })) << "merge_uv_row";
+
+      // Rotating covers mirroring and transposing with positive and negative
+      // strides, scaling covers the interpolation of rows.
+      for (const uint32_t height : {1u, 3u, 8u, 17u, 33u}) {
+        SCOPED_TRACE("height " + std::to_string(height));
+        for (const size_t bpp : {1, 4}) {
+          const auto src = random_bytes(bpp * width * height);
+          for (const auto rotation : {Rotation::Rotate0, Rotation::Rotate90, Rotation::Rotate180, Rotation::Rotate270}) {
+            const auto transposed = rotation == Rotation::Rotate90 || rotation == Rotation::Rotate270;
+            const size_t dst_stride = bpp * (transposed ? height : width);
+            EXPECT_TRUE(matches(*k, src.size(), [&](const Kernels& kernels, uint8_t* out) {
+              const auto ret = bpp == 1 ?
+                  anbox::image::rotate_plane(src.data(), width, out, dst_stride, width, height, rotation, kernels) :
+                  anbox::image::rotate_rgba(src.data(), 4 * width, out, dst_stride, width, height, rotation, kernels);
+              ASSERT_EQ(0, ret);
+            })) << "rotate by " << static_cast<int>(rotation) << " bpp " << bpp;
+          }
+
+          for (const uint32_t dst_width : {size_t{1}, (width + 1) / 2, width - width / 3}) {
+            for (const uint32_t dst_height : {1u, (height + 1) / 2, height}) {
+              EXPECT_TRUE(matches(*k, bpp * dst_width * dst_height, [&](const Kernels& kernels, uint8_t* out) {
+                const auto ret = bpp == 1 ?
+                    anbox::image::scale_plane(src.data(), width, width, height, out, dst_width,
+                                              dst_width, dst_height, kernels) :
+                    anbox::image::scale_rgba(src.data(), 4 * width, width, height, out, 4 * dst_width,
+                                             dst_width, dst_height, kernels);
+                ASSERT_EQ(0, ret);
+              })) << "scale to " << dst_width << "x" << dst_height << " bpp " << bpp;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(SdkPcmKernelsTest, MatchPortableKernels) {
+  using anbox::pcm::Kernels;
+  using anbox::pcm::SimdLevel;
+  const auto& scalar = *anbox::pcm::kernels_for(SimdLevel::Scalar);
+  RandomDataGenerator generator;
+  auto random_samples = [&](auto sample, size_t count) {
+    std::vector<decltype(sample)> data(count);
+    generator.generate(reinterpret_cast<uint8_t*>(data.data()), count * sizeof(sample));
+    return data;
+  };
+  // Runs \a op with the portable and the SIMD kernels, each writing \a count
+  // samples of the type of \a sample
+  auto matches = [&](const Kernels& k, auto sample, size_t count, auto op) {
+    std::vector<decltype(sample)> expected(count), actual(count);
+    op(scalar, expected.data());
+    op(k, actual.data());
+    return expected == actual;
+  };
+
+  for (const auto level : {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::NEON}) {
+    const auto k = anbox::pcm::kernels_for(level);
+    if (!k)
+      continue;
+
+    for (const size_t count : kernel_test_sizes) {
+      SCOPED_TRACE(std::string(k->name) + " count " + std::to_string(count));
+      const auto s16 = random_samples(int16_t{}, 2 * count);
+      const auto s32 = random_samples(int32_t{}, count);
+      // Floats beyond [-1.0, 1.0] to saturate and halfway values to check the
+      // rounding of the conversions to integers
+      std::vector<float> f32(2 * count);
+      const auto bits = random_samples(uint32_t{}, 2 * count);
+      for (size_t n = 0; n < f32.size(); n++) {
+        if (n % 4 == 0)
+          f32[n] = (static_cast<int16_t>(bits[n]) + 0.5f) / 32768.0f;
+        else
+          f32[n] = static_cast<float>(bits[n]) / 4294967296.0f * 3.0f - 1.5f;
+      }
+
+      EXPECT_TRUE(matches(*k, float{}, count, [&](const Kernels& kernels, float* out) {
+        kernels.s16_to_float(s16.data(), out, count);
+      })) << "s16_to_float";
+      EXPECT_TRUE(matches(*k, int16_t{}, count, [&](const Kernels& kernels, int16_t* out) {
+        kernels.float_to_s16(f32.data(), out, count);
+      })) << "float_to_s16";
+      for (const float scale : {2147483648.0f, 8388608.0f}) {
+        EXPECT_TRUE(matches(*k, float{}, count, [&](const Kernels& kernels, float* out) {
+          kernels.s32_to_float(s32.data(), out, count, 1.0f / scale);
+        })) << "s32_to_float with scale " << scale;
+      }
+      EXPECT_TRUE(matches(*k, int32_t{}, count, [&](const Kernels& kernels, int32_t* out) {
+        kernels.float_to_s32(f32.data(), out, count, 2147483648.0f, 2147483520.0f);
+      })) << "float_to_s32";
+      EXPECT_TRUE(matches(*k, int32_t{}, count, [&](const Kernels& kernels, int32_t* out) {
+        kernels.float_to_s32(f32.data(), out, count, 8388608.0f, 8388607.0f);
+      })) << "float_to_s32 to Q8.23";
+      for (const float gain : {0.5f, 1.7f}) {
+        EXPECT_TRUE(matches(*k, float{}, count, [&](const Kernels& kernels, float* out) {
+          std::copy_n(f32.begin(), count, out);
+          kernels.gain_float(out, count, gain);
+        })) << "gain_float by " << gain;
+        EXPECT_TRUE(matches(*k, int16_t{}, count, [&](const Kernels& kernels, int16_t* out) {
+          std::copy_n(s16.begin(), count, out);
+          kernels.gain_s16(out, count, gain);
+        })) << "gain_s16 by " << gain;
+      }
+      EXPECT_TRUE(matches(*k, float{}, 2 * count, [&](const Kernels& kernels, float* out) {
+        kernels.mono_to_stereo_float(f32.data(), out, count);
+      })) << "mono_to_stereo_float";
+      EXPECT_TRUE(matches(*k, float{}, count, [&](const Kernels& kernels, float* out) {
+        kernels.stereo_to_mono_float(f32.data(), out, count);
+      })) << "stereo_to_mono_float";
+      EXPECT_TRUE(matches(*k, int16_t{}, 2 * count, [&](const Kernels& kernels, int16_t* out) {
+        kernels.mono_to_stereo_s16(s16.data(), out, count);
+      })) << "mono_to_stereo_s16";
+      EXPECT_TRUE(matches(*k, int16_t{}, count, [&](const Kernels& kernels, int16_t* out) {
+        kernels.stereo_to_mono_s16(s16.data(), out, count);
+      })) << "stereo_to_mono_s16";
+
+      // dot_float sums in a different order, so only the last bits may differ
+      float magnitude = 0.0f;
+      for (size_t n = 0; n < count; n++)
+        magnitude += std::fabs(f32[n] * f32[count + n]);
+      EXPECT_NEAR(scalar.dot_float(f32.data(), f32.data() + count, count),
+                  k->dot_float(f32.data(), f32.data() + count, count), 1e-5f * (magnitude + 1.0f))
+          << "dot_float";
+    }
+  }
+}
+
+namespace {
+struct BenchmarkResult {
+  std::string name;
+  bool skipped{false};
+  size_t errors{0};
+  uint64_t bytes_per_op{0};
+  uint64_t elapsed_ns{0};
+  std::vector<uint64_t> latencies_ns;
+};
+
+// Runs each processor data path of a plugin in a tight loop and reports
+// throughput and latency percentiles as JSON, so plugin releases can be
+// gated on performance regressions.
+class PlatformBenchmark {
+ public:
+  PlatformBenchmark() = default;
+  ~PlatformBenchmark() {
+    if (platform_)
+      release_platform_(platform_);
+    if (handle_)
+      dlclose(handle_);
+  }
+  PlatformBenchmark(const PlatformBenchmark &) = delete;
+  PlatformBenchmark& operator=(const PlatformBenchmark &) = delete;
+
+  int load(const char* path) {
+    handle_ = dlopen(path, RTLD_NOW);
+    if (!handle_) {
+      std::cerr << "ERROR: Failed to load platform: " << dlerror() << std::endl;
+      return -ENOENT;
+    }
+
+    auto create_platform = export_symbol<AnboxInitializePlatformFunc>(anbox_initialize_platform_name);
+    release_platform_ = export_symbol<AnboxReleasePlatformFunc>(anbox_deinitialize_platform_name);
+    auto ready = export_symbol<AnboxPlatformReadyFunc>(anbox_platform_ready_name);
+    auto wait_until_ready = export_symbol<AnboxPlatformWaitUntilReadyFunc>(anbox_platform_wait_until_ready_name);
+    if (!create_platform || !release_platform_ || !ready || !wait_until_ready) {
+      std::cerr << "ERROR: Platform does not export all mandatory symbols" << std::endl;
+      return -EINVAL;
+    }
+
+    platform_ = create_platform(nullptr);
+    if (!platform_) {
+      std::cerr << "ERROR: Failed to create platform" << std::endl;
+      return -EINVAL;
+    }
+    if (!ready(platform_) && wait_until_ready(platform_) != 0) {
+      std::cerr << "ERROR: Platform did not become ready" << std::endl;
+      return -EIO;
+    }
+    return 0;
+  }
+
+  void run(std::ostream& out) {
+    std::vector<BenchmarkResult> results;
+    results.push_back(run_input());
+    results.push_back(run_sensor());
+    results.push_back(run_gps());
+    for (const auto chunk_size : benchmark_audio_chunk_sizes)
+      results.push_back(run_audio(chunk_size));
+    results.push_back(run_camera("camera_roundtrip_720p", 1280, 720));
+    results.push_back(run_camera("camera_roundtrip_1080p", 1920, 1080));
+    results.push_back(run_pooled_camera("camera_pooled_roundtrip_720p", 1280, 720));
+    results.push_back(run_pooled_camera("camera_pooled_roundtrip_1080p", 1920, 1080));
+    results.push_back(run_memfd_camera("camera_memfd_roundtrip_720p", 1280, 720));
+    results.push_back(run_memfd_camera("camera_memfd_roundtrip_1080p", 1920, 1080));
+    run_pcm_kernels(results);
+    run_resampler(results);
+    run_image_kernels(results);
+    print(out, results);
+  }
+
+ private:
+  template <typename function>
+  function export_symbol(const char* symbol_name) {
+    return reinterpret_cast<function>(dlsym(handle_, symbol_name));
+  }
+
+  static BenchmarkResult skipped(const std::string& name) {
+    BenchmarkResult result;
+    result.name = name;
+    result.skipped = true;
+    return result;
+  }
+
+  // Times \a op for the given number of iterations or until the maximum
+  // duration is exceeded. \a prepare runs before every iteration and is
+  // not accounted for.
+  template <typename Prepare, typename Op>
+  static BenchmarkResult measure(const std::string& name, int iterations, uint64_t bytes_per_op,
+                                 Prepare prepare, Op op) {
+    BenchmarkResult result;
+    result.name = name;
+    result.bytes_per_op = bytes_per_op;
+    result.latencies_ns.reserve(iterations);
+
+    const auto deadline = chrono::steady_clock::now() + chrono::seconds(benchmark_max_duration_in_secs);
+    for (int n = 0; n < iterations; n++) {
+      prepare();
+      const auto start = chrono::steady_clock::now();
+      const auto ret = op();
+      const auto end = chrono::steady_clock::now();
+      if (ret < 0) {
+        result.errors++;
+      } else {
+        const auto duration = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+        result.latencies_ns.push_back(duration);
+        result.elapsed_ns += duration;
+      }
+      if (end > deadline)
+        break;
+    }
+    return result;
+  }
+
+  BenchmarkResult run_input() {
+    const std::string name{"input_roundtrip"};
+    auto get_input_processor = export_symbol<AnboxPlatformGetInputProcessorFunc>(
+        anbox_platform_get_input_processor_name);
+    auto inject_event = export_symbol<AnboxInputProcessorInjectEventFunc>(
+        anbox_input_processor_inject_event_name);
+    auto read_event = export_symbol<AnboxInputProcessorReadEventFunc>(
+        anbox_input_processor_read_event_name);
+    if (!get_input_processor || !inject_event || !read_event)
+      return skipped(name);
+    const auto input_processor = get_input_processor(platform_);
+    if (!input_processor)
+      return skipped(name);
+
+    const AnboxInputEvent event{KEYBOARD, 0, EV_KEY, KEY_ENTER, 0};
+    return measure(name, benchmark_iterations, sizeof(AnboxInputEvent), [] {}, [&]() {
+      auto ret = inject_event(input_processor, event);
+      if (ret < 0)
+        return ret;
+      AnboxInputEvent received;
+      return read_event(input_processor, &received, timeout_in_secs * 1000);
+    });
+  }
+
+  BenchmarkResult run_sensor() {
+    const std::string name{"sensor_roundtrip"};
+    auto get_sensor_processor = export_symbol<AnboxPlatformGetSensorProcessorFunc>(
+        anbox_platform_get_sensor_processor_name);
+    auto inject_data = export_symbol<AnboxSensorProcessorInjectDataFunc>(
+        anbox_sensor_processor_inject_data_name);
+    auto read_data = export_symbol<AnboxSensorProcessorReadDataFunc>(
+        anbox_sensor_processor_read_data_name);
+    if (!get_sensor_processor || !inject_data || !read_data)
+      return skipped(name);
+    const auto sensor_processor = get_sensor_processor(platform_);
+    if (!sensor_processor)
+      return skipped(name);
+
+    SensorDataGenerator generator;
+    AnboxSensorData data;
+    return measure(name, benchmark_iterations, sizeof(AnboxSensorData), [&]() {
+      while (generator.generate(&data) != 0) {}
+    }, [&]() {
+      auto ret = inject_data(sensor_processor, data);
+      if (ret < 0)
+        return ret;
+      AnboxSensorData received;
+      return read_data(sensor_processor, &received, timeout_in_secs * 1000);
+    });
+  }
+
+  BenchmarkResult run_gps() {
+    const std::string name{"gps_roundtrip"};
+    auto get_gps_processor = export_symbol<AnboxPlatformGetGpsProcessorFunc>(
+        anbox_platform_get_gps_processor_name);
+    auto inject_data = export_symbol<AnboxGpsProcessorInjectDataFunc>(
+        anbox_gps_processor_inject_data_name);
+    auto read_data = export_symbol<AnboxGpsProcessorReadDataFunc>(
+        anbox_gps_processor_read_data_name);
+    if (!get_gps_processor || !inject_data || !read_data)
+      return skipped(name);
+    const auto gps_processor = get_gps_processor(platform_);
+    if (!gps_processor)
+      return skipped(name);
+
+    GpsDataGenerator generator;
+    AnboxGpsData data;
+    return measure(name, benchmark_iterations, sizeof(AnboxGpsData), [&]() {
+      while (generator.generate(&data) != 0) {}
+    }, [&]() {
+      auto ret = inject_data(gps_processor, data);
+      if (ret < 0)
+        return ret;
+      AnboxGpsData received;
+      return read_data(gps_processor, &received, timeout_in_secs * 1000);
+    });
+  }
+
+  BenchmarkResult run_audio(size_t chunk_size) {
+    const std::string name{"audio_write_" + std::to_string(chunk_size)};
+    auto get_audio_processor = export_symbol<AnboxPlatformGetAudioProcessorFunc>(
+        anbox_platform_get_audio_processor_name);
+    auto write_data = export_symbol<AnboxAudioProcessorWriteDataFunc>(
+        anbox_audio_processor_write_data_name);
+    if (!get_audio_processor || !write_data)
+      return skipped(name);
+    const auto audio_processor = get_audio_processor(platform_);
+    if (!audio_processor)
+      return skipped(name);
+
+    std::vector<uint8_t> chunk(chunk_size);
+    RandomDataGenerator pcm_generator;
+    pcm_generator.generate(chunk.data(), chunk.size());
+    return measure(name, benchmark_audio_iterations, chunk_size, [] {}, [&]() {
+      const auto ret = write_data(audio_processor, chunk.data(), chunk.size());
+      return ret == static_cast<ssize_t>(chunk.size()) ? 0 : -EIO;
+    });
+  }
+
+  // Opens the first camera of the plugin with the given resolution
+  const AnboxCameraProcessor* open_camera(uint32_t width, uint32_t height) {
+    auto get_camera_processor = export_symbol<AnboxPlatformGetCameraProcessorFunc>(
+        anbox_platform_get_camera_processor_name);
+    auto get_device_specs = export_symbol<AnboxCameraProcessorGetDeviceSpecsFunc>(
+        anbox_camera_processor_get_device_specs_name);
+    auto open_device = export_symbol<AnboxCameraProcessorOpenDeviceFunc>(
+        anbox_camera_processor_open_device_name);
+    if (!get_camera_processor || !get_device_specs || !open_device)
+      return nullptr;
+    const auto camera_processor = get_camera_processor(platform_);
+    if (!camera_processor)
+      return nullptr;
+
+    AnboxCameraSpec* specs{nullptr};
+    size_t specs_len{0};
+    if (get_device_specs(camera_processor, &specs, &specs_len) != 0 || !specs || specs_len == 0)
+      return nullptr;
+
+    auto spec = specs[0];
+    spec.format = VIDEO_FRAME_FORMAT_YUV420;
+    spec.width = width;
+    spec.height = height;
+    if (open_device(camera_processor, spec, CAMERA_ORIENTATION_LANDSCAPE) != 0)
+      return nullptr;
+    return camera_processor;
+  }
+
+  BenchmarkResult run_camera(const std::string& name, uint32_t width, uint32_t height) {
+    auto close_device = export_symbol<AnboxCameraProcessorCloseDeviceFunc>(
+        anbox_camera_processor_close_device_name);
+    auto inject_frame = export_symbol<AnboxCameraProcessorInjectFrameFunc>(
+        anbox_camera_processor_inject_frame_name);
+    auto read_frame = export_symbol<AnboxCameraProcessorReadFrameFunc>(
+        anbox_camera_processor_read_frame_name);
+    if (!close_device || !inject_frame || !read_frame)
+      return skipped(name);
+    const auto camera_processor = open_camera(width, height);
+    if (!camera_processor)
+      return skipped(name);
+
+    VideoFrameGenerator generator;
+    AnboxVideoFrame source;
+    if (generator.generate(source, width, height, VIDEO_FRAME_FORMAT_YUV420) != 0) {
+      close_device(camera_processor);
+      return skipped(name);
+    }
+
+    // The camera processor takes ownership of injected frames and hands them
+    // back on read, so every iteration injects a fresh copy of the frame.
+    AnboxVideoFrame frame;
+    auto result = measure(name, benchmark_camera_iterations, source.size, [&]() {
+      frame.size = source.size;
+      frame.data = reinterpret_cast<uint8_t*>(malloc(source.size));
+      memcpy(frame.data, source.data, source.size);
+    }, [&]() {
+      auto ret = inject_frame(camera_processor, frame);
+      if (ret < 0) {
+        free(frame.data);
+        return ret;
+      }
+      AnboxVideoFrame received;
+      ret = read_frame(camera_processor, &received, timeout_in_secs * 1000);
+      if (ret == 0)
+        free(received.data);
+      return ret;
+    });
+
+    free(source.data);
+    close_device(camera_processor);
+    return result;
+  }
+
+  // Same as run_camera() but the frames come from a pool and are handed back
+  // through their release callback, so no iteration allocates or copies.
+  BenchmarkResult run_pooled_camera(const std::string& name, uint32_t width, uint32_t height) {
+    auto close_device = export_symbol<AnboxCameraProcessorCloseDeviceFunc>(
+        anbox_camera_processor_close_device_name);
+    auto inject_frame = export_symbol<AnboxCameraProcessorInjectFrameWithReleaseFunc>(
+        anbox_camera_processor_inject_frame_with_release_name);
+    auto read_frame = export_symbol<AnboxCameraProcessorReadFrameWithReleaseFunc>(
+        anbox_camera_processor_read_frame_with_release_name);
+    if (!close_device || !inject_frame || !read_frame)
+      return skipped(name);
+    const auto camera_processor = open_camera(width, height);
+    if (!camera_processor)
+      return skipped(name);
+
+    const AnboxCameraSpec spec{VIDEO_FRAME_FORMAT_YUV420, CAMERA_FACING_MODE_REAR, 0, width, height};
+    VideoFrameGenerator generator;
+    AnboxVideoFrame frame;
+    AnboxCallback release;
+    bool generated = false;
+    auto result = measure(name, benchmark_camera_iterations, anbox::VideoFramePool::frame_size(spec), [&]() {
+      generated = generator.generate(frame, release, width, height, VIDEO_FRAME_FORMAT_YUV420) == 0;
+    }, [&]() {
+      if (!generated)
+        return -ENOMEM;
+      auto ret = inject_frame(camera_processor, frame, &release);
+      if (ret < 0) {
+        release.callback(release.user_data);
+        return ret;
+      }
+      AnboxVideoFrame received;
+      AnboxCallback received_release;
+      ret = read_frame(camera_processor, &received, &received_release, timeout_in_secs * 1000);
+      if (ret == 0)
+        received_release.callback(received_release.user_data);
+      return ret;
+    });
+
+    close_device(camera_processor);
+    return result;
+  }
+
+  // Same as run_pooled_camera() but the frames are handed over by file
+  // descriptor, which is what a frame crossing a process boundary costs.
+  BenchmarkResult run_memfd_camera(const std::string& name, uint32_t width, uint32_t height) {
+    auto close_device = export_symbol<AnboxCameraProcessorCloseDeviceFunc>(
+        anbox_camera_processor_close_device_name);
+    auto inject_frame = export_symbol<AnboxCameraProcessorInjectFrame2Func>(
+        anbox_camera_processor_inject_frame2_name);
+    auto read_frame = export_symbol<AnboxCameraProcessorReadFrame2Func>(
+        anbox_camera_processor_read_frame2_name);
+    if (!close_device || !inject_frame || !read_frame)
+      return skipped(name);
+    const auto camera_processor = open_camera(width, height);
+    if (!camera_processor)
+      return skipped(name);
+
+    const AnboxCameraSpec spec{VIDEO_FRAME_FORMAT_YUV420, CAMERA_FACING_MODE_REAR, 0, width, height};
+    VideoFrameGenerator generator;
+    AnboxVideoFrame2 frame;
+    bool generated = false;
+    auto result = measure(name, benchmark_camera_iterations, anbox::VideoFramePool::frame_size(spec), [&]() {
+      generated = generator.generate(frame, width, height, VIDEO_FRAME_FORMAT_YUV420) == 0;
+    }, [&]() {
+      if (!generated)
+        return -ENOMEM;
+      auto ret = inject_frame(camera_processor, &frame);
+      if (ret < 0) {
+        frame.release.callback(frame.release.user_data);
+        return ret;
+      }
+      AnboxVideoFrame2 received;
+      ret = read_frame(camera_processor, &received, timeout_in_secs * 1000);
+      if (ret == 0)
+        received.release.callback(received.release.user_data);
+      return ret;
+    });
+
+    close_device(camera_processor);
+    return result;
+  }
+
+  // The PCM kernels of the SDK don't depend on the plugin, but plugins built
+  // for a given machine want to know which instruction set pays off there.
+  static void run_pcm_kernels(std::vector<BenchmarkResult>& results) {
+    const size_t samples = benchmark_pcm_samples;
+    std::vector<int16_t> s16(2 * samples), s16_out(2 * samples);
+    std::vector<int32_t> s32(samples), s32_out(samples);
+    std::vector<float> f32(2 * samples), f32_out(2 * samples);
+    RandomDataGenerator generator;
+    generator.generate(reinterpret_cast<uint8_t*>(s16.data()), s16.size() * sizeof(int16_t));
+    generator.generate(reinterpret_cast<uint8_t*>(s32.data()), s32.size() * sizeof(int32_t));
+    anbox::pcm::kernels().s16_to_float(s16.data(), f32.data(), f32.size());
+
+    using anbox::pcm::SimdLevel;
+    for (const auto level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::NEON}) {
+      const auto k = anbox::pcm::kernels_for(level);
+      if (!k)
+        continue;
+
+      auto bench = [&](const char* kernel, uint64_t bytes_per_op, auto op) {
+        const auto name = std::string("pcm_") + kernel + "_" + k->name;
+        results.push_back(measure(name, benchmark_pcm_iterations, bytes_per_op, [] {}, [&]() {
+          op();
+          return 0;
+        }));
+      };
+      bench("s16_to_float", samples * sizeof(int16_t), [&]() {
+        k->s16_to_float(s16.data(), f32_out.data(), samples);
+      });
+      bench("float_to_s16", samples * sizeof(float), [&]() {
+        k->float_to_s16(f32.data(), s16_out.data(), samples);
+      });
+      bench("s32_to_float", samples * sizeof(int32_t), [&]() {
+        k->s32_to_float(s32.data(), f32_out.data(), samples, 1.0f / 2147483648.0f);
+      });
+      bench("float_to_s32", samples * sizeof(float), [&]() {
+        k->float_to_s32(f32.data(), s32_out.data(), samples, 2147483648.0f, 2147483520.0f);
+      });
+      bench("gain_float", samples * sizeof(float), [&]() {
+        k->gain_float(f32_out.data(), samples, 1.0f);
+      });
+      bench("gain_s16", samples * sizeof(int16_t), [&]() {
+        k->gain_s16(s16_out.data(), samples, 1.0f);
+      });
+      bench("mono_to_stereo_float", samples * sizeof(float), [&]() {
+        k->mono_to_stereo_float(f32.data(), f32_out.data(), samples);
+      });
+      bench("stereo_to_mono_float", 2 * samples * sizeof(float), [&]() {
+        k->stereo_to_mono_float(f32.data(), f32_out.data(), samples);
+      });
+      bench("mono_to_stereo_s16", samples * sizeof(int16_t), [&]() {
+        k->mono_to_stereo_s16(s16.data(), s16_out.data(), samples);
+      });
+      bench("stereo_to_mono_s16", 2 * samples * sizeof(int16_t), [&]() {
+        k->stereo_to_mono_s16(s16.data(), s16_out.data(), samples);
+      });
+      bench("dot_float", 2 * samples * sizeof(float), [&]() {
+        f32_out[0] = k->dot_float(f32.data(), f32.data() + samples, samples);
+      });
+    }
+  }
+
+  static void run_resampler(std::vector<BenchmarkResult>& results) {
+    const size_t frames = benchmark_pcm_samples / 2;
+    std::vector<int16_t> in(2 * frames);
+    RandomDataGenerator generator;
+    generator.generate(reinterpret_cast<uint8_t*>(in.data()), in.size() * sizeof(int16_t));
+
+    using anbox::AudioResamplerQuality;
+    const std::pair<const char*, AudioResamplerQuality> qualities[] = {
+      {"low", AudioResamplerQuality::Low},
+      {"medium", AudioResamplerQuality::Medium},
+      {"high", AudioResamplerQuality::High},
+    };
+    for (const auto& quality : qualities) {
+      auto resampler = anbox::AudioResampler::create(44100, 48000, 2, quality.second);
+      const auto out_frames = resampler->max_output_frames(frames);
+      std::vector<int16_t> out(2 * out_frames);
+      const auto name = std::string("resample_44100_48000_") + quality.first;
+      results.push_back(measure(name, benchmark_pcm_iterations, in.size() * sizeof(int16_t), [] {}, [&]() {
+        const auto ret = resampler->process_s16(in.data(), frames, out.data(), out_frames);
+        return ret < 0 ? static_cast<int>(ret) : 0;
+      }));
+    }
+  }
+
+  static void run_image_kernels(std::vector<BenchmarkResult>& results) {
+    const uint32_t width = 1280, height = 720;
+    const uint32_t chroma_width = width / 2, chroma_height = height / 2;
+    const size_t luma_size = width * height, chroma_size = chroma_width * chroma_height;
+    std::vector<uint8_t> y(luma_size), u(chroma_size), v(chroma_size), uv(2 * chroma_size);
+    std::vector<uint8_t> y_out(luma_size), u_out(chroma_size), v_out(chroma_size), uv_out(2 * chroma_size);
+    std::vector<uint8_t> rgba(4 * luma_size), rgba_out(4 * luma_size);
+    RandomDataGenerator generator;
+    generator.generate(y.data(), y.size());
+    generator.generate(u.data(), u.size());
+    generator.generate(v.data(), v.size());
+    generator.generate(uv.data(), uv.size());
+    generator.generate(rgba.data(), rgba.size());
+
+    // Downscaling starts from 1080p, so the 720p buffers above are the destination
+    const uint32_t src_width = 1920, src_height = 1080;
+    std::vector<uint8_t> src_y(src_width * src_height), src_u(src_width * src_height / 4);
+    std::vector<uint8_t> src_v(src_width * src_height / 4), src_rgba(4 * src_width * src_height);
+    generator.generate(src_y.data(), src_y.size());
+    generator.generate(src_u.data(), src_u.size());
+    generator.generate(src_v.data(), src_v.size());
+    generator.generate(src_rgba.data(), src_rgba.size());
+
+    using anbox::image::Rotation;
+    using anbox::image::SimdLevel;
+    for (const auto level : {SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::NEON}) {
+      const auto k = anbox::image::kernels_for(level);
+      if (!k)
+        continue;
+
+      auto bench = [&](const char* kernel, uint64_t bytes_per_op, auto op) {
+        const auto name = std::string("image_") + kernel + "_720p_" + k->name;
+        results.push_back(measure(name, benchmark_image_iterations, bytes_per_op, [] {}, op));
+      };
+      bench("i420_to_rgba", luma_size + 2 * chroma_size, [&]() {
+        return anbox::image::i420_to_rgba(y.data(), width, u.data(), chroma_width, v.data(), chroma_width,
+                                          rgba_out.data(), 4 * width, width, height, *k);
+      });
+      bench("rgba_to_i420", rgba.size(), [&]() {
+        return anbox::image::rgba_to_i420(rgba.data(), 4 * width, y_out.data(), width, u_out.data(), chroma_width,
+                                          v_out.data(), chroma_width, width, height, *k);
+      });
+      bench("nv12_to_i420", luma_size + uv.size(), [&]() {
+        return anbox::image::nv12_to_i420(y.data(), width, uv.data(), 2 * chroma_width, y_out.data(), width,
+                                          u_out.data(), chroma_width, v_out.data(), chroma_width,
+                                          width, height, *k);
+      });
+      bench("i420_to_nv12", luma_size + 2 * chroma_size, [&]() {
+        return anbox::image::i420_to_nv12(y.data(), width, u.data(), chroma_width, v.data(), chroma_width,
+                                          y_out.data(), width, uv_out.data(), 2 * chroma_width,
+                                          width, height, *k);
+      });
+      const std::pair<const char*, Rotation> rotations[] = {
+        {"rotate90_i420", Rotation::Rotate90},
+        {"rotate180_i420", Rotation::Rotate180},
+        {"rotate270_i420", Rotation::Rotate270},
+      };
+      for (const auto& rotation : rotations) {
+        const auto transposed = rotation.second != Rotation::Rotate180;
+        const auto stride = transposed ? height : width;
+        const auto chroma_stride = transposed ? chroma_height : chroma_width;
+        bench(rotation.first, luma_size + 2 * chroma_size, [&]() {
+          return anbox::image::rotate_i420(y.data(), width, u.data(), chroma_width, v.data(), chroma_width,
+                                           y_out.data(), stride, u_out.data(), chroma_stride,
+                                           v_out.data(), chroma_stride, width, height, rotation.second, *k);
+        });
+      }
+      bench("rotate90_rgba", rgba.size(), [&]() {
+        return anbox::image::rotate_rgba(rgba.data(), 4 * width, rgba_out.data(), 4 * height,
+                                         width, height, Rotation::Rotate90, *k);
+      });
+      bench("scale_from_1080p_i420", src_y.size() + src_u.size() + src_v.size(), [&]() {
+        return anbox::image::scale_i420(src_y.data(), src_width, src_u.data(), src_width / 2,
+                                        src_v.data(), src_width / 2, src_width, src_height,
+                                        y_out.data(), width, u_out.data(), chroma_width,
+                                        v_out.data(), chroma_width, width, height, *k);
+      });
+      bench("scale_from_1080p_rgba", src_rgba.size(), [&]() {
+        return anbox::image::scale_rgba(src_rgba.data(), 4 * src_width, src_width, src_height,
+                                        rgba_out.data(), 4 * width, width, height, *k);
+      });
+    }
+  }
+
+  static uint64_t percentile(const std::vector<uint64_t>& sorted, int per_mille) {
+    if (sorted.empty())
+      return 0;
+    const auto rank = (sorted.size() * per_mille + 999) / 1000;
+    return sorted[std::max<size_t>(rank, 1) - 1];
+  }
+
+  void print(std::ostream& out, std::vector<BenchmarkResult>& results) const {
+    out << "{\n  \"platform\": \"";
+    for (const char* c = platform_path; *c; c++) {
+      if (*c == '"' || *c == '\\')
+        out << '\\';
+      out << *c;
+    }
+    out << "\",\n  \"benchmarks\": [";
+
+    bool first = true;
+    for (auto& result : results) {
+      out << (first ? "\n" : ",\n") << "    {\"name\": \"" << result.name << "\"";
+      first = false;
+      if (result.skipped) {
+        out << ", \"skipped\": true}";
+        continue;
+      }
+
+      auto& latencies = result.latencies_ns;
+      std::sort(latencies.begin(), latencies.end());
+      const double elapsed_s = result.elapsed_ns / 1e9;
+      const double ops_per_sec = elapsed_s > 0 ? latencies.size() / elapsed_s : 0;
+      out << ", \"iterations\": " << latencies.size()
+          << ", \"errors\": " << result.errors
+          << ", \"ops_per_sec\": " << static_cast<uint64_t>(ops_per_sec)
+          << ", \"bytes_per_sec\": " << static_cast<uint64_t>(ops_per_sec * result.bytes_per_op)
+          << ", \"p50_ns\": " << percentile(latencies, 500)
+          << ", \"p99_ns\": " << percentile(latencies, 990)
+          << ", \"p999_ns\": " << percentile(latencies, 999)
+          << ", \"max_ns\": " << (latencies.empty() ? 0 : latencies.back())
+          << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+  }
+
+  void* handle_{nullptr};
+  AnboxPlatform* platform_{nullptr};
+  AnboxReleasePlatformFunc release_platform_{nullptr};
+};
+} // namespace
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
 
+  bool benchmark = false;
+  if (argc == 3 && strcmp(argv[1], "--benchmark") == 0) {
+    benchmark = true;
+    argv[1] = argv[2];
+    argc = 2;
+  }
+
   if (argc != 2) {
     std::cerr << "ERROR: Invalid number of arguments provided" << std::endl;
     print_usage();
@@ -1801,5 +3547,13 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
+  if (benchmark) {
+    PlatformBenchmark platform_benchmark;
+    if (platform_benchmark.load(platform_path) < 0)
+      return EXIT_FAILURE;
+    platform_benchmark.run(std::cout);
+    return EXIT_SUCCESS;
+  }
+
   return RUN_ALL_TESTS();
 }